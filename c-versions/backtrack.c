@@ -9,218 +9,400 @@
  *		   longest possible prefix such that it's lowercased version
  *		   is a dictionary word**.  But if no solution is found
  *		   having picked the longest word, we backtrack and try the
- *		   next shortest word...
+ *		   next shortest word...  (segment.c finds the same answer
+ *		   without the exponential cost of really backtracking.)
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
-#include <ctype.h>
+#include <limits.h>
+#include <unistd.h>
+#include <getopt.h>
 #include <assert.h>
 
-#include "set.h"
-
-#define min(x,y) ((x)<(y)?(x):(y))
+#include "dict.h"
+#include "lower.h"
+#include "segment.h"
+#include "split.h"
+#include "kbest.h"
+#include "batch.h"
+#include "stream.h"
+#include "stats.h"
 
 // no single word in the dictionary longer than..
 #define MAXWORDLEN 1024
 
-// max number of words in setence..
+// max number of extra words..
 #define MAXWORDS 100
 
+// sentences at least this long are cut at forced word boundaries, and
+// the pieces segmented in parallel (see split.c)
+#define SPLITLEN 65536
+
 typedef char aword[MAXWORDLEN];
 typedef char *wordarray[MAXWORDS];
 
-// while splitting, we represent words within the sentence
-// as a list of lengths eg given "MostEnglishsentencesaremostlylowercase",
-// we'd have 4 (Most), 7 (English), 9 (sentences), 3 (are) etc..
-// this saves copying words out of the original sentence all the time
-typedef int wordinfo[MAXWORDS];
-
+// we represent words within the sentence as spans (see segment.h):
+// an offset and a length, eg given "MostEnglishsentencesaremostlylowercase",
+// we'd have 0,4 (Most), 4,7 (English), 11,9 (sentences), 20,3 (are) etc..
+// this saves copying words out of the original sentence all the time.
 
 
 /*
- * alllower( string );
- *	Lower case the given string, in place.
- */
-void alllower( char *p )
-{
-	for( ; *p; ++p) *p = tolower(*p);
-}
-
-
-/*
- *  set worddset = readdict( wordlistfile, extra_words[], int *longest );
+ *  dictionary dict = readdict( wordlistfile, extra_words[], backend );
  *	Read a word list <wordlistfile> (and add some extra words contained
- *	in <extra_words[]>, terminated by NULL), build and return a set
- *	of all those LOWERCASED words, also setting *longest to the length
- *	of the longest word in the whole set.
+ *	in <extra_words[]>, terminated by NULL), build and return a
+ *	dictionary (using the given <backend>) of all those LOWERCASED
+ *	words.  If <wordlistfile> is a precompiled dictionary image (see
+ *	mkdictimage) we simply map it in instead, ignoring <backend>.
  */
-set readdict( char *wordlistfile, wordarray extra_words, int *longest )
+dictionary readdict( char *wordlistfile, wordarray extra_words, dict_backend backend )
 {
-	set dict = setCreate( NULL );
-	*longest = 0;
-
-	for( char **w = extra_words; *w != NULL; w++ )
+	dictionary dict = dictMapImage( wordlistfile );
+	if( dict == NULL )
 	{
-		// add lowercased word to dictionary
-		alllower( *w );
-		setInclude( dict, *w );
-		// update longest
-		int len = strlen(*w);
-		if( len > *longest ) *longest = len;
+		dict = dictCreate( backend );
+
+		// read every line (word!) of wordlistfile
+		if( dictReadWords( dict, wordlistfile ) == -1 )
+		{
+			fprintf( stderr, "backtrack: can't open %s\n", wordlistfile );
+			exit(1);
+		}
 	}
 
-	// foreach line (word!) in wordlistfile
-	FILE *fh = fopen( wordlistfile, "r" );
-	assert( fh != NULL );
-	aword word;
-	while( fgets(word, MAXWORDLEN, fh ) != NULL )
+	for( char **w = extra_words; *w != NULL; w++ )
 	{
-		// remove trailing '\n' - if not present, line too long: die!
-		char *last = word + strlen(word) - 1;
-		assert( *last == '\n' );
-		*last = '\0';
-
 		// add lowercased word to dictionary
-		alllower( word );
-		setInclude( dict, word );
-		// update longest
-		int len = strlen(word);
-		if( len > *longest ) *longest = len;
+		alllower( *w );
+		dictInclude( dict, *w );
 	}
-	fclose( fh );
 
+	// all words are in: build the automaton that segment() scans with
+	dictAutomaton( dict );
 	return dict;
 }
 
 
 /*
- * convertwords( sentence, nwords, wlen, result );
- *	Given a <sentence> in original case, the number of words <nwords>,
- *	and an array <wlen> of word lengths, build <result>, a word array.
- *	The storage for <result> must have alredy been allocated, but not
- *	the storage for each string (char *).
+ * int nwords = breakwords( sentence, dict, obj, nthreads, sc, spans[] );
+ *	Given a <sentence> with no spaces, and a dictionary <dict>, break
+ *	the original sentence up into words.  With objective <obj> ==
+ *	SegLongestFirst, prefer to pick the longest possible prefix that
+ *	is a word in the dictionary, but "backtrack" to pick shorter
+ *	word-prefixes if necessary; with SegFewestWords, pick the breakdown
+ *	with the fewest words; with SegMostProbable, the most probable one.
+ *	(Either way, segmentSpans() does the work in O(n.L) time, rather
+ *	than actually backtracking, in scratch space <sc>; a very long
+ *	sentence is cut into pieces, which splitSegment() segments with
+ *	up to <nthreads> threads.)
+ *	Each word is stored in spans[] as its offset and length within
+ *	sentence (nothing is copied), which must have room for
+ *	strlen(sentence) entries.
+ *	Return the number of words found - or -1 if no breakdown is possible.
  */
-void convertwords( char *sentence, int nwords, wordinfo wlen, wordarray result )
+int breakwords( char *sentence, dictionary dict, seg_objective obj, int nthreads,
+		segscratch sc, segspan *spans )
 {
-	assert( nwords < MAXWORDS );
-	int size = strlen(sentence) + nwords + 1;
-	assert( size < MAXWORDLEN );
-	char *block = (char *)malloc( size*sizeof(char) );
-	assert( block != NULL );
-	char *dst = block;
-	char *src = sentence;
-	for( int i=0; i<nwords; i++ )
+	int len = strlen(sentence);
+	if( len >= SPLITLEN )
 	{
-		result[i] = dst;
-		// copy wlen chars from src into dst..
-		int l = wlen[i];
-		strncpy( dst, src, l );
-		dst[l] = '\0';
-		//printf( "debug: word %d is %s\n", i, dst );
-		src += l;
-		dst += l+1;
+		return splitSegment( dict, sentence, len, obj, nthreads, spans );
 	}
+	return segmentSpans( dict, sentence, len, obj, sc, spans );
 }
 
 
 /*
- * int nwords = canbreakwords( lc_str, dict, maxwordlen, wordlen[], nwordssofar );
- *	Given a lower-case string <lc_str>, a dictionary set <dict>, and the
- *	length of the longest word in the set <maxwordlen>, try to break
- *	the original sentence up into an array of word lengths, preferring to
- *	pick the longest possible prefix that is a word in the dictionary set,
- *	but backtracking if necessary.
- *	The array of word lengths is built up in wordlen[], no more than
- *	MAXWORDS allowed.
- *	Return the number of words found - or -1 if no breakdown is possible.
+ * printword( word, len, nwordsp );
+ *	streamCreate() callback: print the next <len> char <word>, space
+ *	separated from the previous one, counting words in *nwordsp.
  */
-int canbreakwords( char *lc_str, set dict, int maxwordlen, wordinfo wordlen, int nwordssofar )
+void printword( char *word, int len, void *nwordsp )
 {
-	for( int wlen = min(maxwordlen,strlen(lc_str)); wlen>0; wlen-- )
-	{
-		// consider word starting at lc_str, length wlen:
-		// is it a dict word?
-
-		// temporarly string terminate lc_str at wlen..
-		char ch = lc_str[wlen];
-		lc_str[wlen] = '\0';
+	long *nwords = (long *)nwordsp;
+	if( *nwords > 0 ) putchar( ' ' );
+	fwrite( word, sizeof(char), len, stdout );
+	(*nwords)++;
+}
 
-		// check if lc_str is a word (in dict)?
-		bool isword = setIn( dict, lc_str);
 
-		// found a dictionary word?
-		if( isword )
+/*
+ * char *sentence = readsentence( filename );
+ *	Read the whole of <filename> (- for stdin) as one sentence, leaving
+ *	out line breaks (as stream mode does), into a malloc()d string:
+ *	the command line can't hold a sentence of more than 128K chars.
+ *	Return NULL if we can't open it.
+ */
+char *readsentence( char *filename )
+{
+	FILE *in = strcmp( filename, "-" ) == 0 ? stdin : fopen( filename, "r" );
+	if( in == NULL ) return NULL;
+
+	int max = 65536;
+	int n = 0;
+	char *sentence = (char *) malloc( max*sizeof(char) );
+	assert( sentence != NULL );
+	size_t got;
+	while( (got = fread( sentence+n, sizeof(char), max-1-n, in )) > 0 )
+	{
+		// drop line breaks
+		int m = n;
+		for( int i = n; i < n+got; i++ )
 		{
-			// add wlen to words so far..
-			wordlen[nwordssofar] = wlen;
-			assert( nwordssofar < MAXWORDS );
-
-			//printf( "debug: cbw: found word %s of length %d\n", lc_str, wlen );
-
-			// change it back
-			lc_str[wlen] = ch;
-
-			// have we finished the entire string?
-			if( ch == '\0' )
+			if( sentence[i] != '\n' && sentence[i] != '\r' )
 			{
-				return nwordssofar+1;
+				sentence[m++] = sentence[i];
 			}
+		}
+		n = m;
+		if( n == max-1 )
+		{
+			max *= 2;
+			sentence = (char *) realloc( sentence, max*sizeof(char) );
+			assert( sentence != NULL );
+		}
+	}
+	sentence[n] = '\0';
+	if( in != stdin ) fclose( in );
+	return sentence;
+}
 
-			// try to break the rest..
-			int nwords = canbreakwords( lc_str+wlen, dict, maxwordlen, wordlen, nwordssofar+1 );
-			if( nwords != -1 )
-			{
-				return nwords;
-			}
+
+/*
+ * long nwords = streamwords( in, dict );
+ *	Break the whole text read from <in> (ignoring line breaks) up
+ *	into words, as a single arbitrarily long sentence, printing the
+ *	words as soon as they're certain, using bounded memory.  Return
+ *	the number of words, or -1 if no breakdown is possible.
+ */
+long streamwords( FILE *in, dictionary dict )
+{
+	long nwords = 0;
+	streamseg s = streamCreate( dict, &printword, &nwords );
+
+	char buf[65536];
+	size_t n;
+	int ok = 1;
+	while( ok && (n = fread( buf, sizeof(char), sizeof(buf), in )) > 0 )
+	{
+		// drop line breaks
+		int m = 0;
+		for( int i = 0; i < n; i++ )
+		{
+			if( buf[i] != '\n' && buf[i] != '\r' ) buf[m++] = buf[i];
 		}
+		ok = streamPut( s, buf, m );
+	}
+	ok = ok && streamEnd( s );
+	if( nwords > 0 ) putchar( '\n' );
+	if( ! ok )
+	{
+		fprintf( stderr, "No solution found (after the first %ld chars)\n",
+			streamOffset( s ) );
+		nwords = -1;
+	}
+	streamFree( s );
+	return nwords;
+}
 
-		// change it back
-		lc_str[wlen] = ch;
 
+/*
+ * int nwords = segmentline( lc_line, n, wordlen[], arg, state );
+ *	batchSegment() callback: break the lower-cased <n> char sentence
+ *	<lc_line> up into words, using the dictionary and objective in
+ *	<arg>, and this thread's scratch space in <state>, storing their
+ *	lengths in wordlen[].  Return the number of words found - or -1
+ *	if no breakdown is possible.  A very long sentence is cut up (see
+ *	split.c), but its pieces are segmented by this thread alone: the
+ *	batch's threads are already busy with the other sentences.
+ */
+typedef struct { dictionary dict; seg_objective obj; } segarg;
+typedef struct { segscratch sc; segspan *spans; int maxspans; } linestate;
+int segmentline( char *lc_line, int n, int *wordlen, void *arg, void *state )
+{
+	segarg *a = (segarg *)arg;
+	linestate *ls = (linestate *)state;
+	if( n+1 > ls->maxspans )
+	{
+		ls->maxspans = n+1;
+		ls->spans = (segspan *) realloc( ls->spans, ls->maxspans*sizeof(segspan) );
+		assert( ls->spans != NULL );
 	}
-	return -1;
+	int nwords = n < SPLITLEN ?
+		segmentSpans( a->dict, lc_line, n, a->obj, ls->sc, ls->spans ) :
+		splitSegment( a->dict, lc_line, n, a->obj, 1, ls->spans );
+	for( int i = 0; i < nwords; i++ )
+	{
+		wordlen[i] = ls->spans[i].len;
+	}
+	return nwords;
 }
 
 
 /*
- * int nwords = breakwords( sentence, dict, longestwordlen, words[] );
- *	Given a <sentence> with no spaces, a dictionary set <dict>, and
- *	the length of the longest word in the set <longestwordlen>, break
- *	the original sentence up into an array of words, preferring to pick
- *	the longest possible prefix that is a word in the dictionary set,
- *	but backtracking to pick shorter word-prefixes if necessary.
- *	The array of words is built up in words[], no more than MAXWORDS
- *	allowed.  Each individual word can be no longer than MAXWORDLEN.
- *	Return the number of words found - or -1 if no breakdown is possible.
+ * linestate *ls = newlinestate( arg );
+ *	batchSegment() callback: make a segmenting thread's own state for
+ *	segmentline(), initially empty: it grows to fit the longest line.
  */
-int breakwords( char *sentence, set dict, int longestwordlen, wordarray words )
+void *newlinestate( void *arg )
 {
-	assert( strlen(sentence) < MAXWORDLEN );
-	aword lc_sentence;
-	strcpy( lc_sentence, sentence );
-	alllower( lc_sentence );
+	linestate *ls = (linestate *) malloc( sizeof(linestate) );
+	assert( ls != NULL );
+	ls->sc = segScratchCreate();
+	ls->spans = NULL;
+	ls->maxspans = 0;
+	return (void *) ls;
+}
+
+
+/*
+ * batchSegment() callback: free a thread's segmentline() state
+ */
+void freelinestate( void *state )
+{
+	linestate *ls = (linestate *)state;
+	segScratchFree( ls->sc );
+	free( (void *) ls->spans );
+	free( (void *) ls );
+}
 
-	wordinfo wordlen;
-	int nwords = canbreakwords( lc_sentence, dict, longestwordlen, wordlen, 0 );
 
-	if( nwords == -1 ) return -1;
+/*
+ * int nfound = printkbest( sentence, dict, k );
+ *	Given a <sentence> with no spaces, and a dictionary <dict>, print
+ *	(at most) the <k> most probable breakdowns of the sentence into
+ *	words, best first, with their costs.  Return how many there were.
+ */
+int printkbest( char *sentence, dictionary dict, int k )
+{
+	int len = strlen(sentence);
+	char *lc_sentence = strdup( sentence );
+	int *wordlen = (int *) malloc( (len+1)*sizeof(int) );
+	assert( lc_sentence != NULL && wordlen != NULL );
+	alllower( lc_sentence );
 
-	// now need to extract the words using wordlen[i] = starting posn
-	convertwords( sentence, nwords, wordlen, words );
-	return nwords;
+	kbest kb = kbestCreate( dict, lc_sentence, len );
+	int nfound = 0;
+	int nwords;
+	double cost;
+	while( nfound < k && (nwords = kbestNext( kb, wordlen, &cost )) != -1 )
+	{
+		nfound++;
+		printf( "solution %d, cost %.3f:", nfound, cost );
+		char *word = sentence;
+		for( int i=0; i<nwords; i++ )
+		{
+			printf( " %.*s", wordlen[i], word );
+			word += wordlen[i];
+		}
+		printf( "\n" );
+	}
+	kbestFree( kb );
+	free( (void *) lc_sentence );
+	free( (void *) wordlen );
+	return nfound;
 }
 
 
 aword wordlistfile = "/usr/share/dict/words";
 char *usage =
-	"backtrack (''|wordlistfile) sentencewithoutspaces [extra words]";
+	"backtrack [-t N] [-H|-P] [-f|-p] (''|wordlistfile) sentencewithoutspaces [extra words]\n"
+	"   or: backtrack -l [-t N] [-H|-P] [-f|-p] (''|wordlistfile) (sentencefile|-) [extra words]\n"
+	"   or: backtrack -b [-t N] [-H|-P] [-f|-p] (''|wordlistfile) (sentencefile|-) [extra words]\n"
+	"   or: backtrack -s [-H|-P] (''|wordlistfile) (textfile|-) [extra words]\n"
+	"   or: backtrack -k N (''|wordlistfile) sentencewithoutspaces [extra words]\n"
+	"	-H: probe a hash set with each prefix, rather than walking a trie\n"
+	"	-P: likewise, but a static minimal perfect hash of the word list\n"
+	"	-f: find the breakdown with the fewest words, not longest first\n"
+	"	-p: find the most probable breakdown, given word frequencies\n"
+	"	    (an optional second column in wordlistfile; not with -H)\n"
+	"	-b: batch mode, segment each line of sentencefile (- for stdin)\n"
+	"	-l: read one (very long) sentence from sentencefile (- for stdin),\n"
+	"	    ignoring line breaks\n"
+	"	-t: use N threads (0 means one per CPU): in batch mode, for separate\n"
+	"	    sentences; otherwise, for pieces of a very long sentence\n"
+	"	-s: stream mode, segment all of textfile (- for stdin) as one\n"
+	"	    sentence of any length, finding the fewest words\n"
+	"	-k: print the N most probable breakdowns, best first (not with -H)\n"
+	"	--stats: print search statistics and phase timings on stderr";
+
+struct option longopts[] = {
+	{ "stats", no_argument, NULL, 'S' },
+	{ NULL, 0, NULL, 0 }
+};
 
 int main( int argc, char **argv )
 {
-	if( argc < 3 )
+	dict_backend backend = DictTrie;
+	seg_objective obj = SegLongestFirst;
+	bool batch = false;
+	bool stream = false;
+	bool fromfile = false;
+	int nthreads = 1;
+	bool threads = false;
+	int kbestn = 0;
+	int opt;
+	while( (opt = getopt_long( argc, argv, "+HPfpblt:sk:", longopts, NULL )) != -1 )
+	{
+		if( opt == 'S' )
+		{
+			statsTiming = 1;
+		} else if( opt == 'H' )
+		{
+			backend = DictSet;
+		} else if( opt == 'P' )
+		{
+			backend = DictPerfect;
+		} else if( opt == 'f' )
+		{
+			obj = SegFewestWords;
+		} else if( opt == 'p' )
+		{
+			obj = SegMostProbable;
+		} else if( opt == 'b' )
+		{
+			batch = true;
+		} else if( opt == 'l' )
+		{
+			fromfile = true;
+		} else if( opt == 's' )
+		{
+			stream = true;
+		} else if( opt == 't' )
+		{
+			nthreads = atoi( optarg );
+			if( nthreads <= 0 ) nthreads = sysconf( _SC_NPROCESSORS_ONLN );
+			threads = true;
+		} else if( opt == 'k' )
+		{
+			// N must be a whole number of breakdowns, at least 1
+			char *end;
+			long k = strtol( optarg, &end, 10 );
+			if( end == optarg || *end != '\0' || k < 1 || k > INT_MAX )
+			{
+				fprintf( stderr, "%s\n", usage );
+				exit(1);
+			}
+			kbestn = k;
+			obj = SegMostProbable;
+		} else
+		{
+			fprintf( stderr, "%s\n", usage );
+			exit(1);
+		}
+	}
+	argc -= optind-1;
+	argv += optind-1;
+
+	// a hash set has nowhere to keep word frequencies; stream mode
+	// always finds the fewest words, with one thread
+	if( argc < 3 || (obj == SegMostProbable && backend == DictSet) ||
+	    (kbestn > 0 && (batch || stream)) ||
+	    (fromfile && (batch || stream)) ||
+	    (stream && (batch || threads || obj != SegLongestFirst)) )
 	{
 		fprintf( stderr, "%s\n", usage );
 		exit(1);
@@ -231,22 +413,91 @@ int main( int argc, char **argv )
 	{
 		strcpy( wordlistfile, argv[1] );
 	}
-	aword sentence;
-	strcpy( sentence, argv[2] );
 	int nextra = argc-3;
 	assert( nextra < MAXWORDS );
 
 	char **extra_words = argv+3;
 
-	// dict: the set of all dictionary words, lower cased
-	int maxwordlen=0;
-	set dict = readdict( wordlistfile, extra_words, &maxwordlen );
+	// dict: the dictionary of all words, lower cased
+	double t = statsNow();
+	dictionary dict = readdict( wordlistfile, extra_words, backend );
+	statsPhase( PhaseLoad, t );
+
+	if( stream )
+	{
+		// argv[2] is a file containing one long sentence
+		FILE *in = strcmp( argv[2], "-" ) == 0 ? stdin : fopen( argv[2], "r" );
+		if( in == NULL )
+		{
+			fprintf( stderr, "backtrack: can't open %s\n", argv[2] );
+			exit(1);
+		}
+		// stream mode interleaves everything: count it all as search
+		t = statsNow();
+		long nwords = streamwords( in, dict );
+		statsPhase( PhaseSearch, t );
+		if( in != stdin ) fclose( in );
+		dictFree( dict );
+		if( statsTiming ) statsPrint( stderr );
+		return nwords == -1 ? 1 : 0;
+	}
+
+	if( batch )
+	{
+		// argv[2] is a file of sentences, one per line
+		FILE *in = strcmp( argv[2], "-" ) == 0 ? stdin : fopen( argv[2], "r" );
+		if( in == NULL )
+		{
+			fprintf( stderr, "backtrack: can't open %s\n", argv[2] );
+			exit(1);
+		}
+		segarg arg = { dict, obj };
+		batchSegment( in, stdout, &segmentline, &newlinestate, &freelinestate,
+			      &arg, nthreads );
+		if( in != stdin ) fclose( in );
+		dictFree( dict );
+		if( statsTiming ) statsPrint( stderr );
+		return 0;
+	}
+
+	// argv[2] is the sentence itself, or with -l a file containing it
+	char *sentence = argv[2];
+	if( fromfile )
+	{
+		sentence = readsentence( argv[2] );
+		if( sentence == NULL )
+		{
+			fprintf( stderr, "backtrack: can't open %s\n", argv[2] );
+			exit(1);
+		}
+	}
+
+	int maxwordlen = dictLongest( dict );
 	printf( "read dict, maxwordlen=%d\n", maxwordlen );
 
-	wordarray words;
-	int nwords = breakwords( sentence, dict, maxwordlen, words );
+	if( kbestn > 0 )
+	{
+		t = statsNow();
+		if( printkbest( sentence, dict, kbestn ) == 0 )
+		{
+			printf( "No solution found\n" );
+		}
+		statsPhase( PhaseSearch, t );
+		if( fromfile ) free( (void *) sentence );
+		dictFree( dict );
+		if( statsTiming ) statsPrint( stderr );
+		return 0;
+	}
+
+	segspan *spans = (segspan *) malloc( (strlen(sentence)+1)*sizeof(segspan) );
+	assert( spans != NULL );
+	segscratch sc = segScratchCreate();
+	t = statsNow();
+	int nwords = breakwords( sentence, dict, obj, nthreads, sc, spans );
+	statsPhase( PhaseSearch, t );
 
 	// print results:
+	t = statsNow();
 	if( nwords == -1 )
 	{
 		printf( "No solution found\n" );
@@ -256,11 +507,16 @@ int main( int argc, char **argv )
 		// where's Perl's "join" function when you need it:-)
 		for( int i=0; i<nwords; i++ )
 		{
-			printf( "%s%c", words[i], i==nwords-1?'\n':' ' );
+			printf( "%.*s%c", spans[i].len, sentence+spans[i].off,
+				i==nwords-1?'\n':' ' );
 		}
 	}
-	free( words[0] );
-	setFree( dict );
+	statsPhase( PhaseOutput, t );
+	segScratchFree( sc );
+	free( (void *) spans );
+	if( fromfile ) free( (void *) sentence );
+	dictFree( dict );
+	if( statsTiming ) statsPrint( stderr );
 
 	return 0;
 }
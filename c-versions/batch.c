@@ -0,0 +1,469 @@
+/*
+ * batch.c: segment many sentences, one per line, in a single process
+ *	    (so the dictionary is only loaded once), writing one result
+ *	    line per input line.  Each result line is machine-parseable,
+ *	    with three tab-separated fields:
+ *
+ *		ok<TAB>s1,s2,...,sN<TAB>word1 word2 ... wordN
+ *	    or
+ *		fail<TAB><TAB>original sentence
+ *
+ *	    where s1..sN are the (0-based byte) offsets in the original
+ *	    sentence at which each word starts, and the words are in
+ *	    their original case.  Input lines may end in "\n" or "\r\n",
+ *	    and may be any length.
+ *
+ *	    Given more than one thread, we run a pipeline: a reader
+ *	    thread reads sentences and deals them out round robin to the
+ *	    job queues of a pool of worker threads (all sharing the one
+ *	    read-only dictionary), while the calling thread writes the
+ *	    results strictly in input order.  A worker whose queue is
+ *	    empty steals the oldest job from another worker's queue, so
+ *	    one pathologically long sentence holds up only the worker
+ *	    segmenting it.  At most a window of jobs is in flight at once,
+ *	    and each job's buffers are reused by the job WINDOW later, so
+ *	    memory stays bounded however much input there is.
+ *
+ *	    If statsTiming is set, we add up the time spent lowercasing,
+ *	    segmenting and writing (see stats.h); each worker merges its
+ *	    figures into the totals as it finishes.
+ *
+ * (C) Duncan C. White, 2017
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <assert.h>
+
+#include "batch.h"
+#include "lower.h"
+#include "stats.h"
+
+
+// size of our (fully buffered) output buffer
+#define OUTBUFSIZE 65536
+
+// max jobs in flight, per worker thread
+#define WINDOWPERTHREAD 256
+
+
+// one sentence, and the result of segmenting it
+typedef struct {
+	char *		line;			/* the sentence, and.. */
+	size_t		linesize;
+	int		n;			/* ..it's length */
+	char *		lc_line;		/* lower-cased copy */
+	int *		wordlen;		/* the word lengths.. */
+	int		maxlen;			/* room in lc_line, wordlen */
+	int		nwords;			/* ..and how many, or -1 */
+	int		done;			/* segmented yet? */
+} job;
+
+// a worker's queue of job numbers
+typedef struct {
+	pthread_mutex_t	lock;
+	long *		seq;			/* ring of job numbers.. */
+	int		head;			/* ..the oldest is here.. */
+	int		count;			/* ..and this many of them */
+} jobqueue;
+
+// the whole multi-threaded pipeline
+typedef struct {
+	FILE *		in;
+	batch_segfunc	seg;
+	batch_newstatefunc newstate;
+	batch_freestatefunc freestate;
+	void *		arg;
+	int		nthreads;		/* number of workers */
+	int		window;			/* max jobs in flight */
+	job *		jobs;			/* job seq is jobs[seq%window] */
+	jobqueue *	queue;			/* one per worker */
+	atomic_long	pending;		/* jobs queued, not yet taken */
+	pthread_mutex_t	lock;			/* protects all below.. */
+	pthread_cond_t	space;			/* reader waits for space */
+	pthread_cond_t	work;			/* workers wait for jobs */
+	pthread_cond_t	done;			/* writer waits for a job */
+	long		nread;			/* jobs read so far */
+	long		nwritten;		/* jobs written so far */
+	int		eof;			/* reader finished? */
+} pipeline;
+
+// what each worker thread is given
+typedef struct {
+	pipeline *	p;
+	int		id;
+} workerarg;
+
+
+/* Private functions */
+
+static int readjob( FILE *, job * );
+static void dojob( job *, batch_segfunc, void *, void * );
+static void writejob( FILE *, job * );
+static void freejob( job * );
+static long pipelinesegment( FILE *, FILE *, batch_segfunc, batch_newstatefunc,
+			     batch_freestatefunc, void *, int );
+static void *reader( void * );
+static void *worker( void * );
+static long takejob( pipeline *, int );
+
+
+/*
+ * long nlines = batchSegment( in, out, seg, newstate, freestate, arg, nthreads );
+ *	Read sentences, one per line, from <in>; lowercase and segment
+ *	each one via (*seg)( lc_line, n, wordlen, arg, state ), and write
+ *	the results to <out> (see above), one line per sentence, in order.
+ *	If <nthreads> > 1, segment sentences in parallel on that many
+ *	threads (so seg must be thread-safe).  Each segmenting thread has
+ *	its own state, made by (*newstate)( arg ) and freed by
+ *	(*freestate)( state ) (or NULL, if they are).  Return the number
+ *	of sentences processed.
+ */
+long batchSegment( FILE *in, FILE *out, batch_segfunc seg,
+		   batch_newstatefunc newstate, batch_freestatefunc freestate,
+		   void *arg, int nthreads )
+{
+	setvbuf( out, NULL, _IOFBF, OUTBUFSIZE );
+
+	if( nthreads > 1 )
+	{
+		return pipelinesegment( in, out, seg, newstate, freestate, arg, nthreads );
+	}
+
+	void *state = newstate != NULL ? (*newstate)( arg ) : NULL;
+	job j = { NULL, 0, 0, NULL, NULL, 0, 0, 0 };
+	long nlines = 0;
+	while( readjob( in, &j ) )
+	{
+		dojob( &j, seg, arg, state );
+		writejob( out, &j );
+		nlines++;
+	}
+	fflush( out );
+	freejob( &j );
+	if( freestate != NULL ) (*freestate)( state );
+	return nlines;
+}
+
+
+/*
+ * batchWrite( out, line, n, nwords, wordlen[] );
+ *	Write the result line (see above) for the <n> char sentence <line>,
+ *	which broke up into <nwords> words with lengths wordlen[] (or, if
+ *	<nwords> is -1, which couldn't be broken up), to <out>.
+ */
+void batchWrite( FILE *out, char *line, int n, int nwords, int *wordlen )
+{
+	if( nwords == -1 )
+	{
+		fputs( "fail\t\t", out );
+		fwrite( line, sizeof(char), n, out );
+		putc( '\n', out );
+		return;
+	}
+
+	fputs( "ok\t", out );
+	int start = 0;
+	for( int i = 0; i < nwords; i++ )
+	{
+		fprintf( out, "%s%d", i==0?"":",", start );
+		start += wordlen[i];
+	}
+	putc( '\t', out );
+	start = 0;
+	for( int i = 0; i < nwords; i++ )
+	{
+		if( i > 0 ) putc( ' ', out );
+		fwrite( line+start, sizeof(char), wordlen[i], out );
+		start += wordlen[i];
+	}
+	putc( '\n', out );
+}
+
+
+/* -------------------- Jobs --------------------- */
+
+/*
+ * int ok = readjob( in, j );
+ *	Read the next line from <in> into job <j>, reusing j's buffers,
+ *	and make sure there's room for it's lower-cased copy and word
+ *	lengths.  Return 0 at end of file.
+ */
+static int readjob( FILE *in, job *j )
+{
+	ssize_t n = getline( &(j->line), &(j->linesize), in );
+	if( n == -1 ) return 0;
+
+	// remove trailing '\n' or "\r\n"
+	if( n > 0 && j->line[n-1] == '\n' ) j->line[--n] = '\0';
+	if( n > 0 && j->line[n-1] == '\r' ) j->line[--n] = '\0';
+	j->n = n;
+
+	if( n+1 > j->maxlen )
+	{
+		j->maxlen = n+1;
+		j->lc_line = (char *) realloc( j->lc_line, j->maxlen*sizeof(char) );
+		j->wordlen = (int *) realloc( j->wordlen, j->maxlen*sizeof(int) );
+		assert( j->lc_line != NULL && j->wordlen != NULL );
+	}
+	j->done = 0;
+	return 1;
+}
+
+
+/*
+ * dojob( j, seg, arg, state );
+ *	Lowercase job j's sentence and segment it, with the segmenting
+ *	thread's own <state>.
+ */
+static void dojob( job *j, batch_segfunc seg, void *arg, void *state )
+{
+	double t = statsTiming ? statsNow() : 0;
+	lowercopy( j->lc_line, j->line, j->n+1 );
+	if( statsTiming )
+	{
+		statsPhase( PhaseLowercase, t );
+		t = statsNow();
+	}
+	j->nwords = (*seg)( j->lc_line, j->n, j->wordlen, arg, state );
+	if( statsTiming ) statsPhase( PhaseSearch, t );
+}
+
+
+/*
+ * writejob( out, j );
+ *	Write job j's result line to out.
+ */
+static void writejob( FILE *out, job *j )
+{
+	double t = statsTiming ? statsNow() : 0;
+	batchWrite( out, j->line, j->n, j->nwords, j->wordlen );
+	if( statsTiming ) statsPhase( PhaseOutput, t );
+}
+
+
+/*
+ * Free job j's buffers
+ */
+static void freejob( job *j )
+{
+	free( (void *) j->line );
+	free( (void *) j->lc_line );
+	free( (void *) j->wordlen );
+}
+
+
+/* -------------------- The pipeline --------------------- */
+
+/*
+ * long nlines = pipelinesegment( in, out, seg, newstate, freestate, arg, nthreads );
+ *	batchSegment(), using a reader thread and <nthreads> workers,
+ *	while we write the results in order.
+ */
+static long pipelinesegment( FILE *in, FILE *out, batch_segfunc seg,
+			     batch_newstatefunc newstate, batch_freestatefunc freestate,
+			     void *arg, int nthreads )
+{
+	pipeline p;
+	p.in = in;
+	p.seg = seg;
+	p.newstate = newstate;
+	p.freestate = freestate;
+	p.arg = arg;
+	p.nthreads = nthreads;
+	p.window = nthreads * WINDOWPERTHREAD;
+	p.jobs = (job *) calloc( p.window, sizeof(job) );
+	p.queue = (jobqueue *) calloc( nthreads, sizeof(jobqueue) );
+	assert( p.jobs != NULL && p.queue != NULL );
+	for( int i = 0; i < nthreads; i++ )
+	{
+		pthread_mutex_init( &(p.queue[i].lock), NULL );
+		p.queue[i].seq = (long *) malloc( p.window*sizeof(long) );
+		assert( p.queue[i].seq != NULL );
+	}
+	atomic_init( &p.pending, 0 );
+	pthread_mutex_init( &p.lock, NULL );
+	pthread_cond_init( &p.space, NULL );
+	pthread_cond_init( &p.work, NULL );
+	pthread_cond_init( &p.done, NULL );
+	p.nread = p.nwritten = 0;
+	p.eof = 0;
+
+	pthread_t readerthread;
+	pthread_t workerthread[nthreads];
+	workerarg warg[nthreads];
+	pthread_create( &readerthread, NULL, &reader, &p );
+	for( int i = 0; i < nthreads; i++ )
+	{
+		warg[i].p = &p;
+		warg[i].id = i;
+		pthread_create( &workerthread[i], NULL, &worker, &warg[i] );
+	}
+
+	// write each job's result, in order, as soon as it's done
+	for( long seq = 0; ; seq++ )
+	{
+		job *j = &(p.jobs[seq % p.window]);
+
+		pthread_mutex_lock( &p.lock );
+		while( !(seq < p.nread && j->done) && !(p.eof && seq == p.nread) )
+		{
+			pthread_cond_wait( &p.done, &p.lock );
+		}
+		int finished = seq == p.nread;
+		pthread_mutex_unlock( &p.lock );
+		if( finished ) break;
+
+		writejob( out, j );
+
+		pthread_mutex_lock( &p.lock );
+		p.nwritten = seq+1;
+		pthread_cond_signal( &p.space );
+		pthread_mutex_unlock( &p.lock );
+	}
+	fflush( out );
+
+	pthread_join( readerthread, NULL );
+	for( int i = 0; i < nthreads; i++ )
+	{
+		pthread_join( workerthread[i], NULL );
+	}
+	for( int i = 0; i < nthreads; i++ )
+	{
+		pthread_mutex_destroy( &(p.queue[i].lock) );
+		free( (void *) p.queue[i].seq );
+	}
+	for( int i = 0; i < p.window; i++ )
+	{
+		freejob( &(p.jobs[i]) );
+	}
+	free( (void *) p.jobs );
+	free( (void *) p.queue );
+	pthread_mutex_destroy( &p.lock );
+	pthread_cond_destroy( &p.space );
+	pthread_cond_destroy( &p.work );
+	pthread_cond_destroy( &p.done );
+	return p.nread;
+}
+
+
+/*
+ * The reader thread: read each line into the next job (waiting
+ * until that job has been written, and so is free for reuse), and
+ * queue it for the next worker in turn.
+ */
+static void *reader( void *arg )
+{
+	pipeline *p = (pipeline *)arg;
+
+	for( long seq = 0; ; seq++ )
+	{
+		pthread_mutex_lock( &p->lock );
+		while( seq - p->nwritten >= p->window )
+		{
+			pthread_cond_wait( &p->space, &p->lock );
+		}
+		pthread_mutex_unlock( &p->lock );
+
+		job *j = &(p->jobs[seq % p->window]);
+		if( ! readjob( p->in, j ) ) break;
+
+		jobqueue *q = &(p->queue[seq % p->nthreads]);
+		pthread_mutex_lock( &q->lock );
+		q->seq[(q->head + q->count) % p->window] = seq;
+		q->count++;
+		pthread_mutex_unlock( &q->lock );
+
+		pthread_mutex_lock( &p->lock );
+		p->nread = seq+1;
+		atomic_fetch_add( &p->pending, 1 );
+		pthread_cond_signal( &p->work );
+		pthread_mutex_unlock( &p->lock );
+	}
+
+	pthread_mutex_lock( &p->lock );
+	p->eof = 1;
+	pthread_cond_broadcast( &p->work );
+	pthread_cond_signal( &p->done );
+	pthread_mutex_unlock( &p->lock );
+	return NULL;
+}
+
+
+/*
+ * A worker thread: repeatedly take a job (from our own queue, or
+ * failing that by stealing one) and segment it, with our own state,
+ * until the reader has finished and there are no jobs left.
+ */
+static void *worker( void *arg )
+{
+	pipeline *p = ((workerarg *)arg)->p;
+	int id = ((workerarg *)arg)->id;
+	void *state = p->newstate != NULL ? (*p->newstate)( p->arg ) : NULL;
+
+	for(;;)
+	{
+		long seq = takejob( p, id );
+		if( seq == -1 )
+		{
+			// nothing to do: wait for more jobs, or the end
+			pthread_mutex_lock( &p->lock );
+			while( atomic_load( &p->pending ) == 0 && ! p->eof )
+			{
+				pthread_cond_wait( &p->work, &p->lock );
+			}
+			int finished = atomic_load( &p->pending ) == 0 && p->eof;
+			pthread_mutex_unlock( &p->lock );
+			if( finished ) break;
+			continue;
+		}
+
+		job *j = &(p->jobs[seq % p->window]);
+		dojob( j, p->seg, p->arg, state );
+
+		pthread_mutex_lock( &p->lock );
+		j->done = 1;
+		if( seq == p->nwritten )
+		{
+			// the writer is waiting for this very job
+			pthread_cond_signal( &p->done );
+		}
+		pthread_mutex_unlock( &p->lock );
+	}
+	if( p->freestate != NULL ) (*p->freestate)( state );
+	statsMerge();
+	return NULL;
+}
+
+
+/*
+ * long seq = takejob( p, id );
+ *	Take the oldest job from worker <id>'s own queue, or if that's
+ *	empty, steal the oldest job from another worker's queue.
+ *	Return the job number, or -1 if all queues are empty.
+ */
+static long takejob( pipeline *p, int id )
+{
+	for( int i = 0; i < p->nthreads; i++ )
+	{
+		jobqueue *q = &(p->queue[(id + i) % p->nthreads]);
+		long seq = -1;
+		pthread_mutex_lock( &q->lock );
+		if( q->count > 0 )
+		{
+			seq = q->seq[q->head];
+			q->head = (q->head + 1) % p->window;
+			q->count--;
+		}
+		pthread_mutex_unlock( &q->lock );
+		if( seq != -1 )
+		{
+			atomic_fetch_sub( &p->pending, 1 );
+			return seq;
+		}
+	}
+	return -1;
+}
@@ -0,0 +1,25 @@
+/*
+ * batch.h: segment many sentences, one per line, in a single process..
+ *
+ * (C) Duncan C. White, 2017
+ */
+
+// a segmenter: given a lower-cased sentence <lc_line> of length <n>,
+// fill in wordlen[] (which has room for <n> entries) with the lengths
+// of the words it breaks up into, returning the number of words, or
+// -1 if no breakdown is possible.  <arg> is passed through unchanged,
+// and <state> is the calling thread's own state (see below).
+// It must be thread-safe if batchSegment() is given several threads.
+typedef int (*batch_segfunc)( char *lc_line, int n, int *wordlen, void *arg, void *state );
+
+// a segmenter's per-thread state (eg. scratch space, so that it needn't
+// allocate any per sentence): each thread that segments makes its own
+// with (*newstate)( arg ), and frees it with (*freestate)( state ) when
+// it's finished.  Both may be NULL, for no state.
+typedef void *(*batch_newstatefunc)( void *arg );
+typedef void (*batch_freestatefunc)( void *state );
+
+extern long batchSegment( FILE *in, FILE *out, batch_segfunc seg,
+			  batch_newstatefunc newstate, batch_freestatefunc freestate,
+			  void *arg, int nthreads );
+extern void batchWrite( FILE *out, char *line, int n, int nwords, int *wordlen );
@@ -0,0 +1,1059 @@
+/*
+ * dict.c: dictionary (a set of lower-cased words) for the sentence
+ *	   splitters.  The interesting operation is dictPrefixes(),
+ *	   which finds the lengths of all dictionary words that are
+ *	   prefixes of a given string.  We can answer that either by
+ *	   walking a trie (one pass, stopping as soon as no word can
+ *	   continue) or - the original way - by probing a hash set
+ *	   with every prefix in turn.
+ *
+ *	   A trie dictionary can also be saved as a precompiled image
+ *	   (see mkdictimage), which dictMapImage() later mmap()s in
+ *	   read-only: no reading, lowercasing or allocating per word,
+ *	   and processes using the same image share its page cache
+ *	   pages.  Words included in a mapped dictionary go into a
+ *	   small private "extra" trie, which dictPrefixes() also walks.
+ *
+ *	   A DictPerfect dictionary is for word lists that never change:
+ *	   dictReadWords() compiles the whole list into a static minimal
+ *	   perfect hash (see mph.c), which finds any word with one probe
+ *	   and one compare, and keeps each word's frequency in an array
+ *	   alongside.  It can be saved as an image too (mkdictimage -P),
+ *	   and like a mapped trie, puts any words included after that
+ *	   into an extra trie.
+ *
+ *	   An overlay (see dictOverlay()) is a dictionary made of a
+ *	   shared, unchanging base dictionary plus a few words of its
+ *	   own - eg. one per request, each with its own extra words.
+ *	   A DictSet overlay's set is a layer over the base's set (see
+ *	   setLayer()); a DictTrie overlay keeps its words in its own
+ *	   extra trie and asks the base about all the rest.  Either way,
+ *	   making or freeing one costs time proportional to its own
+ *	   words, not the base's: even its side index (which char pairs
+ *	   are adjacent, and which lengths of word start with each) is
+ *	   a short list of its own pairs, until it has too many of them
+ *	   for that, rather than tables the size of the base's.
+ *
+ *	   dictMatches() finds every word occurrence anywhere in a
+ *	   string.  Once dictAutomaton() has built Aho-Corasick links
+ *	   over the trie(s), that's a single linear scan; otherwise
+ *	   (or with DictSet) it's one dictPrefixes() per position.
+ *
+ *	   A DictSet or DictPerfect dictionary also keeps a small side
+ *	   index, so that it needn't probe prefix lengths that can't
+ *	   possibly match: for each pair of first two chars, a bitmask
+ *	   of the lengths of the words starting with them (bit len-2
+ *	   for lengths up to 32, bit 31 for any longer), and for each
+ *	   char, whether it's a word by itself.  So one unusually long
+ *	   word only costs the positions that start like it.
+ *
+ *	   Every dictionary also records which chars appear in its
+ *	   words, and which pairs of chars appear next to each other
+ *	   in them (see dictUsesChar() and dictAdjacent()): a string
+ *	   with a char in no word can't be broken up at all, and no
+ *	   word can span two adjacent chars that no word has next to
+ *	   each other, so a breakdown must have a word boundary there.
+ *
+ *	   Each word may also have a frequency (a count, or any other
+ *	   positive number); including the same word again adds to it,
+ *	   and words included without one count as 1.  dictCost() and
+ *	   dictMatches() turn frequencies into costs, -log(probability),
+ *	   for finding the most probable breakdown.  A trie stores each
+ *	   word's log frequency in 16 bits (to within 1/1024 nats), so
+ *	   that nodes stay the same size (a DictPerfect dictionary keeps
+ *	   the same weights, one per slot); a DictSet dictionary has no
+ *	   room for frequencies at all, and treats every word as 1.
+ *
+ * (C) Duncan C. White, 2017
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <assert.h>
+
+#include "set.h"
+#include "trie.h"
+#include "mph.h"
+#include "dict.h"
+#include "wordlist.h"
+#include "stats.h"
+
+
+// an overlay's side index, while it's small: each char pair adjacent
+// in its words, with the lengths (as in lenmask) of the words starting
+// with it
+typedef struct {
+	uint16_t	pair;			/* c1<<8|c2 */
+	uint32_t	lens;
+} sidepair;
+
+// an overlay's words with more char pairs than this use the full tables
+#define	MAXSIDEPAIRS	64
+
+// a quick filter for an overlay's short list: it only has pair if bit
+// PAIRBIT(pair) of its pairbits is set
+#define	PAIRBIT(pair)	((uint32_t)(pair) * 2654435761U >> 26)
+
+struct dict_s {
+	dict_backend	b;			/* which backend? */
+	set		s;			/* DictSet: set of words */
+	trie		t;			/* DictTrie: trie of words */
+	mph		m;			/* DictPerfect: hash of words.. */
+	uint16_t *	weight;			/* ..and their weights, by slot */
+	trie		x;			/* extra words, if t is mapped */
+	trieac		tac;			/* Aho-Corasick links over t.. */
+	trieac		xac;			/* ..and x, or NULL */
+	void *		image;			/* mapped image, or NULL */
+	size_t		imagesize;
+	int		longest;		/* length of longest word */
+	double		total;			/* sum of word frequencies */
+	uint32_t *	lenmask;		/* lengths by 1st 2 chars.. */
+	char		single[256];		/* ..and 1 char words (not trie) */
+	uint64_t *	adjacent;		/* char pairs adjacent in words */
+	sidepair *	pairs;			/* overlay: instead, while few.. */
+	int		npairs;
+	int		maxpairs;
+	uint64_t	pairbits;		/* ..PAIRBIT()s of those pairs */
+	char		used[256];		/* chars used in words */
+	dictionary	under;			/* overlay: its base, or NULL */
+	atomic_int	noverlays;		/* how many overlays on this */
+};
+
+// adjacent[] has bit c1<<8|c2 set if chars c1,c2 are adjacent in a word
+#define	NADJACENT	(256*256/64)
+
+// the DictSet/DictPerfect side index: lenmask[c1<<8|c2] has bit
+// LENBIT(len) set if there's a word of length len (>= 2) starting
+// with chars c1,c2
+#define	LENBIT(len)	((len) < 33 ? (len)-2 : 31)
+
+
+// a dictionary image starts with this header, followed by the
+// saved trie (see trieSave) and its Aho-Corasick links (see
+// trieACSave) - the header is 16 bytes long so that the trie nodes
+// and links remain suitably aligned.
+#define	IMAGEMAGIC	"dictimg3"
+#define	MAGICLEN	8
+
+// a DictPerfect image has the same header (with its own magic), then
+// the saved hash (see mphSave) and the weights of its words, by slot
+#define	MPHMAGIC	"dictmph1"
+
+typedef struct {
+	char		magic[MAGICLEN];	/* IMAGEMAGIC */
+	double		total;			/* sum of word frequencies */
+} imageheader;
+
+// a trie word's weight is its log frequency, offset and scaled to
+// fit 0..TRIEMAXWEIGHT: frequencies from about 1e-14 to 1e14 fit.
+#define	WEIGHTSCALE	1024.0
+#define	WEIGHTOFFSET	32.0
+
+// dictMatches() passes this to the trie scanning callback
+typedef struct {
+	dict_matchfunc	cb;
+	void *		arg;
+	double		logtotal;		/* log of d->total */
+} matcharg;
+
+
+/* Private functions */
+
+static int mergelens( int *, int, int *, int );
+static void freeautomaton( dictionary );
+static int freqweight( double );
+static double weightfreq( int );
+static void trieMatch( int, int, int, void * );
+static int setPrefixes( dictionary, const char *, int, int * );
+static int perfectPrefixes( dictionary, const char *, int, int *, int * );
+static int mainIn( dictionary, char * );
+static dictionary mapperfect( void *, size_t, imageheader * );
+static void indexword( dictionary, const char *, int );
+static void indexlens( dictionary, const char *, int );
+static void indexpair( dictionary, int, uint32_t );
+static uint32_t pairlens( dictionary, int );
+static sidepair *findpair( dictionary, int );
+static void indexperfect( dictionary );
+
+
+/*
+ * Create an empty dictionary using backend b
+ */
+dictionary dictCreate( dict_backend b )
+{
+	dictionary d = (dictionary) malloc( sizeof(struct dict_s) );
+	assert( d != NULL );
+	d->b = b;
+	d->s = b == DictSet ? setCreate( NULL ) : NULL;
+	d->t = b == DictTrie ? trieCreate() : NULL;
+	d->m = NULL;			/* made by dictReadWords() */
+	d->weight = NULL;
+	d->lenmask = NULL;
+	if( b != DictTrie )
+	{
+		d->lenmask = (uint32_t *) calloc( 256*256, sizeof(uint32_t) );
+		assert( d->lenmask != NULL );
+	}
+	memset( d->single, 0, sizeof(d->single) );
+	d->adjacent = (uint64_t *) calloc( NADJACENT, sizeof(uint64_t) );
+	assert( d->adjacent != NULL );
+	d->pairs = NULL;
+	d->npairs = d->maxpairs = 0;
+	d->pairbits = 0;
+	memset( d->used, 0, sizeof(d->used) );
+	d->x = NULL;
+	d->tac = d->xac = NULL;
+	d->image = NULL;
+	d->imagesize = 0;
+	d->longest = 0;
+	d->total = 0;
+	d->under = NULL;
+	d->noverlays = 0;
+	return d;
+}
+
+
+/*
+ * dictionary o = dictOverlay( base );
+ *	Create an overlay on dictionary <base>: a dictionary with all of
+ *	base's words, to which dictInclude() can add more without changing
+ *	base.  Including a word that's already in base changes nothing, and
+ *	an overlay's words don't change the total frequency, so base's
+ *	words cost the same in every overlay.  Many overlays can share
+ *	one base (even from several threads, once dictAutomaton() has been
+ *	called on base), but base mustn't change, or be freed, while it
+ *	has any.
+ */
+dictionary dictOverlay( dictionary base )
+{
+	dictionary d = (dictionary) malloc( sizeof(struct dict_s) );
+	assert( d != NULL );
+	d->b = base->b;
+	d->s = base->b == DictSet ? setLayer( base->s ) : NULL;
+	d->t = d->x = NULL;
+	d->m = NULL;
+	d->weight = NULL;
+	d->tac = d->xac = NULL;
+	d->image = NULL;
+	d->imagesize = 0;
+	d->longest = base->longest;
+	d->total = base->total;
+	d->lenmask = NULL;		/* see indexpair() */
+	memcpy( d->single, base->single, sizeof(d->single) );
+	d->adjacent = NULL;		/* likewise */
+	d->pairs = NULL;
+	d->npairs = d->maxpairs = 0;
+	d->pairbits = 0;
+	memcpy( d->used, base->used, sizeof(d->used) );
+	d->under = base;
+	d->noverlays = 0;
+	base->noverlays++;
+	return d;
+}
+
+
+/*
+ * dictionary d = dictMapImage( filename );
+ *	If <filename> is a dictionary image, written by dictSaveImage(),
+ *	mmap() it in read-only and return a (trie or DictPerfect)
+ *	dictionary built on top of it.  Otherwise, return NULL.
+ */
+dictionary dictMapImage( char *filename )
+{
+	int fd = open( filename, O_RDONLY );
+	if( fd == -1 ) return NULL;
+
+	struct stat st;
+	imageheader h;
+	if( fstat( fd, &st ) == -1 || st.st_size < sizeof(h) ||
+	    read( fd, &h, sizeof(h) ) != sizeof(h) ||
+	    (memcmp( h.magic, IMAGEMAGIC, MAGICLEN ) != 0 &&
+	     memcmp( h.magic, MPHMAGIC, MAGICLEN ) != 0) )
+	{
+		close( fd );
+		return NULL;
+	}
+
+	void *image = mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+	close( fd );
+	if( image == MAP_FAILED ) return NULL;
+
+	if( memcmp( h.magic, MPHMAGIC, MAGICLEN ) == 0 )
+	{
+		dictionary d = mapperfect( image, st.st_size, &h );
+		if( d == NULL )
+		{
+			fprintf( stderr, "dictMapImage: %s: corrupt image\n", filename );
+			munmap( image, st.st_size );
+		}
+		return d;
+	}
+
+	trie t = trieMap( (char *)image + sizeof(h), st.st_size - sizeof(h) );
+	size_t acoff = t == NULL ? 0 : sizeof(h) + trieSize( t );
+	trieac tac = t == NULL ? NULL :
+		trieACMap( t, (char *)image + acoff, st.st_size - acoff );
+	if( tac == NULL )
+	{
+		fprintf( stderr, "dictMapImage: %s: corrupt image\n", filename );
+		if( t != NULL ) trieFree( t );
+		munmap( image, st.st_size );
+		return NULL;
+	}
+
+	dictionary d = (dictionary) malloc( sizeof(struct dict_s) );
+	assert( d != NULL );
+	d->b = DictTrie;
+	d->s = NULL;
+	d->t = t;
+	d->m = NULL;
+	d->weight = NULL;
+	d->x = NULL;
+	d->tac = tac;
+	d->xac = NULL;
+	d->image = image;
+	d->imagesize = st.st_size;
+	d->longest = trieLongest( t );
+	d->total = h.total;
+	d->lenmask = NULL;
+	memset( d->single, 0, sizeof(d->single) );
+	d->adjacent = (uint64_t *) calloc( NADJACENT, sizeof(uint64_t) );
+	assert( d->adjacent != NULL );
+	d->pairs = NULL;
+	d->npairs = d->maxpairs = 0;
+	d->pairbits = 0;
+	memset( d->used, 0, sizeof(d->used) );
+	trieAdjacent( t, d->adjacent, d->used );
+	d->under = NULL;
+	d->noverlays = 0;
+	return d;
+}
+
+
+/*
+ * dictionary d = mapperfect( image, size, &h );
+ *	dictMapImage() for a DictPerfect image of <size> bytes, mapped in
+ *	at <image>, with header h: build the dictionary on top of it, and
+ *	index its words, or return NULL if it's corrupt.
+ */
+static dictionary mapperfect( void *image, size_t size, imageheader *h )
+{
+	size_t off = sizeof(*h);
+	mph m = mphMap( (char *)image + off, size - off );
+	if( m == NULL ) return NULL;
+	off += mphSize( m );
+	if( off > size || size - off < mphKeys( m )*sizeof(uint16_t) )
+	{
+		mphFree( m );
+		return NULL;
+	}
+
+	dictionary d = dictCreate( DictPerfect );
+	d->m = m;
+	d->weight = (uint16_t *) ((char *)image + off);
+	d->image = image;
+	d->imagesize = size;
+	d->total = h->total;
+	indexperfect( d );
+	return d;
+}
+
+
+/*
+ * int ok = dictSaveImage( d, filename );
+ *	Save (trie or DictPerfect) dictionary d as an image in <filename>,
+ *	which dictMapImage() can later map in.  Return 1 if ok, 0 on
+ *	failure.
+ */
+int dictSaveImage( dictionary d, char *filename )
+{
+	assert( d->b != DictSet && d->x == NULL && d->under == NULL );
+	assert( d->b == DictTrie || d->m != NULL );
+	dictAutomaton( d );
+	FILE *out = fopen( filename, "w" );
+	if( out == NULL ) return 0;
+	imageheader h;
+	memset( &h, 0, sizeof(h) );
+	memcpy( h.magic, d->b == DictPerfect ? MPHMAGIC : IMAGEMAGIC, MAGICLEN );
+	h.total = d->total;
+	int ok = fwrite( &h, sizeof(h), 1, out ) == 1;
+	if( ok && d->b == DictPerfect )
+	{
+		int nk = mphKeys( d->m );
+		ok = mphSave( d->m, out ) > 0 &&
+		     fwrite( d->weight, sizeof(uint16_t), nk, out ) == nk;
+	} else if( ok )
+	{
+		ok = trieSave( d->t, out ) > 0 &&
+		     trieACSave( d->tac, out ) > 0;
+	}
+	return fclose( out ) == 0 && ok;
+}
+
+
+/*
+ * Free the given dictionary
+ */
+void dictFree( dictionary d )
+{
+	assert( d->noverlays == 0 );
+	if( d->under != NULL ) d->under->noverlays--;
+	freeautomaton( d );
+	if( d->s != NULL ) setFree( d->s );
+	if( d->lenmask != NULL ) free( (void *) d->lenmask );
+	if( d->adjacent != NULL ) free( (void *) d->adjacent );
+	if( d->pairs != NULL ) free( (void *) d->pairs );
+	if( d->t != NULL ) trieFree( d->t );
+	if( d->m != NULL ) mphFree( d->m );
+	if( d->weight != NULL && d->image == NULL ) free( (void *) d->weight );
+	if( d->x != NULL ) trieFree( d->x );
+	if( d->image != NULL ) munmap( d->image, d->imagesize );
+	free( (void *) d );
+}
+
+
+/*
+ * Include (lower-cased) word in dictionary d, with frequency 1
+ */
+void dictInclude( dictionary d, char *word )
+{
+	dictIncludeFreq( d, word, 1.0 );
+}
+
+
+/*
+ * dictIncludeFreq( d, word, freq );
+ *	Include (lower-cased) word in dictionary d, adding <freq> (> 0)
+ *	to its frequency.  The words of a mapped image, a perfect hash or
+ *	an overlay's base are read-only, so including one of them again
+ *	changes nothing.
+ */
+void dictIncludeFreq( dictionary d, char *word, double freq )
+{
+	assert( d->noverlays == 0 );
+	assert( freq > 0 );
+	trie t = d->t;
+	int len = strlen(word);
+	indexword( d, word, len );
+	if( d->b == DictSet )
+	{
+		indexlens( d, word, len );
+		setInclude( d->s, word );
+		t = NULL;
+	} else if( d->b == DictTrie && d->image == NULL && d->under == NULL )
+	{
+		freeautomaton( d );		/* no longer up to date */
+	} else if( d->under != NULL ? dictIn( d->under, word ) : mainIn( d, word ) )
+	{
+		return;
+	} else
+	{
+		// can't modify a mapped trie, a perfect hash or a base:
+		// add word to the extras
+		if( d->x == NULL ) d->x = trieCreate();
+		if( d->xac != NULL ) trieACFree( d->xac );
+		d->xac = NULL;
+		t = d->x;
+	}
+	if( t != NULL )
+	{
+		int w = trieWeight( t, word );
+		double oldfreq = w == -1 ? 0 : weightfreq( w );
+		trieInclude( t, word, freqweight( oldfreq+freq ) );
+	}
+	if( d->under == NULL ) d->total += freq;
+	if( len > d->longest ) d->longest = len;
+}
+
+
+/*
+ * long nbytes = dictReadWords( d, filename );
+ *	Read word list <filename> - one word per line, each optionally
+ *	followed by a space or tab and its frequency - and include all
+ *	its words, lower cased, in dictionary d, as dictIncludeFreq()
+ *	would.  Return the size of the file, or -1 if we can't read it.
+ *	The file is read, and its words found and lower cased, in
+ *	parallel (see wordlist.c); then a DictSet dictionary (not an
+ *	overlay) takes all the words at once (see setIncludeAll()), while
+ *	a trie must take them one at a time.  An empty DictPerfect
+ *	dictionary compiles all the words into its perfect hash, which
+ *	can't change after that: any words read into it later (or into
+ *	an overlay) go into its extra trie.
+ */
+long dictReadWords( dictionary d, char *filename )
+{
+	wordlist wl = wordlistRead( filename );
+	if( wl == NULL ) return -1;
+	int n = wordlistCount( wl );
+	char **word = wordlistWords( wl );
+	int *len = wordlistLens( wl );
+	double *freq = wordlistFreqs( wl );
+
+	if( d->b == DictSet && d->under == NULL )
+	{
+		assert( d->noverlays == 0 );
+		setIncludeAll( d->s, word, len, n );
+		for( int i = 0; i < n; i++ )
+		{
+			indexword( d, word[i], len[i] );
+			indexlens( d, word[i], len[i] );
+			d->total += freq != NULL ? freq[i] : 1.0;
+			if( len[i] > d->longest ) d->longest = len[i];
+		}
+	} else if( d->b == DictPerfect && d->m == NULL && d->x == NULL && d->under == NULL )
+	{
+		// duplicates share a slot: add up their frequencies there
+		int *slot = (int *) malloc( (n+1)*sizeof(int) );
+		assert( slot != NULL );
+		d->m = mphBuild( word, len, n, slot );
+		int nk = mphKeys( d->m );
+		double *f = (double *) calloc( nk+1, sizeof(double) );
+		d->weight = (uint16_t *) malloc( (nk+1)*sizeof(uint16_t) );
+		assert( f != NULL && d->weight != NULL );
+		for( int i = 0; i < n; i++ )
+		{
+			f[slot[i]] += freq != NULL ? freq[i] : 1.0;
+			d->total += freq != NULL ? freq[i] : 1.0;
+		}
+		for( int k = 0; k < nk; k++ )
+		{
+			d->weight[k] = freqweight( f[k] );
+		}
+		free( (void *) f );
+		free( (void *) slot );
+		indexperfect( d );
+	} else
+	{
+		for( int i = 0; i < n; i++ )
+		{
+			dictIncludeFreq( d, word[i], freq != NULL ? freq[i] : 1.0 );
+		}
+	}
+
+	long nbytes = wordlistBytes( wl );
+	wordlistFree( wl );
+	threadstats.loadbytes += nbytes;
+	return nbytes;
+}
+
+
+/*
+ * indexword( d, word, len );
+ *	Record the chars, and adjacent pairs of chars, of the <len> char
+ *	word in d's tables.
+ */
+static void indexword( dictionary d, const char *word, int len )
+{
+	unsigned char *w = (unsigned char *) word;
+	for( int i = 0; i < len; i++ )
+	{
+		d->used[w[i]] = 1;
+		if( i == 0 ) continue;
+		int pair = w[i-1]<<8 | w[i];
+		if( d->adjacent != NULL )
+		{
+			d->adjacent[pair/64] |= (uint64_t)1 << (pair%64);
+		} else
+		{
+			indexpair( d, pair, 0 );
+		}
+	}
+}
+
+
+/*
+ * indexlens( d, word, len );
+ *	Record the length of the <len> char word in d's side index.
+ */
+static void indexlens( dictionary d, const char *word, int len )
+{
+	unsigned char *w = (unsigned char *) word;
+	if( len == 1 )
+	{
+		d->single[w[0]] = 1;
+	} else if( len > 1 )
+	{
+		indexpair( d, w[0]<<8 | w[1], 1U << LENBIT(len) );
+	}
+}
+
+
+/*
+ * indexpair( d, pair, lens );
+ *	Record that char pair <pair> is adjacent in a word of d, and that
+ *	words of the lengths <lens> (as in lenmask, maybe none) start
+ *	with it: in d's tables, or if d is an overlay with few enough
+ *	pairs, in its short list - which, once it has too many pairs,
+ *	we move into tables of its own.
+ */
+static void indexpair( dictionary d, int pair, uint32_t lens )
+{
+	if( d->adjacent == NULL )
+	{
+		sidepair *sp = findpair( d, pair );
+		if( sp != NULL )
+		{
+			sp->lens |= lens;
+			return;
+		}
+		if( d->npairs < MAXSIDEPAIRS )
+		{
+			if( d->npairs == d->maxpairs )
+			{
+				d->maxpairs = d->maxpairs == 0 ? 4 : 2*d->maxpairs;
+				d->pairs = (sidepair *) realloc( d->pairs, d->maxpairs*sizeof(sidepair) );
+				assert( d->pairs != NULL );
+			}
+			d->pairs[d->npairs].pair = pair;
+			d->pairs[d->npairs].lens = lens;
+			d->npairs++;
+			d->pairbits |= (uint64_t)1 << PAIRBIT(pair);
+			return;
+		}
+
+		// too many pairs: switch to tables
+		d->adjacent = (uint64_t *) calloc( NADJACENT, sizeof(uint64_t) );
+		d->lenmask = (uint32_t *) calloc( 256*256, sizeof(uint32_t) );
+		assert( d->adjacent != NULL && d->lenmask != NULL );
+		for( int k = 0; k < d->npairs; k++ )
+		{
+			int p = d->pairs[k].pair;
+			d->adjacent[p/64] |= (uint64_t)1 << (p%64);
+			d->lenmask[p] = d->pairs[k].lens;
+		}
+		free( (void *) d->pairs );
+		d->pairs = NULL;
+		d->npairs = d->maxpairs = 0;
+		d->pairbits = 0;
+	}
+	d->adjacent[pair/64] |= (uint64_t)1 << (pair%64);
+	if( lens != 0 ) d->lenmask[pair] |= lens;
+}
+
+
+/*
+ * uint32_t lens = pairlens( d, pair );
+ *	The lengths (as in lenmask) of d's own words - not its base's, if
+ *	it's an overlay - that start with char pair <pair>.
+ */
+static uint32_t pairlens( dictionary d, int pair )
+{
+	if( d->lenmask != NULL ) return d->lenmask[pair];
+	sidepair *sp = findpair( d, pair );
+	return sp != NULL ? sp->lens : 0;
+}
+
+
+/*
+ * sidepair *sp = findpair( d, pair );
+ *	Find char pair <pair> in (overlay) d's short list, or return NULL.
+ */
+static sidepair *findpair( dictionary d, int pair )
+{
+	if( ! (d->pairbits >> PAIRBIT(pair) & 1) ) return NULL;
+	for( int k = 0; k < d->npairs; k++ )
+	{
+		if( d->pairs[k].pair == pair ) return &d->pairs[k];
+	}
+	return NULL;
+}
+
+
+/*
+ * indexperfect( d );
+ *	Index all the words in DictPerfect dictionary d's perfect hash,
+ *	as indexword() and indexlens() do, and note the longest.
+ */
+static void indexperfect( dictionary d )
+{
+	int nk = mphKeys( d->m );
+	for( int k = 0; k < nk; k++ )
+	{
+		int len;
+		const char *word = mphKey( d->m, k, &len );
+		indexword( d, word, len );
+		indexlens( d, word, len );
+	}
+	if( mphLongest( d->m ) > d->longest ) d->longest = mphLongest( d->m );
+}
+
+
+/*
+ * Does (lower-cased) char c appear in any word of dictionary d?
+ */
+int dictUsesChar( dictionary d, int c )
+{
+	return d->used[(unsigned char) c];
+}
+
+
+/*
+ * Are (lower-cased) chars c1 and c2 adjacent (c1 then c2) in any word
+ * of dictionary d?  An overlay's pairs are its own and its base's.
+ */
+int dictAdjacent( dictionary d, int c1, int c2 )
+{
+	int pair = (unsigned char) c1 << 8 | (unsigned char) c2;
+	for( dictionary u = d; u != NULL; u = u->under )
+	{
+		if( u->adjacent != NULL ? (u->adjacent[pair/64] >> (pair%64) & 1) :
+		    findpair( u, pair ) != NULL )
+		{
+			return 1;
+		}
+	}
+	return 0;
+}
+
+
+/*
+ * Is (lower-cased) word in dictionary d?
+ */
+int dictIn( dictionary d, char *word )
+{
+	if( d->b == DictSet )
+	{
+		return setIn( d->s, word );
+	}
+	int in = d->under != NULL ? dictIn( d->under, word ) : mainIn( d, word );
+	return in || (d->x != NULL && trieIn( d->x, word ));
+}
+
+
+/*
+ * int in = mainIn( d, word );
+ *	Is (lower-cased) word in (non-overlay, DictTrie or DictPerfect)
+ *	dictionary d's main trie or perfect hash - not counting its
+ *	extra words?
+ */
+static int mainIn( dictionary d, char *word )
+{
+	if( d->t != NULL ) return trieIn( d->t, word );
+	return d->m != NULL && mphLookup( d->m, word, strlen( word ) ) != -1;
+}
+
+
+/*
+ * int nlens = dictPrefixes( d, str, n, lens[] );
+ *	Find all words in d that are prefixes of (the first n chars of)
+ *	<str>, storing their lengths in lens[] in ascending order, and
+ *	return how many there were.  lens[] must have room for
+ *	dictLongest(d) entries.
+ */
+int dictPrefixes( dictionary d, const char *str, int n, int *lens )
+{
+	if( d->b != DictSet )
+	{
+		int nlens = d->under != NULL ? dictPrefixes( d->under, str, n, lens ) :
+			    d->t != NULL ? triePrefixes( d->t, str, n, lens, NULL ) :
+			    perfectPrefixes( d, str, n, lens, NULL );
+		if( d->x != NULL )
+		{
+			int xlens[trieLongest(d->x)+1];
+			int nx = triePrefixes( d->x, str, n, xlens, NULL );
+			nlens = mergelens( lens, nlens, xlens, nx );
+		}
+		return nlens;
+	}
+
+	return setPrefixes( d, str, n, lens );
+}
+
+
+/*
+ * int nlens = setPrefixes( d, str, n, lens[] );
+ *	dictPrefixes() for a DictSet dictionary: probe the set with the
+ *	successively longer prefixes of str - straight out of str,
+ *	extending the hash a char at a time - but only at the lengths
+ *	that the side index says some word starting like str has.
+ *	An overlay's lengths are those of its own index and its base's.
+ */
+static int setPrefixes( dictionary d, const char *str, int n, int *lens )
+{
+	int nlens = 0;
+	if( n < 1 || str[0] == '\0' ) return 0;
+	unsigned char c1 = str[0];
+	if( d->single[c1] ) lens[nlens++] = 1;
+	if( n < 2 || str[1] == '\0' ) return nlens;
+	int c12 = c1<<8 | (unsigned char)str[1];
+	uint32_t mask = 0;
+	for( dictionary u = d; u != NULL; u = u->under )
+	{
+		if( u->lenmask != NULL )
+		{
+			mask |= u->lenmask[c12];
+		} else if( u->pairbits >> PAIRBIT(c12) & 1 )
+		{
+			mask |= pairlens( u, c12 );
+		}
+	}
+	if( mask == 0 ) return nlens;
+
+	// no word starting with c1,c2 is longer than..
+	int maxlen = mask >> 31 ? d->longest : 33 - __builtin_clz( mask );
+	if( maxlen > n ) maxlen = n;
+
+	set_prefixprobe pp;
+	setPrefixStart( d->s, str, &pp );
+	setPrefixSkip( &pp );
+	for( int len = 2; len <= maxlen && str[len-1]; len++ )
+	{
+		if( ! (mask >> LENBIT(len) & 1) )
+		{
+			setPrefixSkip( &pp );
+		} else if( setPrefixNext( &pp ) )
+		{
+			lens[nlens++] = len;
+		}
+	}
+	return nlens;
+}
+
+
+/*
+ * int nlens = perfectPrefixes( d, str, n, lens[], weights[] );
+ *	The prefixes of str that are words in (non-overlay) DictPerfect
+ *	dictionary d's perfect hash, as triePrefixes() finds them (with
+ *	their weights, unless weights is NULL): hashing each char of str
+ *	just once, look up only the lengths the side index allows.
+ */
+static int perfectPrefixes( dictionary d, const char *str, int n, int *lens, int *weights )
+{
+	if( d->m == NULL || n < 1 || str[0] == '\0' ) return 0;
+	unsigned char c1 = str[0];
+	uint32_t mask = 0;
+	if( n >= 2 && str[1] != '\0' ) mask = d->lenmask[c1<<8 | (unsigned char)str[1]];
+	if( mask == 0 && ! d->single[c1] ) return 0;
+
+	// no word starting with c1,c2 is longer than..
+	int maxlen = mask == 0 ? 1 : mask >> 31 ? d->longest : 33 - __builtin_clz( mask );
+	if( maxlen > n ) maxlen = n;
+
+	int nlens = 0;
+	mph_prefixprobe pp;
+	mphPrefixStart( d->m, str, &pp );
+	for( int len = 1; len <= maxlen && str[len-1]; len++ )
+	{
+		int k;
+		if( len == 1 ? ! d->single[c1] : ! (mask >> LENBIT(len) & 1) )
+		{
+			mphPrefixSkip( &pp );
+		} else if( (k = mphPrefixNext( &pp )) != -1 )
+		{
+			if( weights != NULL ) weights[nlens] = d->weight[k];
+			lens[nlens++] = len;
+		}
+	}
+	return nlens;
+}
+
+
+/*
+ * dictAutomaton( d );
+ *	Build Aho-Corasick links over d's trie(s), so that dictMatches()
+ *	can scan a whole string in one pass.  Call this after the last
+ *	dictInclude() (which discards any it invalidates), and before
+ *	sharing d between threads.  A mapped image already has links
+ *	for its main trie; a DictSet dictionary has nothing to build,
+ *	and a DictPerfect one only builds links over its extra words.
+ *	An overlay only builds links over its own words: its base should
+ *	have its automaton already.
+ */
+void dictAutomaton( dictionary d )
+{
+	if( d->b == DictSet ) return;
+	if( d->t != NULL && d->tac == NULL ) d->tac = trieACBuild( d->t );
+	if( d->x != NULL && d->xac == NULL ) d->xac = trieACBuild( d->x );
+}
+
+
+/*
+ * dictMatches( d, str, n, cb, arg );
+ *	Call cb( end, len, cost, arg ) for every occurrence of a word in d
+ *	within (the first n chars of) <str>, ie. for every word
+ *	str[end-len..end-1], whose cost is as dictCost() would say.
+ *	The order of the calls is unspecified.
+ */
+void dictMatches( dictionary d, char *str, int n, dict_matchfunc cb, void *arg )
+{
+	matcharg m = { cb, arg, log( d->total ) };
+	if( d->b != DictSet && d->under != NULL )
+	{
+		// an overlay: the base's words (costed just as ours are,
+		// as our totals are the same), then our own
+		dictMatches( d->under, str, n, cb, arg );
+		if( d->xac != NULL )
+		{
+			trieACScan( d->xac, str, n, &trieMatch, (void *) &m );
+			return;
+		}
+		int lens[d->longest+1];
+		int weights[d->longest+1];
+		for( int i = 0; d->x != NULL && i < n && str[i] != '\0'; i++ )
+		{
+			int nlens = triePrefixes( d->x, str+i, n-i, lens, weights );
+			for( int j = 0; j < nlens; j++ )
+			{
+				trieMatch( i+lens[j], lens[j], weights[j], (void *) &m );
+			}
+		}
+		return;
+	}
+	if( d->tac != NULL )
+	{
+		trieACScan( d->tac, str, n, &trieMatch, (void *) &m );
+		if( d->xac != NULL ) trieACScan( d->xac, str, n, &trieMatch, (void *) &m );
+		return;
+	}
+
+	// no automaton: one prefix walk (or set of probes) per position
+	// (but a DictPerfect dictionary's extra words may have one)
+	int lens[d->longest+1];
+	int weights[d->longest+1];
+	double setcost = m.logtotal;		/* -log( 1/total ) */
+	for( int i = 0; i < n && str[i] != '\0'; i++ )
+	{
+		if( d->b == DictSet )
+		{
+			int nlens = dictPrefixes( d, str+i, n-i, lens );
+			for( int j = 0; j < nlens; j++ )
+			{
+				(*cb)( i+lens[j], lens[j], setcost, arg );
+			}
+			continue;
+		}
+		int nlens = d->t != NULL ? triePrefixes( d->t, str+i, n-i, lens, weights )
+					 : perfectPrefixes( d, str+i, n-i, lens, weights );
+		for( int j = 0; j < nlens; j++ )
+		{
+			trieMatch( i+lens[j], lens[j], weights[j], (void *) &m );
+		}
+		if( d->x == NULL || d->xac != NULL ) continue;
+		nlens = triePrefixes( d->x, str+i, n-i, lens, weights );
+		for( int j = 0; j < nlens; j++ )
+		{
+			trieMatch( i+lens[j], lens[j], weights[j], (void *) &m );
+		}
+	}
+	if( d->xac != NULL ) trieACScan( d->xac, str, n, &trieMatch, (void *) &m );
+}
+
+
+/*
+ * double cost = dictCost( d, word );
+ *	Return the cost of (lower-cased) word in d: -log(probability of
+ *	word), ie. -log(frequency/total frequency), or HUGE_VAL if word
+ *	isn't in d at all.
+ */
+double dictCost( dictionary d, char *word )
+{
+	if( d->b == DictSet )
+	{
+		return setIn( d->s, word ) ? log( d->total ) : HUGE_VAL;
+	}
+	if( d->under != NULL )
+	{
+		double cost = dictCost( d->under, word );
+		if( cost != HUGE_VAL || d->x == NULL ) return cost;
+	}
+	int w = -1;
+	if( d->t != NULL )
+	{
+		w = trieWeight( d->t, word );
+	} else if( d->m != NULL )
+	{
+		int k = mphLookup( d->m, word, strlen( word ) );
+		if( k != -1 ) w = d->weight[k];
+	}
+	if( w == -1 && d->x != NULL ) w = trieWeight( d->x, word );
+	return w == -1 ? HUGE_VAL : log( d->total ) - log( weightfreq( w ) );
+}
+
+
+/*
+ * How long is the longest word in the dictionary?
+ */
+int dictLongest( dictionary d )
+{
+	return d->longest;
+}
+
+
+/*
+ * int nlens = mergelens( lens[], nlens, xlens[], nx );
+ *	Merge the ascending lengths xlens[0..nx-1] into the ascending
+ *	lengths lens[0..nlens-1], in place, and return the new number
+ *	of lengths.  As the extra trie never contains a word that's in
+ *	the main trie, there are no duplicates.
+ */
+static int mergelens( int *lens, int nlens, int *xlens, int nx )
+{
+	int i = nlens-1;
+	int j = nx-1;
+	for( int k = nlens+nx-1; j >= 0; k-- )
+	{
+		if( i >= 0 && lens[i] > xlens[j] )
+		{
+			lens[k] = lens[i--];
+		} else
+		{
+			lens[k] = xlens[j--];
+		}
+	}
+	return nlens+nx;
+}
+
+
+/*
+ * Free d's Aho-Corasick links, if any
+ */
+static void freeautomaton( dictionary d )
+{
+	if( d->tac != NULL ) trieACFree( d->tac );
+	if( d->xac != NULL ) trieACFree( d->xac );
+	d->tac = d->xac = NULL;
+}
+
+
+/*
+ * int w = freqweight( freq );
+ *	Convert frequency <freq> to a trie weight (its scaled log).
+ */
+static int freqweight( double freq )
+{
+	double w = (log( freq ) + WEIGHTOFFSET) * WEIGHTSCALE;
+	if( ! (w >= 0) ) return 0;		/* NaN too */
+	if( w > TRIEMAXWEIGHT ) return TRIEMAXWEIGHT;
+	return (int) (w + 0.5);
+}
+
+
+/*
+ * double freq = weightfreq( w );
+ *	Convert trie weight <w> back to a frequency.
+ */
+static double weightfreq( int w )
+{
+	return exp( w / WEIGHTSCALE - WEIGHTOFFSET );
+}
+
+
+/*
+ * trieMatch( end, len, weight, m );
+ *	trieACScan() callback: pass the word str[end-len..end-1] on to
+ *	dictMatches()'s caller, converting its weight into a cost.
+ */
+static void trieMatch( int end, int len, int weight, void *arg )
+{
+	matcharg *m = (matcharg *) arg;
+	double cost = m->logtotal - (weight / WEIGHTSCALE - WEIGHTOFFSET);
+	(*m->cb)( end, len, cost, m->arg );
+}
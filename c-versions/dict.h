@@ -0,0 +1,37 @@
+/*
+ * dict.h: dictionary (a set of lower-cased words) for the sentence
+ *	   splitters, which mainly need to ask "which words are prefixes
+ *	   of this string?"..
+ *
+ * (C) Duncan C. White, 2017
+ */
+
+typedef struct dict_s *dictionary;
+
+// how the dictionary answers prefix queries:
+//  DictTrie: one forward walk through a trie (the default),
+//  DictSet:  probe a hash set once per candidate prefix length,
+//  DictPerfect: likewise, but probe a static minimal perfect hash,
+//	      built from the whole word list at once (see mph.c).
+typedef enum { DictTrie, DictSet, DictPerfect } dict_backend;
+
+// called by dictMatches() for each word occurrence str[end-len..end-1],
+// with the word's cost (see dictCost)
+typedef void (*dict_matchfunc)( int end, int len, double cost, void *arg );
+
+extern dictionary dictCreate( dict_backend b );
+extern dictionary dictMapImage( char *filename );
+extern dictionary dictOverlay( dictionary base );
+extern int dictSaveImage( dictionary d, char *filename );
+extern void dictFree( dictionary d );
+extern void dictInclude( dictionary d, char *word );
+extern void dictIncludeFreq( dictionary d, char *word, double freq );
+extern long dictReadWords( dictionary d, char *filename );
+extern int dictIn( dictionary d, char *word );
+extern int dictUsesChar( dictionary d, int c );
+extern int dictAdjacent( dictionary d, int c1, int c2 );
+extern int dictPrefixes( dictionary d, const char *str, int n, int *lens );
+extern void dictAutomaton( dictionary d );
+extern void dictMatches( dictionary d, char *str, int n, dict_matchfunc cb, void *arg );
+extern double dictCost( dictionary d, char *word );
+extern int dictLongest( dictionary d );
@@ -0,0 +1,247 @@
+/*
+ * epoch.c: epoch based reclamation.  Readers bracket their use of a
+ *	    shared structure with epochEnter() and epochExit(), taking
+ *	    no locks; a writer replaces part of the structure by
+ *	    publishing a new version (with an atomic store), and hands
+ *	    the old version to epochRetire(), which frees it once every
+ *	    reader that might have seen it has left.
+ *
+ *	    There's a global epoch number, and each thread has a record
+ *	    saying which epoch it entered in (or that it's not reading).
+ *	    Something retired during epoch e can only be seen by readers
+ *	    that entered in epoch e or earlier; the global epoch only
+ *	    advances when every current reader entered in the current
+ *	    epoch, so once it reaches e+2, all those readers have gone
+ *	    and the thing can be freed.  Each epochRetire() tries to
+ *	    advance the epoch, and frees whatever it can.
+ *
+ *	    Sections nest: only the outermost epochEnter() and epochExit()
+ *	    in a thread touch shared memory, so a caller doing many
+ *	    lookups (eg. all those for one sentence) can enter once
+ *	    around them all, and the lookups' own sections cost next to
+ *	    nothing.  A thread must not stay in a section forever (that
+ *	    would stop anything being freed), nor call epochSynchronize()
+ *	    from inside one.
+ *
+ * (C) Duncan C. White, 2017
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <assert.h>
+
+#include "epoch.h"
+
+
+typedef struct rec_s *rec;
+
+// each thread's record: they're reused when threads exit, never freed
+struct rec_s {
+	atomic_ulong	state;			/* (epoch<<1)|1 if reading, or 0 */
+	atomic_int	inuse;			/* does a thread own this? */
+	rec		next;			/* the next record */
+};
+
+// something waiting to be freed
+typedef struct {
+	void *		p;
+	epoch_freefunc	f;
+	unsigned long	epoch;			/* when it was retired */
+} retired;
+
+
+static atomic_ulong globalepoch = 1;
+static _Atomic(rec) records = NULL;		/* all threads' records */
+
+static _Thread_local rec me;			/* this thread's record.. */
+static _Thread_local int depth;			/* ..and section nesting */
+
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static pthread_key_t exitkey;			/* to release me at exit */
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static retired *pending;			/* protected by lock: */
+static int npending;				/* retired, oldest first */
+static int maxpending;
+
+
+/* Private functions */
+
+static void makekey( void );
+static void release( void * );
+static void registerthread( void );
+static int reclaim( retired ** );
+
+
+/*
+ * epochEnter();
+ *	Start (or nest) a read section: nothing retired from now on will
+ *	be freed until we leave it.
+ */
+void epochEnter( void )
+{
+	if( depth++ > 0 ) return;
+	if( me == NULL ) registerthread();
+	unsigned long e = atomic_load( &globalepoch );
+	atomic_store_explicit( &me->state, e<<1 | 1, memory_order_relaxed );
+
+	// our announcement must be visible before we read anything shared
+	atomic_thread_fence( memory_order_seq_cst );
+}
+
+
+/*
+ * epochExit();
+ *	End a read section (the outermost one lets writers free things).
+ */
+void epochExit( void )
+{
+	assert( depth > 0 );
+	if( --depth > 0 ) return;
+	atomic_store_explicit( &me->state, 0, memory_order_release );
+}
+
+
+/*
+ * epochRetire( p, f );
+ *	p has been unpublished (no reader can find it any more, though
+ *	some may still be using it): call (*f)( p ) once no reader can
+ *	be.  Meanwhile, free anything retired earlier that's now safe.
+ */
+void epochRetire( void *p, epoch_freefunc f )
+{
+	pthread_mutex_lock( &lock );
+	if( npending == maxpending )
+	{
+		maxpending = maxpending == 0 ? 64 : 2*maxpending;
+		pending = (retired *) realloc( pending, maxpending*sizeof(retired) );
+		assert( pending != NULL );
+	}
+	retired r = { p, f, atomic_load( &globalepoch ) };
+	pending[npending++] = r;
+	retired *ready;
+	int nready = reclaim( &ready );
+	pthread_mutex_unlock( &lock );
+
+	for( int i = 0; i < nready; i++ )
+	{
+		(*ready[i].f)( ready[i].p );
+	}
+	free( (void *) ready );
+}
+
+
+/*
+ * epochSynchronize();
+ *	Wait until everything retired so far has been freed.  Not from
+ *	inside a read section, which would wait forever.
+ */
+void epochSynchronize( void )
+{
+	assert( depth == 0 );
+	for(;;)
+	{
+		pthread_mutex_lock( &lock );
+		retired *ready;
+		int nready = reclaim( &ready );
+		int left = npending;
+		pthread_mutex_unlock( &lock );
+
+		for( int i = 0; i < nready; i++ )
+		{
+			(*ready[i].f)( ready[i].p );
+		}
+		free( (void *) ready );
+		if( left == 0 ) return;
+		sched_yield();
+	}
+}
+
+
+/*
+ * int nready = reclaim( &ready );
+ *	With lock held: advance the global epoch if every reader entered
+ *	in the current one, then remove the retired things that are safe
+ *	to free from the pending list, returning them in ready (a malloc()ed
+ *	array, or NULL if there are none, for the caller to free after
+ *	freeing them).
+ */
+static int reclaim( retired **ready )
+{
+	// see the readers' announcements made before our unpublishing
+	atomic_thread_fence( memory_order_seq_cst );
+	unsigned long e = atomic_load( &globalepoch );
+	int advance = 1;
+	for( rec r = atomic_load( &records ); r != NULL && advance; r = r->next )
+	{
+		unsigned long st = atomic_load( &r->state );
+		if( (st & 1) && (st >> 1) != e ) advance = 0;
+	}
+	if( advance ) atomic_store( &globalepoch, ++e );
+
+	// pending is oldest first, so the safe ones are at the front
+	int n = 0;
+	while( n < npending && pending[n].epoch+2 <= e ) n++;
+	*ready = NULL;
+	if( n == 0 ) return 0;
+	*ready = (retired *) malloc( n*sizeof(retired) );
+	assert( *ready != NULL );
+	memcpy( *ready, pending, n*sizeof(retired) );
+	memmove( pending, pending+n, (npending-n)*sizeof(retired) );
+	npending -= n;
+	return n;
+}
+
+
+/*
+ * registerthread();
+ *	Give this thread a record: a free one if there is one, else a
+ *	new one, added to the (lock free) list.
+ */
+static void registerthread( void )
+{
+	pthread_once( &once, &makekey );
+	for( rec r = atomic_load( &records ); r != NULL; r = r->next )
+	{
+		int unused = 0;
+		if( atomic_compare_exchange_strong( &r->inuse, &unused, 1 ) )
+		{
+			me = r;
+			pthread_setspecific( exitkey, me );
+			return;
+		}
+	}
+	me = (rec) calloc( 1, sizeof(struct rec_s) );
+	assert( me != NULL );
+	atomic_init( &me->inuse, 1 );
+	rec head = atomic_load( &records );
+	do
+	{
+		me->next = head;
+	} while( ! atomic_compare_exchange_weak( &records, &head, me ) );
+	pthread_setspecific( exitkey, me );
+}
+
+
+/*
+ * Make the key whose destructor releases a thread's record
+ */
+static void makekey( void )
+{
+	pthread_key_create( &exitkey, &release );
+}
+
+
+/*
+ * A thread has exited: its record is free for another thread
+ */
+static void release( void *arg )
+{
+	rec r = (rec) arg;
+	atomic_store( &r->state, 0 );
+	atomic_store( &r->inuse, 0 );
+}
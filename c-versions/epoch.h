@@ -0,0 +1,15 @@
+/*
+ * epoch.h: epoch based reclamation, so that readers can use shared
+ *	    data structures without locks while writers replace parts
+ *	    of them, freeing the old parts only once no reader can
+ *	    still be looking at them..
+ *
+ * (C) Duncan C. White, 2017
+ */
+
+typedef void (*epoch_freefunc)( void *p );
+
+extern void epochEnter( void );
+extern void epochExit( void );
+extern void epochRetire( void *p, epoch_freefunc f );
+extern void epochSynchronize( void );
@@ -0,0 +1,282 @@
+/*
+ *	findallpossible: read a dictionary forming a dictionary set, add
+ *			 some extra words from the command line, take a
+ *			 sentence WITH NO SPACES, and find ALL POSSIBLE ways
+ *			 of parsing the sentence as a sequence of words.
+ *			 (A C port of ../perl-versions/findallpossible.)
+ *
+ *			 There can be astronomically many solutions, so we
+ *			 never build them all.  Instead, the sentence's word
+ *			 lattice (see lattice.c) is a DAG whose nodes are
+ *			 positions and whose edges are words: one backward
+ *			 pass counts the paths from each position to the end
+ *			 (so we can report the number of solutions at once),
+ *			 and then a depth first walk of that DAG - pruned
+ *			 to positions from which the end can be reached -
+ *			 prints each solution as soon as it's found.  Memory
+ *			 is proportional to the sentence length, however
+ *			 many solutions there are.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+
+#include "dict.h"
+#include "lower.h"
+#include "lattice.h"
+
+// no single word in the dictionary longer than..
+#define MAXWORDLEN 1024
+
+// max number of extra words..
+#define MAXWORDS 100
+
+typedef char aword[MAXWORDLEN];
+typedef char *wordarray[MAXWORDS];
+
+
+/*
+ *  dictionary dict = readdict( wordlistfile, extra_words[], backend );
+ *	Read a word list <wordlistfile> (and add some extra words contained
+ *	in <extra_words[]>, terminated by NULL), build and return a
+ *	dictionary (using the given <backend>) of all those LOWERCASED
+ *	words.  If <wordlistfile> is a precompiled dictionary image (see
+ *	mkdictimage) we simply map it in instead, ignoring <backend>.
+ */
+dictionary readdict( char *wordlistfile, wordarray extra_words, dict_backend backend )
+{
+	dictionary dict = dictMapImage( wordlistfile );
+	if( dict == NULL )
+	{
+		dict = dictCreate( backend );
+
+		// read every line (word!) of wordlistfile
+		if( dictReadWords( dict, wordlistfile ) == -1 )
+		{
+			fprintf( stderr, "findallpossible: can't open %s\n", wordlistfile );
+			exit(1);
+		}
+	}
+
+	for( char **w = extra_words; *w != NULL; w++ )
+	{
+		// add lowercased word to dictionary
+		alllower( *w );
+		dictInclude( dict, *w );
+	}
+
+	// all words are in: build the automaton that latticeBuild() scans with
+	dictAutomaton( dict );
+	return dict;
+}
+
+
+/*
+ * uint64_t nsol = countsolutions( lat, n, count[] );
+ *	Given the word lattice <lat> of a sentence of length <n>, work out
+ *	count[i], the number of ways of breaking up the suffix starting at
+ *	position i, for all i in 0..n (count[] must have room for n+1
+ *	entries), and return count[0] - the total number of solutions.
+ *	Counts saturate at UINT64_MAX rather than wrapping around.
+ */
+uint64_t countsolutions( lattice lat, int n, uint64_t *count )
+{
+	int lens[latticeLongest(lat)+1];
+
+	count[n] = 1;
+	for( int i = n-1; i >= 0; i-- )
+	{
+		count[i] = 0;
+		int nlens = latticeWords( lat, i, lens );
+		for( int j = 0; j < nlens; j++ )
+		{
+			uint64_t c = count[i+lens[j]];
+			count[i] = c > UINT64_MAX - count[i] ? UINT64_MAX : count[i]+c;
+		}
+	}
+	return n > 0 ? count[0] : 0;
+}
+
+
+/*
+ * int len = nextword( lat, n, count[], pos, below );
+ *	Return the length of the longest word, shorter than <below>, that
+ *	starts at position <pos> and leaves a suffix that can be broken
+ *	up (according to count[]) - or 0 if there's no such word.
+ */
+int nextword( lattice lat, int n, uint64_t *count, int pos, int below )
+{
+	for( int len = below-1; len > 0; len-- )
+	{
+		if( pos+len <= n && latticeHas( lat, pos, len ) &&
+		    count[pos+len] > 0 )
+		{
+			return len;
+		}
+	}
+	return 0;
+}
+
+
+/*
+ * long nprinted = printsolutions( sentence, lat, n, count[], max );
+ *	Given a <sentence> (in original case) of length <n>, its word
+ *	lattice <lat> and the suffix counts count[] from countsolutions(),
+ *	print (at most <max>, unless max < 0) solutions, one per line,
+ *	longest first words first - the order in which Perl's recursive
+ *	breakwords() finds them.  Return the number printed.
+ *	We walk the DAG with an explicit stack: wordlen[d] is the length
+ *	of the d'th word of the current solution, which starts at start[d].
+ */
+long printsolutions( char *sentence, lattice lat, int n, uint64_t *count, long max )
+{
+	if( n == 0 || count[0] == 0 ) return 0;
+
+	int *start   = (int *) malloc( n*sizeof(int) );
+	int *wordlen = (int *) malloc( n*sizeof(int) );
+	assert( start != NULL && wordlen != NULL );
+
+	int top = latticeLongest( lat ) + 1;	/* longer than any word */
+	long nprinted = 0;
+	int d = 0;
+	start[0] = 0;
+	wordlen[0] = nextword( lat, n, count, 0, top );
+	while( d >= 0 && (max < 0 || nprinted < max) )
+	{
+		if( wordlen[d] == 0 )
+		{
+			// no more words at this depth: backtrack
+			if( --d >= 0 )
+			{
+				wordlen[d] = nextword( lat, n, count, start[d], wordlen[d] );
+			}
+			continue;
+		}
+
+		int end = start[d] + wordlen[d];
+		if( end < n )
+		{
+			// go deeper: count[end] > 0, so this can't be a dead end
+			d++;
+			start[d] = end;
+			wordlen[d] = nextword( lat, n, count, end, top );
+			continue;
+		}
+
+		// words 0..d are a complete solution
+		printf( "  %.*s", wordlen[0], sentence );
+		for( int i = 1; i <= d; i++ )
+		{
+			printf( ",%.*s", wordlen[i], sentence+start[i] );
+		}
+		printf( "\n" );
+		nprinted++;
+		wordlen[d] = nextword( lat, n, count, start[d], wordlen[d] );
+	}
+
+	free( (void *) start );
+	free( (void *) wordlen );
+	return nprinted;
+}
+
+
+char wordlistfile[MAXWORDLEN] = "/usr/share/dict/words";
+char *usage =
+	"findallpossible [-H|-P] [-c] [-n N] (''|wordlistfile) sentencewithoutspaces [extra words]\n"
+	"	-H: probe a hash set with each prefix, rather than walking a trie\n"
+	"	-P: likewise, but a static minimal perfect hash of the word list\n"
+	"	-c: just count the solutions, don't print them\n"
+	"	-n: print at most N solutions";
+
+int main( int argc, char **argv )
+{
+	dict_backend backend = DictTrie;
+	bool countonly = false;
+	long max = -1;
+	int opt;
+	while( (opt = getopt( argc, argv, "+HPcn:" )) != -1 )
+	{
+		if( opt == 'H' )
+		{
+			backend = DictSet;
+		} else if( opt == 'P' )
+		{
+			backend = DictPerfect;
+		} else if( opt == 'c' )
+		{
+			countonly = true;
+		} else if( opt == 'n' )
+		{
+			// N must be a whole number of solutions, at least 1
+			char *end;
+			max = strtol( optarg, &end, 10 );
+			if( end == optarg || *end != '\0' || max < 1 )
+			{
+				fprintf( stderr, "%s\n", usage );
+				exit(1);
+			}
+		} else
+		{
+			fprintf( stderr, "%s\n", usage );
+			exit(1);
+		}
+	}
+	argc -= optind-1;
+	argv += optind-1;
+
+	if( argc < 3 )
+	{
+		fprintf( stderr, "%s\n", usage );
+		exit(1);
+	}
+
+	// if wordlistfile is an empty string, use above default
+	if( strlen(argv[1]) > 0 )
+	{
+		strcpy( wordlistfile, argv[1] );
+	}
+	int nextra = argc-3;
+	assert( nextra < MAXWORDS );
+
+	char **extra_words = argv+3;
+
+	// dict: the dictionary of all words, lower cased
+	dictionary dict = readdict( wordlistfile, extra_words, backend );
+	printf( "read dict, maxwordlen=%d\n", dictLongest( dict ) );
+
+	char *sentence = argv[2];
+	int n = strlen( sentence );
+	char *lc_sentence = strdup( sentence );
+	assert( lc_sentence != NULL );
+	alllower( lc_sentence );
+
+	lattice lat = latticeBuild( dict, lc_sentence, n, 0 );
+	uint64_t *count = (uint64_t *) malloc( (n+1)*sizeof(uint64_t) );
+	assert( count != NULL );
+
+	uint64_t nsol = countsolutions( lat, n, count );
+	if( nsol == UINT64_MAX )
+	{
+		printf( "found at least %" PRIu64 " solutions:\n", nsol );
+	} else
+	{
+		printf( "found %" PRIu64 " solutions:\n", nsol );
+	}
+	if( ! countonly )
+	{
+		(void) printsolutions( sentence, lat, n, count, max );
+	}
+
+	free( (void *) count );
+	latticeFree( lat );
+	free( (void *) lc_sentence );
+	dictFree( dict );
+
+	return 0;
+}
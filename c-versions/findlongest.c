@@ -13,16 +13,20 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
+#include <unistd.h>
+#include <getopt.h>
 #include <assert.h>
 
-#include "set.h"
+#include "dict.h"
+#include "lower.h"
+#include "batch.h"
+#include "stats.h"
 
 
 // no single word in the dictionary longer than..
 #define MAXWORDLEN 1024
 
-// max number of words in setence..
+// max number of extra words..
 #define MAXWORDS 100
 
 typedef char aword[MAXWORDLEN];
@@ -30,144 +34,172 @@ typedef char *wordarray[MAXWORDS];
 
 
 /*
- * alllower( string );
- *	Lower case the given string, in place.
- */
-void alllower( char *p )
-{
-	for( ; *p; ++p) *p = tolower(*p);
-}
-
-
-/*
- *  set worddset = readdict( wordlistfile, extra_words[] );
+ *  dictionary dict = readdict( wordlistfile, extra_words[], backend );
  *	Read a word list <wordlistfile> (and add some extra words contained
- *	in <extra_words[]>, terminated by NULL), build and return a set
- *	of all those LOWERCASED words.
+ *	in <extra_words[]>, terminated by NULL), build and return a
+ *	dictionary (using the given <backend>) of all those LOWERCASED
+ *	words.  If <wordlistfile> is a precompiled dictionary image (see
+ *	mkdictimage) we simply map it in instead, ignoring <backend>.
  */
-set readdict( char *wordlistfile, wordarray extra_words )
+dictionary readdict( char *wordlistfile, wordarray extra_words, dict_backend backend )
 {
-	set dict = setCreate( NULL );
+	dictionary dict = dictMapImage( wordlistfile );
+	if( dict == NULL )
+	{
+		dict = dictCreate( backend );
+
+		// read every line (word!) of wordlistfile
+		if( dictReadWords( dict, wordlistfile ) == -1 )
+		{
+			fprintf( stderr, "findlongest: can't open %s\n", wordlistfile );
+			exit(1);
+		}
+	}
 
 	for( char **w = extra_words; *w != NULL; w++ )
 	{
 		// add lowercased word to dictionary
 		alllower( *w );
-		setInclude( dict, *w );
+		dictInclude( dict, *w );
 	}
 
-	// foreach line (word!) in wordlistfile
-	FILE *fh = fopen( wordlistfile, "r" );
-	assert( fh != NULL );
-	aword word;
-	while( fgets(word, MAXWORDLEN, fh ) != NULL )
-	{
-		// remove trailing '\n' - if not present, line too long: die!
-		char *last = word + strlen(word) - 1;
-		assert( *last == '\n' );
-		*last = '\0';
+	return dict;
+}
 
-		// add lowercased word to dictionary
-		alllower( word );
-		setInclude( dict, word );
-	}
-	fclose( fh );
 
-	return dict;
+/*
+ * int len = longestprefixlen( string, n, dict );
+ *	Given a <string> (of which we consider only the first <n> chars)
+ *	and a dictionary <dict>, find and return the length of the LONGEST
+ *	prefix of string that is a word (i.e. present in dict), or 0 if
+ *	there is none.
+ */
+int longestprefixlen( char *string, int n, dictionary dict )
+{
+	// find the lengths of all dict words that are prefixes of
+	// string, in a single walk (shortest first)
+	int prefixlen[dictLongest(dict)+1];
+	int nprefixes = dictPrefixes( dict, string, n, prefixlen );
+
+	return nprefixes > 0 ? prefixlen[nprefixes-1] : 0;
 }
 
 
 /*
  * int len = findprefixlen( string, dict );
- *	Given a <string> and a dictionary set <dict>,
+ *	Given a <string> and a dictionary <dict>,
  *	find and return the length of the LONGEST prefix of string
  *	that is a word (i.e. present in dict).
  *	note: we don't need to return the longest prefix itself;
  *	just it's length, but it's nice to print the longest prefix out:-).
  */
-int findprefixlen( char *string, set dict )
+int findprefixlen( char *string, dictionary dict )
 {
-	aword prefix;
-	aword longestword;
-	strcpy( prefix, "" );
-	strcpy( longestword, "" );
-	char *prefixend = prefix;
-	char *stringend = string+MAXWORDLEN;
-	int maxlen = 0;
-
-	for( char *p=string; *p != '\0' && p<stringend; p++ )
-	{
-		// extend prefix
-		*prefixend++ = *p;
-		*prefixend = '\0';
-		//printf( "debug: string=%s, prefix=%s\n", string, prefix );
-
-		int len = prefixend-prefix;
-
-		// check if prefix is a word (in dict)?
-		if( setIn( dict, prefix) )
-		{
-			//printf( "debug: found word: %s\n", prefix );
-			assert( len > strlen(longestword) );
-			strcpy( longestword, prefix );
-			maxlen = len;
-		}
-	}
-	printf( "longest prefix that is a word: %s, len %d\n",
-		longestword, maxlen );
+	int maxlen = longestprefixlen( string, MAXWORDLEN-1, dict );
+	printf( "longest prefix that is a word: %.*s, len %d\n",
+		maxlen, string, maxlen );
 	return maxlen;
 }
 
 
 /*
- * int nwords = breakwords( sentence, lc_sentence, dict, words[] );
- *	Given a <sentence> in original case, and the same sentence in
- *	lower-case <lc_sentence>, and a dictionary set <dict>, break the
- *	original sentence up into an array of words, where each word is
- *	the **longest possible prefix** that is a word in the dictionary set.
- *	The array of words is built up in words[], no more than MAXWORDS
- *	allowed.  Each individual word can be no longer than MAXWORDLEN.
+ * int nwords = breakwords( lc_sentence, dict, wordlen[] );
+ *	Given a lower-case sentence <lc_sentence>, and a dictionary <dict>,
+ *	break it up into words, where each word is the **longest possible
+ *	prefix** that is a word in the dictionary.  The lengths of the
+ *	words are stored in wordlen[], which must have room for
+ *	strlen(lc_sentence) entries: the words themselves are simply the
+ *	next wordlen[i] chars of the original sentence, so nothing is
+ *	copied or allocated.  Each individual word can be no longer than
+ *	MAXWORDLEN.
  *	Return the number of words found - or zero if no breakdown is possible.
  */
-int breakwords( char *sentence, char *lc_sentence, set dict, wordarray words )
+int breakwords( char *lc_sentence, dictionary dict, int *wordlen )
 {
 	int nwords = 0;
-	while( *sentence != '\0' )
+	while( *lc_sentence != '\0' )
 	{
 		int len = findprefixlen( lc_sentence, dict );
 
 		// fail if no prefix word found
-		if( len == 0 )
-		{
-			// free any earlier allocated words..
-			for( int i=0; i<nwords; i++ )
-			{
-				free( words[i] );
-			}
-			return 0;
-		}
-
-		// push corresponding prefix of original sentence onto words[]
-		words[nwords] = malloc( (len+1) * sizeof(char) );
-		char *s = words[nwords];
-		strncpy( s, sentence, len );
-		s[len] = '\0';
-		nwords++;
+		if( len == 0 ) return 0;
 
-		// now remove found word from sentence and lc_sentence
-		sentence += len;
+		// now remove found word from lc_sentence
+		wordlen[nwords++] = len;
 		lc_sentence += len;
 	}
 	return nwords;
 }
 
 
+/*
+ * int nwords = segmentline( lc_line, n, wordlen[], dict, state );
+ *	batchSegment() callback: break the lower-cased <n> char sentence
+ *	<lc_line> up into words, each the longest possible prefix that
+ *	is a word in <dict>, storing their lengths in wordlen[].  Return
+ *	the number of words found - or -1 if no breakdown is possible.
+ *	Unlike breakwords(), this prints nothing, and needs no state.
+ */
+int segmentline( char *lc_line, int n, int *wordlen, void *dict, void *state )
+{
+	int nwords = 0;
+	for( int i = 0; i < n; i += wordlen[nwords++] )
+	{
+		wordlen[nwords] = longestprefixlen( lc_line+i, n-i, (dictionary)dict );
+		if( wordlen[nwords] == 0 ) return -1;
+	}
+	return nwords > 0 ? nwords : -1;
+}
+
+
 aword wordlistfile = "/usr/share/dict/words";
 char *usage =
-	"findlongest (''|wordlistfile) sentencewithoutspaces [extra words]";
+	"findlongest [-H|-P] (''|wordlistfile) sentencewithoutspaces [extra words]\n"
+	"   or: findlongest -b [-t N] [-H|-P] (''|wordlistfile) (sentencefile|-) [extra words]\n"
+	"	-H: probe a hash set with each prefix, rather than walking a trie\n"
+	"	-P: likewise, but a static minimal perfect hash of the word list\n"
+	"	-b: batch mode, segment each line of sentencefile (- for stdin)\n"
+	"	-t: in batch mode, use N threads (0 means one per CPU)\n"
+	"	--stats: print search statistics and phase timings on stderr";
+
+struct option longopts[] = {
+	{ "stats", no_argument, NULL, 'S' },
+	{ NULL, 0, NULL, 0 }
+};
 
 int main( int argc, char **argv )
 {
+	dict_backend backend = DictTrie;
+	int batch = 0;
+	int nthreads = 1;
+	int opt;
+	while( (opt = getopt_long( argc, argv, "+HPbt:", longopts, NULL )) != -1 )
+	{
+		if( opt == 'S' )
+		{
+			statsTiming = 1;
+		} else if( opt == 'H' )
+		{
+			backend = DictSet;
+		} else if( opt == 'P' )
+		{
+			backend = DictPerfect;
+		} else if( opt == 'b' )
+		{
+			batch = 1;
+		} else if( opt == 't' )
+		{
+			nthreads = atoi( optarg );
+			if( nthreads <= 0 ) nthreads = sysconf( _SC_NPROCESSORS_ONLN );
+		} else
+		{
+			fprintf( stderr, "%s\n", usage );
+			exit(1);
+		}
+	}
+	argc -= optind-1;
+	argv += optind-1;
+
 	if( argc < 3 )
 	{
 		fprintf( stderr, "%s\n", usage );
@@ -179,24 +211,48 @@ int main( int argc, char **argv )
 	{
 		strcpy( wordlistfile, argv[1] );
 	}
-	aword sentence;
-	strcpy( sentence, argv[2] );
 	int nextra = argc-3;
 	assert( nextra < MAXWORDS );
 
 	char **extra_words = argv+3;
 
-	// dict: the set of all dictionary words, lower cased
-	set dict = readdict( wordlistfile, extra_words );
+	// dict: the dictionary of all words, lower cased
+	double t = statsNow();
+	dictionary dict = readdict( wordlistfile, extra_words, backend );
+	statsPhase( PhaseLoad, t );
+
+	if( batch )
+	{
+		// argv[2] is a file of sentences, one per line
+		FILE *in = strcmp( argv[2], "-" ) == 0 ? stdin : fopen( argv[2], "r" );
+		if( in == NULL )
+		{
+			fprintf( stderr, "findlongest: can't open %s\n", argv[2] );
+			exit(1);
+		}
+		batchSegment( in, stdout, &segmentline, NULL, NULL, (void *)dict, nthreads );
+		if( in != stdin ) fclose( in );
+		dictFree( dict );
+		if( statsTiming ) statsPrint( stderr );
+		return 0;
+	}
+
+	char *sentence = argv[2];
 
-	aword lc_sentence;
-	strcpy( lc_sentence, sentence );
+	t = statsNow();
+	char *lc_sentence = strdup( sentence );
+	assert( lc_sentence != NULL );
 	alllower( lc_sentence );
+	statsPhase( PhaseLowercase, t );
 
-	wordarray words;
-	int nwords = breakwords( sentence, lc_sentence, dict, words );
+	t = statsNow();
+	int *wordlen = (int *) malloc( (strlen(sentence)+1)*sizeof(int) );
+	assert( wordlen != NULL );
+	int nwords = breakwords( lc_sentence, dict, wordlen );
+	statsPhase( PhaseSearch, t );
 
 	// print results:
+	t = statsNow();
 	if( nwords == 0 )
 	{
 		printf( "No solution found\n" );
@@ -204,14 +260,19 @@ int main( int argc, char **argv )
 	{
 		printf( "found solution with %d words\n", nwords );
 		// where's Perl's "join" function when you need it:-)
+		char *word = sentence;
 		for( int i=0; i<nwords; i++ )
 		{
-			printf( "%s%c", words[i], i==nwords-1?'\n':' ' );
-			free( words[i] );
+			printf( "%.*s%c", wordlen[i], word, i==nwords-1?'\n':' ' );
+			word += wordlen[i];
 		}
 		putchar( '\n' );
 	}
-	setFree( dict );
+	statsPhase( PhaseOutput, t );
+	free( (void *) wordlen );
+	free( (void *) lc_sentence );
+	dictFree( dict );
+	if( statsTiming ) statsPrint( stderr );
 
 	return 0;
 }
@@ -0,0 +1,361 @@
+/*
+ * kbest.c: the k best breakdowns of a lower-cased sentence with no
+ *	    spaces, in order of increasing cost (the sum of the words'
+ *	    dictCost()s, so the most probable breakdown comes first),
+ *	    produced lazily, one per kbestNext() call.
+ *
+ *	The sentence's word lattice (see lattice.c) is a DAG whose nodes
+ *	are positions 0..n and whose edges are words, and a breakdown is
+ *	a path from 0 to n.  We use Jimenez and Marzal's Recursive
+ *	Enumeration Algorithm, backwards: for each node v we keep the
+ *	paths from v to n found so far, best first, each one recorded as
+ *	its first word plus the index of the path from that word's end
+ *	that it extends.  The 1st best paths from every node come from
+ *	one backward pass, exactly as in segment.c - the same sums, and
+ *	ties going to the longer first word - so the best breakdown is
+ *	always the one that backtrack -p finds.  The kth best path from
+ *	v must be one of:
+ *
+ *		(v,u) plus the 1st best path from each successor u, or
+ *		(v,u) plus the (j+1)th best path from u, where (v,u) plus
+ *		the jth best path from u was one of the k-1 better paths
+ *		from v
+ *
+ *	so each node keeps a heap of candidates - at most one per
+ *	successor, ie. per word length - and each time a candidate is
+ *	chosen, we replace it with its successor, which may mean finding
+ *	the next path from u first.  Each next path from 0 therefore costs
+ *	O(n log L) at worst (one heap operation per node along it), no
+ *	matter how many breakdowns there are altogether.  We work with
+ *	an explicit stack of (node, k) requests rather than recursing,
+ *	so that long sentences can't overflow the C stack.
+ *
+ * (C) Duncan C. White, 2017
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <assert.h>
+
+#include "dict.h"
+#include "lattice.h"
+#include "kbest.h"
+
+
+// a path from node v: its first word is v..v+len-1, and it extends the
+// k'th best path (counting from 0) from node v+len
+typedef struct {
+	double		cost;			/* total cost of the path */
+	int		len;			/* length of first word */
+	int		k;			/* which path from v+len */
+	int		extended;		/* successor candidate made? */
+} path;
+
+// what we know about each node
+typedef struct {
+	path *		path;			/* paths found so far, best first */
+	int		npaths;
+	int		maxpaths;
+	path *		cand;			/* heap of candidate next paths */
+	int		ncand;
+	int		maxcand;
+	int		started;		/* initial candidates made? */
+	int		exhausted;		/* no more paths to find? */
+} pnode;
+
+struct kbest_s {
+	int		n;			/* sentence length */
+	lattice		lat;			/* its word lattice, with costs */
+	pnode *		node;			/* nodes 0..n */
+	int		nfound;			/* paths from 0 returned so far */
+	int *		stack;			/* (node, k) requests */
+};
+
+
+/* Private functions */
+
+static void addpath( pnode *, path );
+static void pushcand( pnode *, path );
+static path popcand( pnode * );
+static int candless( path *, path * );
+static void startcands( kbest, int );
+static int findpath( kbest, int, int );
+
+
+/*
+ * kbest kb = kbestCreate( dict, lc_str, n );
+ *	Prepare to enumerate the breakdowns of the lower-case string
+ *	<lc_str> of length <n> into words of dictionary <dict>: build
+ *	its word lattice and find the best path from every position.
+ *	O(n.L) for a longest word of length L.
+ */
+kbest kbestCreate( dictionary dict, char *lc_str, int n )
+{
+	kbest kb = (kbest) malloc( sizeof(struct kbest_s) );
+	assert( kb != NULL );
+	kb->n = n;
+	kb->lat = latticeBuild( dict, lc_str, n, 1 );
+	kb->node = (pnode *) calloc( n+1, sizeof(pnode) );
+	kb->stack = (int *) malloc( 2*(n+1)*sizeof(int) );
+	assert( kb->node != NULL && kb->stack != NULL );
+	kb->nfound = 0;
+
+	// the empty path from node n, then the best path from every other
+	// node, from the best paths from its successors
+	path p = { 0, 0, 0, 1 };
+	addpath( &kb->node[n], p );
+	kb->node[n].exhausted = 1;
+
+	int longest = latticeLongest( kb->lat );
+	int lens[longest+1];
+	double *best = (double *) malloc( (n+1)*sizeof(double) );
+	int *bestlen = (int *) calloc( n+1, sizeof(int) );
+	assert( best != NULL && bestlen != NULL );
+	best[n] = 0;
+	for( int v = n-1; v >= 0; v-- )
+	{
+		best[v] = HUGE_VAL;
+		int nlens = latticeWords( kb->lat, v, lens );
+
+		// consider words longest first, as segment.c does
+		for( int j = nlens-1; j >= 0; j-- )
+		{
+			int u = v+lens[j];
+			if( u < n && bestlen[u] == 0 ) continue;	/* dead end */
+			double c = latticeCost( kb->lat, v, lens[j] ) + best[u];
+			if( c < best[v] )
+			{
+				best[v] = c;
+				bestlen[v] = lens[j];
+			}
+		}
+		if( bestlen[v] == 0 )
+		{
+			kb->node[v].exhausted = 1;
+		} else
+		{
+			path p = { best[v], bestlen[v], 0, 0 };
+			addpath( &kb->node[v], p );
+		}
+	}
+	free( (void *) best );
+	free( (void *) bestlen );
+	return kb;
+}
+
+
+/*
+ * int nwords = kbestNext( kb, wordlen[], &cost );
+ *	Find the next best breakdown of kb's sentence, storing its word
+ *	lengths in wordlen[] (which must have room for n entries) and
+ *	its cost in cost, and return the number of words in it - or -1
+ *	if there are no more breakdowns (or the sentence is empty).
+ */
+int kbestNext( kbest kb, int *wordlen, double *cost )
+{
+	int n = kb->n;
+	if( n == 0 || ! findpath( kb, 0, kb->nfound+1 ) ) return -1;
+	int k = kb->nfound++;
+
+	// follow the path from 0 to n
+	*cost = kb->node[0].path[k].cost;
+	int nwords = 0;
+	for( int v = 0; v < n; )
+	{
+		path *p = &kb->node[v].path[k];
+		wordlen[nwords++] = p->len;
+		v += p->len;
+		k = p->k;
+	}
+	return nwords;
+}
+
+
+/*
+ * Free the given enumerator
+ */
+void kbestFree( kbest kb )
+{
+	for( int v = 0; v <= kb->n; v++ )
+	{
+		free( (void *) kb->node[v].path );
+		free( (void *) kb->node[v].cand );
+	}
+	free( (void *) kb->node );
+	free( (void *) kb->stack );
+	latticeFree( kb->lat );
+	free( (void *) kb );
+}
+
+
+/*
+ * int found = findpath( kb, target, want );
+ *	Make sure that the <want> best paths from node <target> (counting
+ *	from 1) have been found, if there are that many; return 1 if so,
+ *	0 if not.
+ *	Finding the k'th path from v may first need the next path from
+ *	some successor u, which may need the next path from a successor
+ *	of u, and so on: those requests go on kb->stack.
+ */
+static int findpath( kbest kb, int target, int want )
+{
+	int *stack = kb->stack;
+	int sp = 0;
+	stack[sp++] = target;
+	stack[sp++] = want;
+	while( sp > 0 )
+	{
+		int k = stack[sp-1];
+		int v = stack[sp-2];
+		pnode *pv = &kb->node[v];
+		if( pv->npaths >= k || pv->exhausted )
+		{
+			sp -= 2;
+			continue;
+		}
+
+		// all paths before the k'th are known: the last of them
+		// has a successor candidate, unless it's not yet made..
+		if( ! pv->started ) startcands( kb, v );
+		path *last = &pv->path[k-2];
+		if( ! last->extended )
+		{
+			int u = v + last->len;
+			pnode *pu = &kb->node[u];
+			if( pu->npaths <= last->k+1 && ! pu->exhausted )
+			{
+				// we need the next path from u first
+				stack[sp++] = u;
+				stack[sp++] = last->k+2;
+				continue;
+			}
+			last->extended = 1;
+			if( pu->npaths > last->k+1 )
+			{
+				path *q = &pu->path[last->k+1];
+				path c = { latticeCost( kb->lat, v, last->len ) + q->cost,
+					   last->len, last->k+1, 0 };
+				pushcand( pv, c );
+			}
+		}
+
+		// the best candidate is the k'th path from v
+		if( pv->ncand == 0 )
+		{
+			pv->exhausted = 1;
+		} else
+		{
+			addpath( pv, popcand( pv ) );
+		}
+		sp -= 2;
+	}
+	return kb->node[target].npaths >= want;
+}
+
+
+/*
+ * startcands( kb, v );
+ *	Make node v's initial candidates: the word (v,u) plus the best
+ *	path from each of its successors u, except the one that is
+ *	already the best path from v.
+ */
+static void startcands( kbest kb, int v )
+{
+	pnode *pv = &kb->node[v];
+	pv->started = 1;
+	int lens[latticeLongest( kb->lat )+1];
+	int nlens = latticeWords( kb->lat, v, lens );
+	for( int j = 0; j < nlens; j++ )
+	{
+		int len = lens[j];
+		int u = v+len;
+		if( len == pv->path[0].len || kb->node[u].npaths == 0 )
+		{
+			continue;
+		}
+		path c = { latticeCost( kb->lat, v, len ) + kb->node[u].path[0].cost,
+			   len, 0, 0 };
+		pushcand( pv, c );
+	}
+}
+
+
+/*
+ * addpath( pv, p );
+ *	Append path p to node pv's list of known paths.
+ */
+static void addpath( pnode *pv, path p )
+{
+	if( pv->npaths == pv->maxpaths )
+	{
+		pv->maxpaths = pv->maxpaths == 0 ? 4 : 2*pv->maxpaths;
+		pv->path = (path *) realloc( pv->path, pv->maxpaths*sizeof(path) );
+		assert( pv->path != NULL );
+	}
+	pv->path[pv->npaths++] = p;
+}
+
+
+/* -------------------- Candidate heap ops --------------------- */
+
+/*
+ * Is candidate a better than candidate b?  Cheaper is better; to
+ * make the order of equal cost paths predictable, and agree with
+ * segment.c, a longer first word and then an earlier path from its
+ * end break ties.
+ */
+static int candless( path *a, path *b )
+{
+	if( a->cost != b->cost ) return a->cost < b->cost;
+	if( a->len != b->len ) return a->len > b->len;
+	return a->k < b->k;
+}
+
+
+/*
+ * pushcand( pv, c );
+ *	Add candidate c to node pv's candidate heap.
+ */
+static void pushcand( pnode *pv, path c )
+{
+	if( pv->ncand == pv->maxcand )
+	{
+		pv->maxcand = pv->maxcand == 0 ? 4 : 2*pv->maxcand;
+		pv->cand = (path *) realloc( pv->cand, pv->maxcand*sizeof(path) );
+		assert( pv->cand != NULL );
+	}
+	path *h = pv->cand;
+	int i = pv->ncand++;
+	for( ; i > 0 && candless( &c, &h[(i-1)/2] ); i = (i-1)/2 )
+	{
+		h[i] = h[(i-1)/2];
+	}
+	h[i] = c;
+}
+
+
+/*
+ * path c = popcand( pv );
+ *	Remove and return the best candidate from node pv's (non-empty)
+ *	candidate heap.
+ */
+static path popcand( pnode *pv )
+{
+	path *h = pv->cand;
+	path top = h[0];
+	path last = h[--pv->ncand];
+	int n = pv->ncand;
+	int i = 0;
+	for( ;; )
+	{
+		int c = 2*i+1;
+		if( c >= n ) break;
+		if( c+1 < n && candless( &h[c+1], &h[c] ) ) c++;
+		if( ! candless( &h[c], &last ) ) break;
+		h[i] = h[c];
+		i = c;
+	}
+	if( n > 0 ) h[i] = last;
+	return top;
+}
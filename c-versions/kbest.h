@@ -0,0 +1,13 @@
+/*
+ * kbest.h: enumerate the breakdowns of a lower-cased sentence into
+ *	    dictionary words in order of increasing cost (ie. most
+ *	    probable first), one at a time, on demand..
+ *
+ * (C) Duncan C. White, 2017
+ */
+
+typedef struct kbest_s *kbest;
+
+extern kbest kbestCreate( dictionary dict, char *lc_str, int n );
+extern int kbestNext( kbest kb, int *wordlen, double *cost );
+extern void kbestFree( kbest kb );
@@ -0,0 +1,194 @@
+/*
+ * lattice.c: word lattice of a lower-cased sentence with no spaces.
+ *	For each start position i, we record the lengths of all the
+ *	dictionary words lc_str[i..i+len-1], as a bitset (bit len-1
+ *	set) of (longest+63)/64 64-bit words.  Most dictionaries have
+ *	no word longer than 64 chars, so that's one word per position.
+ *	On request, we also record the cost (see dictCost) of each of
+ *	those words, in a position by length array of floats.
+ *
+ *	The lattice is filled by a single dictMatches() scan over the
+ *	whole sentence - linear in the sentence length plus the number
+ *	of word occurrences, once dictAutomaton() has been called -
+ *	and the search algorithms then run entirely off the bitsets.
+ *
+ * (C) Duncan C. White, 2017
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "dict.h"
+#include "lattice.h"
+#include "stats.h"
+
+
+struct lattice_s {
+	int		n;			/* number of positions */
+	int		longest;		/* longest possible word */
+	int		wpp;			/* bitset words per position */
+	uint64_t *	bits;			/* n*wpp bitset words */
+	float *		cost;			/* n*longest costs, if withcosts */
+	size_t		maxbits;		/* room in bits.. */
+	size_t		maxcost;		/* ..and in costs */
+	int		withcosts;		/* are costs being recorded? */
+};
+
+
+/* Private functions */
+
+static void addmatch( int, int, double, void * );
+
+
+/*
+ * lattice l = latticeBuild( d, lc_str, n, withcosts );
+ *	Build the word lattice of the lower-case string <lc_str> of
+ *	length <n>, using dictionary d.  If <withcosts>, record the
+ *	cost of each word too, for latticeCost().
+ */
+lattice latticeBuild( dictionary d, char *lc_str, int n, int withcosts )
+{
+	lattice l = latticeCreate();
+	latticeFill( l, d, lc_str, n, withcosts );
+	return l;
+}
+
+
+/*
+ * lattice l = latticeCreate();
+ *	Create an empty lattice, for latticeFill() to (re)use.
+ */
+lattice latticeCreate( void )
+{
+	lattice l = (lattice) malloc( sizeof(struct lattice_s) );
+	assert( l != NULL );
+	l->n = 0;
+	l->longest = 0;
+	l->wpp = 1;
+	l->bits = NULL;
+	l->cost = NULL;
+	l->maxbits = 0;
+	l->maxcost = 0;
+	l->withcosts = 0;
+	return l;
+}
+
+
+/*
+ * latticeFill( l, d, lc_str, n, withcosts );
+ *	Make l the word lattice of the lower-case string <lc_str> of
+ *	length <n>, as latticeBuild() would, reusing l's storage: it
+ *	only grows (so filling a lattice with sentences no longer than
+ *	ones it has held before allocates nothing).
+ */
+void latticeFill( lattice l, dictionary d, char *lc_str, int n, int withcosts )
+{
+	l->n = n;
+	l->longest = dictLongest( d );
+	l->wpp = (l->longest+63)/64;
+	if( l->wpp == 0 ) l->wpp = 1;
+	size_t nbits = (size_t)n*l->wpp+1;
+	if( nbits > l->maxbits )
+	{
+		free( (void *) l->bits );
+		l->maxbits = nbits;
+		l->bits = (uint64_t *) malloc( nbits*sizeof(uint64_t) );
+		assert( l->bits != NULL );
+	}
+	memset( l->bits, 0, nbits*sizeof(uint64_t) );
+	l->withcosts = withcosts;
+	if( withcosts )
+	{
+		size_t ncost = (size_t)n*l->longest+1;
+		if( ncost > l->maxcost )
+		{
+			free( (void *) l->cost );
+			l->maxcost = ncost;
+			l->cost = (float *) malloc( ncost*sizeof(float) );
+			assert( l->cost != NULL );
+		}
+	}
+
+	dictMatches( d, lc_str, n, &addmatch, (void *) l );
+}
+
+
+/*
+ * Free the given lattice
+ */
+void latticeFree( lattice l )
+{
+	free( (void *) l->bits );
+	free( (void *) l->cost );
+	free( (void *) l );
+}
+
+
+/*
+ * int nlens = latticeWords( l, pos, lens[] );
+ *	Store the lengths of all words starting at position <pos> in
+ *	lens[], in ascending order, and return how many there were.
+ *	lens[] must have room for latticeLongest(l) entries.
+ */
+int latticeWords( lattice l, int pos, int *lens )
+{
+	int nlens = 0;
+	uint64_t *b = l->bits + (size_t)pos*l->wpp;
+	for( int w = 0; w < l->wpp; w++ )
+	{
+		for( uint64_t bits = b[w]; bits != 0; bits &= bits-1 )
+		{
+			lens[nlens++] = w*64 + __builtin_ctzll( bits ) + 1;
+		}
+	}
+	return nlens;
+}
+
+
+/*
+ * Is there a word of length <len> starting at position <pos>?
+ */
+int latticeHas( lattice l, int pos, int len )
+{
+	uint64_t *b = l->bits + (size_t)pos*l->wpp;
+	return len >= 1 && len <= l->longest &&
+	       (b[(len-1)/64] >> ((len-1)%64)) & 1;
+}
+
+
+/*
+ * double cost = latticeCost( l, pos, len );
+ *	Return the cost of the word of length <len> starting at position
+ *	<pos>, which must be present, in a lattice built with costs.
+ */
+double latticeCost( lattice l, int pos, int len )
+{
+	assert( l->withcosts );
+	return l->cost[(size_t)pos*l->longest + len-1];
+}
+
+
+/*
+ * How long is the longest word the lattice might contain?
+ */
+int latticeLongest( lattice l )
+{
+	return l->longest;
+}
+
+
+/*
+ * addmatch( end, len, cost, l );
+ *	dictMatches() callback: record the word lc_str[end-len..end-1].
+ */
+static void addmatch( int end, int len, double cost, void *arg )
+{
+	lattice l = (lattice) arg;
+	int pos = end-len;
+	STAT_INC( matches );
+	l->bits[(size_t)pos*l->wpp + (len-1)/64] |= (uint64_t)1 << ((len-1)%64);
+	if( l->withcosts ) l->cost[(size_t)pos*l->longest + len-1] = cost;
+}
@@ -0,0 +1,18 @@
+/*
+ * lattice.h: word lattice of a lower-cased sentence - the lengths of
+ *	      all dictionary words starting at each position, found
+ *	      once so that searches needn't touch the dictionary..
+ *
+ * (C) Duncan C. White, 2017
+ */
+
+typedef struct lattice_s *lattice;
+
+extern lattice latticeBuild( dictionary d, char *lc_str, int n, int withcosts );
+extern lattice latticeCreate( void );
+extern void latticeFill( lattice l, dictionary d, char *lc_str, int n, int withcosts );
+extern void latticeFree( lattice l );
+extern int latticeWords( lattice l, int pos, int *lens );
+extern int latticeHas( lattice l, int pos, int len );
+extern double latticeCost( lattice l, int pos, int len );
+extern int latticeLongest( lattice l );
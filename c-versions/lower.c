@@ -0,0 +1,149 @@
+/*
+ * lower.c: ASCII case folding for the sentence splitters.
+ *	Every dictionary word and every sentence is lower cased before
+ *	we look at it, so this is on the hottest path of all.  None of
+ *	our programs call setlocale(), so tolower() only ever maps 'A'..'Z'
+ *	to 'a'..'z': which we can do to 16 (SSE2) or 32 (AVX2) chars at
+ *	once, by adding 0x80-'A' to each byte - taking exactly the upper
+ *	case letters to the 26 smallest signed byte values - and setting
+ *	bit 0x20 of those bytes that then compare less than -128+26.
+ *	Bytes with the top bit set are left alone, just as tolower() does
+ *	in the C locale.
+ *
+ *	Which version to use is decided at run time, on every call (it's
+ *	just a test of a flag that the C runtime set up at startup), so
+ *	one binary runs at its best on any x86 CPU.  On other CPUs, or
+ *	other compilers, we fall back to a plain loop.
+ *
+ * (C) Duncan C. White, 2017
+ */
+
+#include <string.h>
+#include <ctype.h>
+
+#include "lower.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86 1
+#include <immintrin.h>
+#endif
+
+
+/* Private functions */
+
+#ifdef HAVE_X86
+static int lowercopySSE2( char *, char *, int );
+static int lowercopyAVX2( char *, char *, int );
+#endif
+
+
+/*
+ * alllower( string );
+ *	Lower case the given string, in place.
+ */
+void alllower( char *p )
+{
+	lowercopy( p, p, strlen( p ) );
+}
+
+
+/*
+ * lowercopy( dst, src, n );
+ *	Copy the <n> chars at <src> to <dst>, lower casing them on the
+ *	way.  dst may be src, to lower case in place, but the two must
+ *	not otherwise overlap.
+ */
+void lowercopy( char *dst, char *src, int n )
+{
+	int done = 0;
+#ifdef HAVE_X86
+	if( n >= 32 && __builtin_cpu_supports( "avx2" ) )
+	{
+		done = lowercopyAVX2( dst, src, n );
+	}
+	if( n-done >= 16 && __builtin_cpu_supports( "sse2" ) )
+	{
+		done += lowercopySSE2( dst+done, src+done, n-done );
+	}
+#endif
+	lowercopyScalar( dst+done, src+done, n-done );
+}
+
+
+/*
+ * lowercopyScalar( dst, src, n );
+ *	lowercopy() a char at a time: for the tail end of a string, and
+ *	to compare the vector versions against.
+ */
+void lowercopyScalar( char *dst, char *src, int n )
+{
+	for( int i = 0; i < n; i++ )
+	{
+		dst[i] = tolower( (unsigned char)src[i] );
+	}
+}
+
+
+/*
+ * char *name = lowerImpl();
+ *	Return the name of the version of lowercopy() that this CPU uses
+ *	for long strings: "avx2", "sse2" or "scalar".
+ */
+char *lowerImpl( void )
+{
+#ifdef HAVE_X86
+	if( __builtin_cpu_supports( "avx2" ) ) return "avx2";
+	if( __builtin_cpu_supports( "sse2" ) ) return "sse2";
+#endif
+	return "scalar";
+}
+
+
+#ifdef HAVE_X86
+
+/*
+ * int done = lowercopySSE2( dst, src, n );
+ *	lowercopy() as many whole 16 char blocks as there are in <src>,
+ *	and return how many chars that was.
+ */
+__attribute__((target("sse2")))
+static int lowercopySSE2( char *dst, char *src, int n )
+{
+	__m128i shift = _mm_set1_epi8( (char)(0x80-'A') );
+	__m128i limit = _mm_set1_epi8( (char)(-128+26) );
+	__m128i bit   = _mm_set1_epi8( 0x20 );
+	int i;
+	for( i = 0; i+16 <= n; i += 16 )
+	{
+		__m128i v = _mm_loadu_si128( (__m128i *)(src+i) );
+		__m128i upper = _mm_cmplt_epi8( _mm_add_epi8( v, shift ), limit );
+		v = _mm_or_si128( v, _mm_and_si128( upper, bit ) );
+		_mm_storeu_si128( (__m128i *)(dst+i), v );
+	}
+	return i;
+}
+
+
+/*
+ * int done = lowercopyAVX2( dst, src, n );
+ *	lowercopy() as many whole 32 char blocks as there are in <src>,
+ *	and return how many chars that was.
+ */
+__attribute__((target("avx2")))
+static int lowercopyAVX2( char *dst, char *src, int n )
+{
+	__m256i shift = _mm256_set1_epi8( (char)(0x80-'A') );
+	__m256i limit = _mm256_set1_epi8( (char)(-128+26) );
+	__m256i bit   = _mm256_set1_epi8( 0x20 );
+	int i;
+	for( i = 0; i+32 <= n; i += 32 )
+	{
+		__m256i v = _mm256_loadu_si256( (__m256i *)(src+i) );
+		__m256i upper = _mm256_cmpgt_epi8( limit, _mm256_add_epi8( v, shift ) );
+		v = _mm256_or_si256( v, _mm256_and_si256( upper, bit ) );
+		_mm256_storeu_si256( (__m256i *)(dst+i), v );
+	}
+	return i;
+}
+
+#endif
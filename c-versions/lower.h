@@ -0,0 +1,11 @@
+/*
+ * lower.h: ASCII case folding, a vector register at a time where the
+ *	    CPU allows..
+ *
+ * (C) Duncan C. White, 2017
+ */
+
+extern void alllower( char *p );
+extern void lowercopy( char *dst, char *src, int n );
+extern void lowercopyScalar( char *dst, char *src, int n );
+extern char *lowerImpl( void );
@@ -0,0 +1,336 @@
+/*
+ *	mkcorpus: build the fixed benchmark corpora (see runbench) from
+ *		  a word list: every run uses the same pseudo-random
+ *		  sequence, so the corpora are identical every time.
+ *		  In directory <corpusdir>, we write:
+ *
+ *		  sentences.txt: realistic sentences - random words run
+ *				 together, the first one capitalised
+ *		  camel.txt:	 camelCase identifiers, eg. parseHttpHeader
+ *		  adversarial.txt: runs of "a" ending in a letter that
+ *				 makes the whole line unbreakable, the
+ *				 worst case for a backtracking search
+ *		  size-N.txt:	 (for N = 10, 100, .. 1000000) lines of N
+ *				 chars of run-together words, as many lines
+ *				 as make about 1M chars in all
+ *
+ *		  Each file has one sentence per line, as batch mode
+ *		  (findlongest -b, backtrack -b) expects.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <assert.h>
+
+
+// no single word in the word list longer than..
+#define MAXWORDLEN 1024
+
+// number of lines in sentences.txt and camel.txt
+#define NLINES 20000
+
+// size-N.txt files have about this many chars in all
+#define SIZECHARS 1000000
+
+typedef char aword[MAXWORDLEN];
+
+
+char **word;			// the alphabetic words in the word list
+int nwords;
+
+char **bylen[MAXWORDLEN];	// bylen[l]: the words of length l..
+int nbylen[MAXWORDLEN];		// ..and how many there are
+
+uint64_t seed = 88172645463325252ULL;
+
+
+/*
+ * uint64_t r = rnd();
+ *	Return the next pseudo-random number (xorshift64*), the same
+ *	sequence every run.
+ */
+uint64_t rnd( void )
+{
+	seed ^= seed >> 12;
+	seed ^= seed << 25;
+	seed ^= seed >> 27;
+	return seed * 2685821657736338717ULL;
+}
+
+
+/*
+ * char *w = randword();
+ *	Return a random word from the word list.
+ */
+char *randword( void )
+{
+	return word[rnd() % nwords];
+}
+
+
+/*
+ * readwords( wordlistfile );
+ *	Read all the purely alphabetic words of <wordlistfile> (ignoring
+ *	any frequency column) into word[0..nwords-1], lower cased, and
+ *	index them by length in bylen[].
+ */
+void readwords( char *wordlistfile )
+{
+	FILE *fh = fopen( wordlistfile, "r" );
+	if( fh == NULL )
+	{
+		fprintf( stderr, "mkcorpus: can't open %s\n", wordlistfile );
+		exit(1);
+	}
+	int maxwords = 1024;
+	word = (char **) malloc( maxwords*sizeof(char *) );
+	assert( word != NULL );
+	nwords = 0;
+
+	aword w;
+	while( fgets( w, MAXWORDLEN, fh ) != NULL )
+	{
+		w[strcspn( w, " \t\r\n" )] = '\0';
+		char *p;
+		for( p = w; isalpha( (unsigned char)*p ); p++ )
+		{
+			*p = tolower( (unsigned char)*p );
+		}
+		if( *p != '\0' || p == w ) continue;
+
+		if( nwords == maxwords )
+		{
+			maxwords *= 2;
+			word = (char **) realloc( word, maxwords*sizeof(char *) );
+			assert( word != NULL );
+		}
+		word[nwords] = strdup( w );
+		assert( word[nwords] != NULL );
+		nwords++;
+	}
+	fclose( fh );
+	if( nwords == 0 )
+	{
+		fprintf( stderr, "mkcorpus: no words in %s\n", wordlistfile );
+		exit(1);
+	}
+
+	// index the words by length
+	for( int i = 0; i < nwords; i++ )
+	{
+		nbylen[strlen( word[i] )]++;
+	}
+	for( int l = 0; l < MAXWORDLEN; l++ )
+	{
+		bylen[l] = (char **) malloc( (nbylen[l]+1)*sizeof(char *) );
+		assert( bylen[l] != NULL );
+		nbylen[l] = 0;
+	}
+	for( int i = 0; i < nwords; i++ )
+	{
+		int l = strlen( word[i] );
+		bylen[l][nbylen[l]++] = word[i];
+	}
+}
+
+
+/*
+ * FILE *out = create( dir, name );
+ *	Create file <dir>/<name> for writing, or die.
+ */
+FILE *create( char *dir, char *name )
+{
+	char path[strlen(dir)+strlen(name)+2];
+	sprintf( path, "%s/%s", dir, name );
+	FILE *out = fopen( path, "w" );
+	if( out == NULL )
+	{
+		fprintf( stderr, "mkcorpus: can't create %s\n", path );
+		exit(1);
+	}
+	return out;
+}
+
+
+/*
+ * Write NLINES sentences of 3..12 random words to out, the first word
+ * of each capitalised
+ */
+void sentences( FILE *out )
+{
+	for( int i = 0; i < NLINES; i++ )
+	{
+		int n = 3 + rnd() % 10;
+		for( int j = 0; j < n; j++ )
+		{
+			char *w = randword();
+			if( j == 0 )
+			{
+				fprintf( out, "%c%s", toupper( (unsigned char)w[0] ), w+1 );
+			} else
+			{
+				fputs( w, out );
+			}
+		}
+		fputc( '\n', out );
+	}
+}
+
+
+/*
+ * Write NLINES camelCase identifiers of 2..5 random words to out
+ */
+void camelcase( FILE *out )
+{
+	for( int i = 0; i < NLINES; i++ )
+	{
+		int n = 2 + rnd() % 4;
+		for( int j = 0; j < n; j++ )
+		{
+			char *w = randword();
+			if( j > 0 )
+			{
+				fprintf( out, "%c%s", toupper( (unsigned char)w[0] ), w+1 );
+			} else
+			{
+				fputs( w, out );
+			}
+		}
+		fputc( '\n', out );
+	}
+}
+
+
+/*
+ * char c = badletter();
+ *	Find a letter c such that no word consists of zero or more 'a's
+ *	followed by c: then no string a..ac can be broken into words.
+ *	Return '\0' if there's no such letter.
+ */
+char badletter( void )
+{
+	for( char c = 'b'; c <= 'z'; c++ )
+	{
+		int ok = 1;
+		for( int i = 0; ok && i < nwords; i++ )
+		{
+			char *w = word[i];
+			int len = strlen( w );
+			if( w[len-1] == c && strspn( w, "a" ) == len-1 ) ok = 0;
+		}
+		if( ok ) return c;
+	}
+	return '\0';
+}
+
+
+/*
+ * Write unbreakable lines to out: for each length 10, 20, 50, 100,..
+ * up to 10000, ten lines of that many chars - all 'a's but the last
+ */
+void adversarial( FILE *out )
+{
+	static int lens[] = { 10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000 };
+	char bad = badletter();
+	if( bad == '\0' )
+	{
+		fprintf( stderr, "mkcorpus: warning: every a..aX is breakable\n" );
+		bad = '#';
+	}
+	for( int l = 0; l < sizeof(lens)/sizeof(lens[0]); l++ )
+	{
+		for( int i = 0; i < 10; i++ )
+		{
+			for( int j = 0; j < lens[l]-1; j++ )
+			{
+				fputc( 'a', out );
+			}
+			fprintf( out, "%c\n", bad );
+		}
+	}
+}
+
+
+/*
+ * char *w = wordoflen( len );
+ *	Return a random word of exactly <len> chars, or NULL if there
+ *	are none.
+ */
+char *wordoflen( int len )
+{
+	if( len >= MAXWORDLEN || nbylen[len] == 0 ) return NULL;
+	return bylen[len][rnd() % nbylen[len]];
+}
+
+
+/*
+ * Write lines of exactly <len> chars of run-together random words to
+ * out, about SIZECHARS chars in all.  When the next random word won't
+ * fit, we finish the line with a word that fits exactly, so every line
+ * can be broken up.
+ */
+void sized( FILE *out, int len )
+{
+	int nlines = SIZECHARS / len;
+	if( nlines == 0 ) nlines = 1;
+	for( int i = 0; i < nlines; i++ )
+	{
+		int n = 0;
+		while( n < len )
+		{
+			char *w = randword();
+			if( strlen( w ) > len-n )
+			{
+				w = wordoflen( len-n );
+				if( w == NULL ) continue;	/* try another */
+			}
+			fputs( w, out );
+			n += strlen( w );
+		}
+		fputc( '\n', out );
+	}
+}
+
+
+char *usage = "mkcorpus wordlistfile corpusdir";
+
+int main( int argc, char **argv )
+{
+	if( argc != 3 )
+	{
+		fprintf( stderr, "%s\n", usage );
+		exit(1);
+	}
+	readwords( argv[1] );
+
+	char *dir = argv[2];
+	mkdir( dir, 0755 );
+
+	FILE *out = create( dir, "sentences.txt" );
+	sentences( out );
+	fclose( out );
+
+	out = create( dir, "camel.txt" );
+	camelcase( out );
+	fclose( out );
+
+	out = create( dir, "adversarial.txt" );
+	adversarial( out );
+	fclose( out );
+
+	for( int len = 10; len <= 1000000; len *= 10 )
+	{
+		char name[32];
+		sprintf( name, "size-%d.txt", len );
+		out = create( dir, name );
+		sized( out, len );
+		fclose( out );
+	}
+
+	printf( "wrote corpora in %s, from %d words\n", dir, nwords );
+	return 0;
+}
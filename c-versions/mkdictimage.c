@@ -0,0 +1,87 @@
+/*
+ *	mkdictimage: read a word list, lowercasing each word and removing
+ *		     duplicates (adding up their frequencies, if the list
+ *		     has any), build a dictionary trie of those words, and
+ *		     save it as a precompiled dictionary image, which
+ *		     findlongest and backtrack (given the image instead of
+ *		     the word list) simply mmap() in, rather than reading
+ *		     and inserting every word all over again.  With -P,
+ *		     compile the words into a static minimal perfect hash
+ *		     instead (see mph.c), and save that.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+
+#include "dict.h"
+#include "stats.h"
+
+
+/*
+ *  dictionary dict = readdict( wordlistfile, backend );
+ *	Read a word list <wordlistfile>, build and return a dictionary
+ *	(using the given <backend>) of all those LOWERCASED words,
+ *	reporting how fast we read it.
+ */
+dictionary readdict( char *wordlistfile, dict_backend backend )
+{
+	dictionary dict = dictCreate( backend );
+
+	// read every line (word!) of wordlistfile
+	double t = statsNow();
+	long nbytes = dictReadWords( dict, wordlistfile );
+	if( nbytes == -1 )
+	{
+		fprintf( stderr, "mkdictimage: can't open %s\n", wordlistfile );
+		exit(1);
+	}
+	t = statsNow() - t;
+	printf( "read %s: %.1f MB in %.3f secs, %.1f MB/s\n",
+		wordlistfile, nbytes/1e6, t, t > 0 ? nbytes/t/1e6 : 0 );
+
+	return dict;
+}
+
+
+char *usage =
+	"mkdictimage [-P] wordlistfile imagefile\n"
+	"	-P: save a static minimal perfect hash of the words, not a trie";
+
+int main( int argc, char **argv )
+{
+	dict_backend backend = DictTrie;
+	int opt;
+	while( (opt = getopt( argc, argv, "+P" )) != -1 )
+	{
+		if( opt == 'P' )
+		{
+			backend = DictPerfect;
+		} else
+		{
+			fprintf( stderr, "%s\n", usage );
+			exit(1);
+		}
+	}
+	argc -= optind-1;
+	argv += optind-1;
+	if( argc != 3 )
+	{
+		fprintf( stderr, "%s\n", usage );
+		exit(1);
+	}
+
+	dictionary dict = readdict( argv[1], backend );
+	if( ! dictSaveImage( dict, argv[2] ) )
+	{
+		fprintf( stderr, "mkdictimage: can't write image %s\n", argv[2] );
+		exit(1);
+	}
+	printf( "saved dictionary image %s, maxwordlen=%d\n",
+		argv[2], dictLongest( dict ) );
+	dictFree( dict );
+
+	return 0;
+}
@@ -0,0 +1,576 @@
+/*
+ * mph.c: static minimal perfect hash of strings, for dictionaries that
+ *	  never change once built: mphBuild() gives each of n distinct
+ *	  keys its own slot, 0..n-1, with no empty slots and no
+ *	  collisions, so looking a string up is one slot probe and one
+ *	  compare against the key kept in that slot.
+ *
+ *	  The construction is "hash and displace" (as in CHD, and more
+ *	  directly PTHash): each key's 64 bit hash x picks one of about
+ *	  n/LAMBDA buckets, and each bucket has a 32 bit "pilot" p,
+ *	  chosen at build time so that position( x, p ) sends every
+ *	  key in the bucket to a slot no other key has.  We place the
+ *	  biggest buckets first, while most slots are free, trying
+ *	  p = 0, 1, 2.. for each bucket in turn until all its keys land
+ *	  on free slots.  To help, DENSEKEYS of the keys go into the
+ *	  first DENSEBUCKETS of the buckets: these big buckets are all
+ *	  placed while the table is still mostly empty, leaving small
+ *	  ones (which find room easily) until the end.  So the hash
+ *	  function itself costs just 32/LAMBDA bits per key.
+ *
+ *	  Slot k keeps its key, for checking, as pool[off[k]..off[k+1]-1]:
+ *	  the keys are stored in slot order, one after another.  The hash
+ *	  is computed a char at a time (FNV-1a, then a final mix), so that
+ *	  mphPrefixNext() can look up each successively longer prefix of
+ *	  a string without rehashing it.
+ *
+ *	  The whole structure is relocatable: mphSave() writes it out as
+ *	  is, and mphMap() builds a read-only mph straight on top of a
+ *	  saved copy (eg. one that has been mmap()ed in).  The format is
+ *	  native endian.
+ *
+ * (C) Duncan C. White, 2017
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "mph.h"
+#include "stats.h"
+
+
+// keys per bucket, on average
+#define LAMBDA		5
+
+// this fraction (of 2^32) of the keys go into the first 30% of the
+// buckets, so they average twice LAMBDA keys, and the rest LAMBDA/1.75
+#define DENSEKEYS	2576980378U		/* 0.6 * 2^32 */
+#define DENSEBUCKETS(nb) ((nb)*3/10)
+
+// FNV-1a, a char at a time; the seed changes the starting point
+#define FNVBASIS	0xcbf29ce484222325ULL
+#define FNVPRIME	0x100000001b3ULL
+#define GOLDEN		0x9e3779b97f4a7c15ULL
+#define HSTART(m)	(FNVBASIS ^ (m)->seed*GOLDEN)
+#define HSTEP(h,c)	(((h) ^ (unsigned char)(c)) * FNVPRIME)
+
+
+struct mph_s {
+	uint32_t	nkeys;			/* how many keys (and slots) */
+	uint32_t	nbuckets;
+	uint32_t	ndense;			/* DENSEBUCKETS(nbuckets) */
+	uint32_t	longest;		/* length of longest key */
+	uint64_t	seed;			/* which hash function */
+	uint32_t *	pilot;			/* each bucket's pilot */
+	uint32_t *	off;			/* [nkeys+1]: slot k's key is.. */
+	char *		pool;			/* ..pool[off[k]..off[k+1]-1] */
+	int		mapped;			/* on top of a saved copy? */
+};
+
+// a saved mph starts with this header, then the pilots, the offsets
+// and the pool, padded to a multiple of 8 bytes
+typedef struct {
+	uint32_t	nkeys;
+	uint32_t	nbuckets;
+	uint32_t	longest;
+	uint32_t	poolsize;
+	uint64_t	seed;
+} mphheader;
+
+
+/* Private functions */
+
+static int hashkeys( mph, char **, int *, int, uint64_t *, int *, int *, int *, int * );
+static int placekeys( mph, uint64_t *, int *, int *, int *, int * );
+static int probe( mph, uint64_t, const char *, int );
+static uint64_t mix( uint64_t );
+static inline uint32_t bucket( mph, uint64_t );
+static inline uint32_t position( mph, uint64_t, uint32_t );
+
+
+/*
+ * mph m = mphBuild( keys[], lens[], n, slot[] );
+ *	Build a minimal perfect hash of the <n> keys keys[i], of lengths
+ *	lens[i] (they needn't be '\0' terminated), and store each key's
+ *	slot in slot[i].  The keys may include duplicates, which share
+ *	a slot: so mphKeys(m) may be less than n.  The keys are copied,
+ *	so they needn't outlive m.
+ */
+mph mphBuild( char **keys, int *lens, int n, int *slot )
+{
+	mph m = (mph) calloc( 1, sizeof(struct mph_s) );
+	assert( m != NULL );
+	m->nbuckets = n/LAMBDA + 2;
+	m->ndense = DENSEBUCKETS( m->nbuckets );
+	m->pilot = (uint32_t *) malloc( m->nbuckets*sizeof(uint32_t) );
+	uint64_t *x = (uint64_t *) malloc( (n+1)*sizeof(uint64_t) );
+	int *start = (int *) malloc( (m->nbuckets+1)*sizeof(int) );
+	int *order = (int *) malloc( (n+1)*sizeof(int) );
+	int *rep = (int *) malloc( (n+1)*sizeof(int) );
+	int *size = (int *) malloc( m->nbuckets*sizeof(int) );
+	int *keyat = (int *) malloc( (n+1)*sizeof(int) );
+	assert( m->pilot != NULL && x != NULL && start != NULL && order != NULL &&
+		rep != NULL && size != NULL && keyat != NULL );
+
+	// two different keys with the same 64 bit hash, or a bucket with
+	// no pilot that fits, are (very) bad luck: try another seed
+	for( m->seed = 0; ; m->seed++ )
+	{
+		int nk = hashkeys( m, keys, lens, n, x, start, order, rep, size );
+		if( nk == -1 ) continue;
+		m->nkeys = nk;
+		if( placekeys( m, x, start, order, size, keyat ) ) break;
+	}
+
+	// store the keys in slot order
+	size_t poolsize = 0;
+	for( int k = 0; k < m->nkeys; k++ )
+	{
+		poolsize += lens[keyat[k]];
+	}
+	assert( poolsize <= UINT32_MAX );
+	m->off = (uint32_t *) malloc( (m->nkeys+1)*sizeof(uint32_t) );
+	m->pool = (char *) malloc( poolsize+1 );
+	assert( m->off != NULL && m->pool != NULL );
+	uint32_t at = 0;
+	for( int k = 0; k < m->nkeys; k++ )
+	{
+		int i = keyat[k];
+		m->off[k] = at;
+		memcpy( m->pool+at, keys[i], lens[i] );
+		at += lens[i];
+		if( lens[i] > m->longest ) m->longest = lens[i];
+	}
+	m->off[m->nkeys] = at;
+
+	// each key's slot: the distinct keys', then their duplicates'
+	for( int k = 0; k < m->nkeys; k++ )
+	{
+		slot[keyat[k]] = k;
+	}
+	for( int i = 0; i < n; i++ )
+	{
+		if( rep[i] != i ) slot[i] = slot[rep[i]];
+	}
+
+	free( (void *) x );
+	free( (void *) start );
+	free( (void *) order );
+	free( (void *) rep );
+	free( (void *) size );
+	free( (void *) keyat );
+	return m;
+}
+
+
+/*
+ * Free the given mph (if it's mapped, the memory it's built on is the
+ * caller's to release)
+ */
+void mphFree( mph m )
+{
+	if( ! m->mapped )
+	{
+		free( (void *) m->pilot );
+		free( (void *) m->off );
+		free( (void *) m->pool );
+	}
+	free( (void *) m );
+}
+
+
+/*
+ * size_t size = mphSave( m, out );
+ *	Write mph m to out, in the form that mphMap() expects;
+ *	return the number of bytes written, or 0 on failure.
+ */
+size_t mphSave( mph m, FILE *out )
+{
+	mphheader h;
+	memset( &h, 0, sizeof(h) );
+	h.nkeys    = m->nkeys;
+	h.nbuckets = m->nbuckets;
+	h.longest  = m->longest;
+	h.poolsize = m->off[m->nkeys];
+	h.seed     = m->seed;
+	if( fwrite( &h, sizeof(h), 1, out ) != 1 ) return 0;
+	if( fwrite( m->pilot, sizeof(uint32_t), m->nbuckets, out ) != m->nbuckets ) return 0;
+	if( fwrite( m->off, sizeof(uint32_t), m->nkeys+1, out ) != m->nkeys+1 ) return 0;
+	if( fwrite( m->pool, 1, h.poolsize, out ) != h.poolsize ) return 0;
+	size_t size = mphSize( m );
+	size_t written = sizeof(h) + (m->nbuckets+m->nkeys+1)*sizeof(uint32_t) + h.poolsize;
+	char pad[8] = { 0 };
+	if( fwrite( pad, 1, size-written, out ) != size-written ) return 0;
+	return size;
+}
+
+
+/*
+ * size_t size = mphSize( m );
+ *	Return the number of bytes that mphSave( m ) writes: always
+ *	a multiple of 8, so that whatever follows stays aligned.
+ */
+size_t mphSize( mph m )
+{
+	size_t size = sizeof(mphheader) +
+		      (m->nbuckets+m->nkeys+1)*sizeof(uint32_t) + m->off[m->nkeys];
+	return (size+7) & ~(size_t)7;
+}
+
+
+/*
+ * mph m = mphMap( mem, size );
+ *	Build a read-only mph on top of <size> bytes at <mem>, previously
+ *	written by mphSave() - and suitably aligned.  The memory must
+ *	outlive the mph.  Return NULL if it's not a plausible mph.
+ */
+mph mphMap( const void *mem, size_t size )
+{
+	const mphheader *h = (const mphheader *)mem;
+	if( size < sizeof(*h) || h->nbuckets < 2 ||
+	    size < sizeof(*h) + ((size_t)h->nbuckets+h->nkeys+1)*sizeof(uint32_t) + h->poolsize )
+	{
+		return NULL;
+	}
+	mph m = (mph) calloc( 1, sizeof(struct mph_s) );
+	assert( m != NULL );
+	m->nkeys = h->nkeys;
+	m->nbuckets = h->nbuckets;
+	m->ndense = DENSEBUCKETS( m->nbuckets );
+	m->longest = h->longest;
+	m->seed = h->seed;
+	m->pilot = (uint32_t *) (h+1);
+	m->off = m->pilot + m->nbuckets;
+	m->pool = (char *) (m->off + m->nkeys+1);
+	m->mapped = 1;
+	if( m->off[m->nkeys] != h->poolsize )
+	{
+		free( (void *) m );
+		return NULL;
+	}
+	return m;
+}
+
+
+/*
+ * How many (distinct) keys does m have?  Their slots are 0..that-1.
+ */
+int mphKeys( mph m )
+{
+	return m->nkeys;
+}
+
+
+/*
+ * const char *key = mphKey( m, k, &len );
+ *	Return the key in slot <k> of m (not '\0' terminated), and set
+ *	len to its length.
+ */
+const char *mphKey( mph m, int k, int *len )
+{
+	assert( k >= 0 && k < m->nkeys );
+	*len = m->off[k+1] - m->off[k];
+	return m->pool + m->off[k];
+}
+
+
+/*
+ * How long is the longest key in m?
+ */
+int mphLongest( mph m )
+{
+	return m->longest;
+}
+
+
+/*
+ * double bits = mphBitsPerKey( m );
+ *	How many bits per key does m's hash function (its pilots) take?
+ *	This doesn't count the keys themselves, kept for checking.
+ */
+double mphBitsPerKey( mph m )
+{
+	return m->nkeys == 0 ? 0 : 32.0 * m->nbuckets / m->nkeys;
+}
+
+
+/*
+ * int k = mphLookup( m, key, len );
+ *	Return the slot of the <len> char <key> in m, or -1 if it's not
+ *	one of m's keys.
+ */
+int mphLookup( mph m, const char *key, int len )
+{
+	uint64_t h = HSTART( m );
+	for( int i = 0; i < len; i++ )
+	{
+		h = HSTEP( h, key[i] );
+	}
+	return probe( m, h, key, len );
+}
+
+
+/*
+ * mphPrefixStart( m, str, &pp );
+ *	Start looking up the successively longer prefixes of <str> in m:
+ *	each mphPrefixNext( &pp ) extends the prefix by one char, and
+ *	returns its slot, or -1 if it's not a key; mphPrefixSkip( &pp )
+ *	just extends it, without looking it up.  Each char is hashed
+ *	once, however many prefixes are looked up.  The caller must not
+ *	go past the end of str.
+ */
+void mphPrefixStart( mph m, const char *str, mph_prefixprobe *pp )
+{
+	pp->m = m;
+	pp->str = str;
+	pp->len = 0;
+	pp->h = HSTART( m );
+}
+
+
+int mphPrefixNext( mph_prefixprobe *pp )
+{
+	mphPrefixSkip( pp );
+	return probe( pp->m, pp->h, pp->str, pp->len );
+}
+
+
+void mphPrefixSkip( mph_prefixprobe *pp )
+{
+	pp->h = HSTEP( pp->h, pp->str[pp->len] );
+	pp->len++;
+}
+
+
+/*
+ * int nk = hashkeys( m, keys[], lens[], n, x[], start[], order[], rep[], size[] );
+ *	Hash the <n> keys with m's seed into x[], and sort them by bucket
+ *	into order[], bucket b's being order[start[b]..], merging
+ *	duplicates: only the first (its "representative") of each set of
+ *	identical keys is kept in order[], and size[b] is how many
+ *	distinct keys bucket b has.  rep[i] is key i's representative
+ *	(i itself if it's kept).  Return the number of distinct keys,
+ *	or -1 if two different keys have the same hash.
+ */
+static int hashkeys( mph m, char **keys, int *lens, int n, uint64_t *x,
+		     int *start, int *order, int *rep, int *size )
+{
+	memset( start, 0, (m->nbuckets+1)*sizeof(int) );
+	for( int i = 0; i < n; i++ )
+	{
+		uint64_t h = HSTART( m );
+		for( int j = 0; j < lens[i]; j++ )
+		{
+			h = HSTEP( h, keys[i][j] );
+		}
+		x[i] = mix( h );
+		start[bucket( m, x[i] )+1]++;
+	}
+	for( int b = 0; b < m->nbuckets; b++ )
+	{
+		start[b+1] += start[b];
+		size[b] = start[b];		/* where its next key goes */
+	}
+	for( int i = 0; i < n; i++ )
+	{
+		order[size[bucket( m, x[i] )]++] = i;
+	}
+
+	int nk = 0;
+	for( int b = 0; b < m->nbuckets; b++ )
+	{
+		// sort the bucket's keys by hash (there are few of them)..
+		int lo = start[b], hi = start[b+1];
+		for( int j = lo+1; j < hi; j++ )
+		{
+			int i = order[j];
+			int k;
+			for( k = j; k > lo && x[order[k-1]] > x[i]; k-- )
+			{
+				order[k] = order[k-1];
+			}
+			order[k] = i;
+		}
+
+		// ..so that equal hashes are next to each other
+		int d = lo;
+		for( int j = lo; j < hi; j++ )
+		{
+			int i = order[j];
+			if( d > lo && x[order[d-1]] == x[i] )
+			{
+				int r = order[d-1];
+				if( lens[r] != lens[i] || memcmp( keys[r], keys[i], lens[i] ) != 0 )
+				{
+					return -1;
+				}
+				rep[i] = r;
+			} else
+			{
+				rep[i] = i;
+				order[d++] = i;
+			}
+		}
+		size[b] = d - lo;
+		nk += size[b];
+	}
+	return nk;
+}
+
+
+/*
+ * int ok = placekeys( m, x[], start[], order[], size[], keyat[] );
+ *	Choose each bucket's pilot, biggest buckets first, so that each
+ *	key's position is a different slot, 0..m->nkeys-1; record which
+ *	key is in each slot in keyat[].  Return 1 if ok, or 0 if some
+ *	bucket has no pilot that fits.
+ */
+static int placekeys( mph m, uint64_t *x, int *start, int *order, int *size, int *keyat )
+{
+	// sort the (non-empty) buckets by size, biggest first
+	int maxsize = 0;
+	for( int b = 0; b < m->nbuckets; b++ )
+	{
+		if( size[b] > maxsize ) maxsize = size[b];
+	}
+	int *bysize = (int *) calloc( maxsize+2, sizeof(int) );
+	int *border = (int *) malloc( m->nbuckets*sizeof(int) );
+	uint32_t *pos = (uint32_t *) malloc( (maxsize+1)*sizeof(uint32_t) );
+	uint64_t *taken = (uint64_t *) calloc( m->nkeys/64+1, sizeof(uint64_t) );
+	assert( bysize != NULL && border != NULL && pos != NULL && taken != NULL );
+	for( int b = 0; b < m->nbuckets; b++ )
+	{
+		bysize[size[b]]++;
+	}
+	int at = 0;
+	for( int s = maxsize; s > 0; s-- )
+	{
+		int c = bysize[s];
+		bysize[s] = at;
+		at += c;
+	}
+	int nbusy = at;
+	for( int b = 0; b < m->nbuckets; b++ )
+	{
+		m->pilot[b] = 0;
+		if( size[b] > 0 ) border[bysize[size[b]]++] = b;
+	}
+
+	int ok = 1;
+	for( int i = 0; ok && i < nbusy; i++ )
+	{
+		int b = border[i];
+		int *key = order + start[b];
+		uint32_t p = 0;
+		for( ;; )
+		{
+			// try pilot p: claim each key's slot, till one is taken
+			int j;
+			for( j = 0; j < size[b]; j++ )
+			{
+				uint32_t s = position( m, x[key[j]], p );
+				if( taken[s/64] >> (s%64) & 1 ) break;
+				taken[s/64] |= (uint64_t)1 << (s%64);
+				pos[j] = s;
+			}
+			if( j == size[b] ) break;
+
+			// no good: give the slots back, and try the next
+			while( j-- > 0 )
+			{
+				taken[pos[j]/64] &= ~((uint64_t)1 << (pos[j]%64));
+			}
+			if( ++p == 0 )
+			{
+				ok = 0;
+				break;
+			}
+		}
+		m->pilot[b] = p;
+		for( int j = 0; ok && j < size[b]; j++ )
+		{
+			keyat[pos[j]] = key[j];
+		}
+	}
+
+	free( (void *) bysize );
+	free( (void *) border );
+	free( (void *) pos );
+	free( (void *) taken );
+	return ok;
+}
+
+
+/*
+ * int k = probe( m, h, key, len );
+ *	Finish the hash <h> of the <len> char <key>, and return its slot
+ *	in m, or -1 if it's not one of m's keys: its bucket's pilot gives
+ *	the one slot it can be in, and the key there is either it or not.
+ */
+static int probe( mph m, uint64_t h, const char *key, int len )
+{
+	STAT_INC( setlookups );
+	if( m->nkeys == 0 )
+	{
+		STAT_INC( setmisses );
+		return -1;
+	}
+	uint64_t x = mix( h );
+	uint32_t s = position( m, x, m->pilot[bucket( m, x )] );
+	STAT_INC( setprobes );
+	uint32_t o = m->off[s];
+	if( m->off[s+1] - o == len && memcmp( m->pool+o, key, len ) == 0 )
+	{
+		STAT_INC( sethits );
+		return s;
+	}
+	STAT_INC( setmisses );
+	return -1;
+}
+
+
+/*
+ * uint64_t x = mix( h );
+ *	Mix all 64 bits of <h> together, so that every bit of the result
+ *	depends on every bit of h (Murmur3's finalizer).
+ */
+static uint64_t mix( uint64_t h )
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+
+/*
+ * uint32_t b = bucket( m, x );
+ *	Which bucket does a key with hash <x> go in?  The top 32 bits
+ *	decide whether it's a dense one or not, the bottom 32 which.
+ */
+static inline uint32_t bucket( mph m, uint64_t x )
+{
+	uint64_t lo = (uint32_t) x;
+	if( (uint32_t) (x >> 32) < DENSEKEYS )
+	{
+		return (lo * m->ndense) >> 32;
+	}
+	return m->ndense + ((lo * (m->nbuckets - m->ndense)) >> 32);
+}
+
+
+/*
+ * uint32_t s = position( m, x, p );
+ *	Which slot does a key with hash <x> go in, in a bucket with
+ *	pilot <p>?
+ */
+static inline uint32_t position( mph m, uint64_t x, uint32_t p )
+{
+	uint64_t y = mix( x ^ p*GOLDEN );
+	return ((y >> 32) * m->nkeys) >> 32;
+}
@@ -0,0 +1,35 @@
+/*
+ * mph.h: static minimal perfect hash of strings, built once from a
+ *	  fixed list of keys, then looked up with one probe and one
+ *	  compare per key..
+ *
+ * (C) Duncan C. White, 2017
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+typedef struct mph_s *mph;
+
+// the state of a mphPrefixStart()/mphPrefixNext() walk: public only so
+// that callers can keep it on the stack
+typedef struct {
+	mph		m;			/* the hash we're probing */
+	const char *	str;			/* the string whose prefixes.. */
+	int		len;			/* length of current prefix */
+	uint64_t	h;			/* its (unfinished) hash */
+} mph_prefixprobe;
+
+extern mph mphBuild( char **keys, int *lens, int n, int *slot );
+extern void mphFree( mph m );
+extern size_t mphSave( mph m, FILE *out );
+extern mph mphMap( const void *mem, size_t size );
+extern size_t mphSize( mph m );
+extern int mphKeys( mph m );
+extern const char *mphKey( mph m, int k, int *len );
+extern int mphLongest( mph m );
+extern double mphBitsPerKey( mph m );
+extern int mphLookup( mph m, const char *key, int len );
+extern void mphPrefixStart( mph m, const char *str, mph_prefixprobe *pp );
+extern int mphPrefixNext( mph_prefixprobe *pp );
+extern void mphPrefixSkip( mph_prefixprobe *pp );
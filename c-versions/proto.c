@@ -0,0 +1,303 @@
+/*
+ * proto.c: length-prefixed message framing over a stream socket,
+ *	    for the segmentation daemon (segd) and its clients.  Each
+ *	    message is a 4 byte length, in network byte order, followed
+ *	    by that many bytes of payload.  What's in the payload is up
+ *	    to the caller (see segd.c for the daemon's requests and
+ *	    responses).
+ *
+ *	    Both directions are buffered, so that a client can pipeline
+ *	    many requests, and a server answer them, in a few large
+ *	    reads and writes: protoSend() only adds a message to the
+ *	    output buffer (writing it out when it gets full), and
+ *	    protoRecv() flushes the output buffer only when it has to
+ *	    wait for more input.  To send on one thread while receiving
+ *	    on another, give each thread its own protoconn on the same
+ *	    socket.  Closing the socket is up to the caller.
+ *
+ *	    The sockets themselves are Unix domain sockets, named by
+ *	    a path: protoListen() and protoConnect() set them up.
+ *
+ * (C) Duncan C. White, 2017
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <assert.h>
+
+#include "proto.h"
+
+
+// we write the output buffer out once it holds this much
+#define OUTBUFSIZE	65536
+
+// and read input at least this much at a time
+#define INBUFSIZE	65536
+
+// the length in front of each message
+#define HEADERLEN	4
+
+
+struct proto_s {
+	int		fd;			/* the socket */
+	char *		in;			/* input buffer: */
+	int		insize;			/* its size, */
+	int		instart;		/* unconsumed input starts here.. */
+	int		inend;			/* ..and ends here */
+	int		savedpos;		/* where we put a '\0', or -1.. */
+	char		savedch;		/* ..and what was there */
+	char *		out;			/* output buffer: */
+	int		outsize;		/* its size.. */
+	int		outlen;			/* ..and how much is in it */
+	int		error;			/* a write failed? */
+};
+
+
+/* Private functions */
+
+static void growin( protoconn, int );
+static int makeaddr( char *, struct sockaddr_un * );
+
+
+/*
+ * int fd = protoListen( path );
+ *	Create a Unix domain socket listening at <path>, replacing any
+ *	stale socket left there by a server that's gone, and return it,
+ *	or -1 (with errno set) on failure - including if another server
+ *	is already listening there.
+ */
+int protoListen( char *path )
+{
+	struct sockaddr_un addr;
+	if( ! makeaddr( path, &addr ) ) return -1;
+
+	int fd = protoConnect( path );
+	if( fd != -1 )
+	{
+		close( fd );
+		errno = EADDRINUSE;
+		return -1;
+	}
+	struct stat st;
+	if( lstat( path, &st ) == 0 && S_ISSOCK( st.st_mode ) ) unlink( path );
+
+	fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+	if( fd == -1 ) return -1;
+	if( bind( fd, (struct sockaddr *) &addr, sizeof(addr) ) == -1 ||
+	    listen( fd, SOMAXCONN ) == -1 )
+	{
+		int e = errno;
+		close( fd );
+		errno = e;
+		return -1;
+	}
+	return fd;
+}
+
+
+/*
+ * int fd = protoConnect( path );
+ *	Connect to the server listening on the Unix domain socket <path>,
+ *	and return the connected socket, or -1 (with errno set).
+ */
+int protoConnect( char *path )
+{
+	struct sockaddr_un addr;
+	if( ! makeaddr( path, &addr ) ) return -1;
+	int fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+	if( fd == -1 ) return -1;
+	if( connect( fd, (struct sockaddr *) &addr, sizeof(addr) ) == -1 )
+	{
+		int e = errno;
+		close( fd );
+		errno = e;
+		return -1;
+	}
+	return fd;
+}
+
+
+/*
+ * protoconn c = protoCreate( fd );
+ *	Start exchanging messages over the connected stream socket <fd>.
+ */
+protoconn protoCreate( int fd )
+{
+	protoconn c = (protoconn) malloc( sizeof(struct proto_s) );
+	assert( c != NULL );
+	c->fd = fd;
+	c->insize = INBUFSIZE;
+	c->in = (char *) malloc( c->insize );
+	c->outsize = OUTBUFSIZE;
+	c->out = (char *) malloc( c->outsize );
+	assert( c->in != NULL && c->out != NULL );
+	c->instart = c->inend = 0;
+	c->savedpos = -1;
+	c->outlen = 0;
+	c->error = 0;
+	return c;
+}
+
+
+/*
+ * char *msg = protoRecv( c, &len );
+ *	Receive the next message on connection c (first writing out any
+ *	buffered output, if we have to wait for it), setting len to its
+ *	length, and return its payload - which stays valid, and '\0'
+ *	terminated, until the next protoRecv().  Return NULL at end of
+ *	file, or on any error (including an over-long message).
+ */
+char *protoRecv( protoconn c, int *len )
+{
+	// put back the char we overwrote with a '\0' last time
+	if( c->savedpos != -1 ) c->in[c->savedpos] = c->savedch;
+	c->savedpos = -1;
+
+	for(;;)
+	{
+		int avail = c->inend - c->instart;
+		uint32_t n = 0;
+		if( avail >= HEADERLEN )
+		{
+			memcpy( &n, c->in+c->instart, HEADERLEN );
+			n = ntohl( n );
+			if( n > PROTOMAXMSG ) return NULL;
+			if( avail >= HEADERLEN+n )
+			{
+				char *msg = c->in + c->instart + HEADERLEN;
+				c->instart += HEADERLEN+n;
+				c->savedpos = c->instart;
+				c->savedch = c->in[c->instart];
+				c->in[c->instart] = '\0';
+				*len = n;
+				return msg;
+			}
+		}
+
+		// we need more input: before we wait for it, send
+		// whatever we owe the other end
+		if( c->outlen > 0 && ! protoFlush( c ) ) return NULL;
+		growin( c, HEADERLEN+n );
+		ssize_t got;
+		do
+		{
+			got = read( c->fd, c->in+c->inend, c->insize-1-c->inend );
+		} while( got == -1 && errno == EINTR );
+		if( got <= 0 ) return NULL;
+		c->inend += got;
+	}
+}
+
+
+/*
+ * protoSend( c, msg, len );
+ *	Queue the <len> byte message <msg> for sending on connection c.
+ *	It goes out when the output buffer fills up, or at the next
+ *	protoFlush() (or protoRecv() that has to wait).
+ */
+void protoSend( protoconn c, const char *msg, int len )
+{
+	assert( len >= 0 && len <= PROTOMAXMSG );
+	if( c->outlen > 0 && c->outlen+HEADERLEN+len > OUTBUFSIZE )
+	{
+		(void) protoFlush( c );
+	}
+	if( c->outlen+HEADERLEN+len > c->outsize )
+	{
+		c->outsize = c->outlen+HEADERLEN+len;
+		c->out = (char *) realloc( c->out, c->outsize );
+		assert( c->out != NULL );
+	}
+	uint32_t n = htonl( len );
+	memcpy( c->out+c->outlen, &n, HEADERLEN );
+	memcpy( c->out+c->outlen+HEADERLEN, msg, len );
+	c->outlen += HEADERLEN+len;
+}
+
+
+/*
+ * int ok = protoFlush( c );
+ *	Write out everything queued on connection c.  Return 0 if
+ *	any write (now or earlier) failed, eg. the other end has gone.
+ */
+int protoFlush( protoconn c )
+{
+	for( int done = 0; done < c->outlen && ! c->error; )
+	{
+		// MSG_NOSIGNAL: a vanished client is an error, not a SIGPIPE
+		ssize_t n = send( c->fd, c->out+done, c->outlen-done, MSG_NOSIGNAL );
+		if( n == -1 && errno == EINTR ) continue;
+		if( n <= 0 )
+		{
+			c->error = 1;
+		} else
+		{
+			done += n;
+		}
+	}
+	c->outlen = 0;
+	return ! c->error;
+}
+
+
+/*
+ * Free connection c, without flushing it or closing its socket
+ */
+void protoFree( protoconn c )
+{
+	free( (void *) c->in );
+	free( (void *) c->out );
+	free( (void *) c );
+}
+
+
+/*
+ * int ok = makeaddr( path, &addr );
+ *	Fill in addr, the Unix domain socket address for <path>.  Return
+ *	0 (with errno set) if path is too long.
+ */
+static int makeaddr( char *path, struct sockaddr_un *addr )
+{
+	memset( addr, 0, sizeof(*addr) );
+	addr->sun_family = AF_UNIX;
+	if( strlen( path ) >= sizeof(addr->sun_path) )
+	{
+		errno = ENAMETOOLONG;
+		return 0;
+	}
+	strcpy( addr->sun_path, path );
+	return 1;
+}
+
+
+/*
+ * growin( c, need );
+ *	Make room in connection c's input buffer for a whole <need> byte
+ *	message (plus a '\0' after it) starting at instart, plus more
+ *	to read into: moving the unconsumed input down to the start,
+ *	and enlarging the buffer if need be.
+ */
+static void growin( protoconn c, int need )
+{
+	if( c->instart > 0 )
+	{
+		memmove( c->in, c->in+c->instart, c->inend-c->instart );
+		c->inend -= c->instart;
+		c->instart = 0;
+	}
+	if( need+1 > c->insize || c->inend+1 == c->insize )
+	{
+		c->insize = need+1 > 2*c->insize ? need+1 : 2*c->insize;
+		c->in = (char *) realloc( c->in, c->insize );
+		assert( c->in != NULL );
+	}
+}
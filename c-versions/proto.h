@@ -0,0 +1,19 @@
+/*
+ * proto.h: length-prefixed message framing over a stream socket,
+ *	    for the segmentation daemon (segd) and its clients..
+ *
+ * (C) Duncan C. White, 2017
+ */
+
+// no message may be longer than..
+#define PROTOMAXMSG	(64*1024*1024)
+
+typedef struct proto_s *protoconn;
+
+extern int protoListen( char *path );
+extern int protoConnect( char *path );
+extern protoconn protoCreate( int fd );
+extern char *protoRecv( protoconn c, int *len );
+extern void protoSend( protoconn c, const char *msg, int len );
+extern int protoFlush( protoconn c );
+extern void protoFree( protoconn c );
@@ -0,0 +1,296 @@
+/*
+ *	runbench: run every segmenter over the benchmark corpora (built
+ *		  by mkcorpus), and report, for each engine and corpus,
+ *		  the throughput (sentences per second and nanoseconds
+ *		  per char) and the peak resident set size.
+ *
+ *		  Each engine is run as a separate process in batch mode
+ *		  (or stream mode), reading a corpus file on stdin, with
+ *		  its output thrown away.  First, each engine is run on
+ *		  empty input: that time is its dictionary load time,
+ *		  which we subtract from the corpus run times before
+ *		  working out throughput.  Each run is repeated <reps>
+ *		  times, and the fastest taken.
+ *
+ *		  Stream mode reads its whole input as one text, not as
+ *		  one sentence per line, so sentences/s means nothing
+ *		  for it: we report it separately, in chars/s, and only
+ *		  on the size-N corpora, whose lines run together into
+ *		  one text that can still be broken up.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <assert.h>
+
+
+// an engine: a segmenter and the options it's run with
+typedef struct {
+	char *		name;			/* as shown in the report */
+	char *		prog;			/* program to run */
+	char *		opts[4];		/* options, NULL terminated */
+	int		wordlist;		/* needs the word list, not image */
+	int		stream;			/* reads its input as one text */
+} engine;
+
+engine engines[] = {
+	{ "findlongest",	"./findlongest",	{ "-b", NULL },		0, 0 },
+	{ "findlongest -P",	"./findlongest",	{ "-b", "-P", NULL },	1, 0 },
+	{ "backtrack",		"./backtrack",		{ "-b", NULL },		0, 0 },
+	{ "backtrack -f",	"./backtrack",		{ "-b", "-f", NULL },	0, 0 },
+	{ "backtrack -p",	"./backtrack",		{ "-b", "-p", NULL },	0, 0 },
+	{ "backtrack -H",	"./backtrack",		{ "-b", "-H", NULL },	1, 0 },
+	{ "backtrack -P",	"./backtrack",		{ "-b", "-P", NULL },	1, 0 },
+	{ "backtrack -t 0",	"./backtrack",		{ "-b", "-t", "0", NULL }, 0, 0 },
+	{ "backtrack -s",	"./backtrack",		{ "-s", NULL },		0, 1 },
+};
+#define NENGINES (sizeof(engines)/sizeof(engines[0]))
+
+// a corpus, and whether its lines run together into one breakable text
+typedef struct {
+	char *		name;
+	int		onetext;
+} corpus;
+
+// the corpora, in the order we report them
+corpus corpora[] = {
+	{ "sentences.txt", 0 }, { "camel.txt", 0 }, { "adversarial.txt", 0 },
+	{ "size-10.txt", 1 }, { "size-100.txt", 1 }, { "size-1000.txt", 1 },
+	{ "size-10000.txt", 1 }, { "size-100000.txt", 1 },
+	{ "size-1000000.txt", 1 },
+};
+#define NCORPORA (sizeof(corpora)/sizeof(corpora[0]))
+
+// the result of one run
+typedef struct {
+	double		secs;			/* elapsed wall time */
+	long		maxrss;			/* peak RSS in KB */
+	int		status;			/* exit status */
+} result;
+
+
+/*
+ * double t = now();
+ *	Return the current (monotonic) time in seconds.
+ */
+double now( void )
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+
+/*
+ * result r = runonce( e, dict, input );
+ *	Run engine e with dictionary <dict>, reading file <input> and
+ *	discarding its output, and return how long it took, its peak RSS
+ *	(via wait4()'s rusage, which covers just that child) and its exit
+ *	status.
+ */
+result runonce( engine *e, char *dict, char *input )
+{
+	char *argv[10];
+	int argc = 0;
+	argv[argc++] = e->prog;
+	for( char **o = e->opts; *o != NULL; o++ )
+	{
+		argv[argc++] = *o;
+	}
+	argv[argc++] = dict;
+	argv[argc++] = "-";
+	argv[argc] = NULL;
+
+	double start = now();
+	pid_t pid = fork();
+	if( pid == -1 )
+	{
+		perror( "runbench: fork" );
+		exit(1);
+	}
+	if( pid == 0 )
+	{
+		int in = open( input, O_RDONLY );
+		int out = open( "/dev/null", O_WRONLY );
+		if( in == -1 || out == -1 )
+		{
+			perror( "runbench: open" );
+			_exit(127);
+		}
+		dup2( in, 0 );
+		dup2( out, 1 );
+		dup2( out, 2 );
+		execv( e->prog, argv );
+		_exit(127);
+	}
+
+	int status;
+	struct rusage ru;
+	if( wait4( pid, &status, 0, &ru ) == -1 )
+	{
+		perror( "runbench: wait4" );
+		exit(1);
+	}
+	result r;
+	r.secs = now() - start;
+	r.maxrss = ru.ru_maxrss;
+	r.status = WIFEXITED(status) ? WEXITSTATUS(status) : 128+WTERMSIG(status);
+	return r;
+}
+
+
+/*
+ * result r = run( e, dict, input, reps );
+ *	Run engine e <reps> times, as runonce() does, and return the
+ *	fastest run.
+ */
+result run( engine *e, char *dict, char *input, int reps )
+{
+	result best = runonce( e, dict, input );
+	for( int i = 1; i < reps; i++ )
+	{
+		result r = runonce( e, dict, input );
+		if( r.secs < best.secs ) best = r;
+	}
+	return best;
+}
+
+
+/*
+ * int ok = measure( filename, &nlines, &nchars );
+ *	Count the lines and (non-newline) chars in <filename>; return 0
+ *	if it can't be read.
+ */
+int measure( char *filename, long *nlines, long *nchars )
+{
+	FILE *f = fopen( filename, "r" );
+	if( f == NULL ) return 0;
+	*nlines = *nchars = 0;
+	int c;
+	while( (c = getc( f )) != EOF )
+	{
+		if( c == '\n' ) (*nlines)++; else (*nchars)++;
+	}
+	fclose( f );
+	return 1;
+}
+
+
+/*
+ * report( e, c, wordlist, image, dir, load, reps );
+ *	Run engine e (which takes <load> secs to load its dictionary:
+ *	either <wordlist> or <image>) on corpus c in directory <dir>, as
+ *	run() does, and print a row of the report: its throughput in
+ *	sentences/s, or - for a stream mode engine - in chars/s.
+ */
+void report( engine *e, corpus *c, char *wordlist, char *image, char *dir,
+	double load, int reps )
+{
+	char input[strlen(dir)+strlen(c->name)+2];
+	sprintf( input, "%s/%s", dir, c->name );
+	long nlines, nchars;
+	if( ! measure( input, &nlines, &nchars ) )
+	{
+		fprintf( stderr, "runbench: can't read %s\n", input );
+		return;
+	}
+	char *dict = e->wordlist ? wordlist : image;
+	result r = run( e, dict, input, reps );
+	double secs = r.secs - load;
+	if( secs < 1e-6 ) secs = 1e-6;
+	char status[16];
+	if( r.status == 0 )
+	{
+		strcpy( status, "ok" );
+	} else
+	{
+		sprintf( status, "exit %d", r.status );
+	}
+	printf( "%-16s %-18s %8ld %9ld %9.3f %12.0f %9.1f %10ld %s\n",
+		e->name, c->name, nlines, nchars, r.secs,
+		(e->stream ? nchars : nlines)/secs, secs*1e9/nchars,
+		r.maxrss, status );
+	fflush( stdout );
+}
+
+
+char *usage = "runbench [-r reps] wordlistfile imagefile corpusdir";
+
+int main( int argc, char **argv )
+{
+	int reps = 3;
+	int opt;
+	while( (opt = getopt( argc, argv, "+r:" )) != -1 )
+	{
+		if( opt == 'r' )
+		{
+			reps = atoi( optarg );
+			if( reps < 1 ) reps = 1;
+		} else
+		{
+			fprintf( stderr, "%s\n", usage );
+			exit(1);
+		}
+	}
+	argc -= optind-1;
+	argv += optind-1;
+	if( argc != 4 )
+	{
+		fprintf( stderr, "%s\n", usage );
+		exit(1);
+	}
+	char *wordlist = argv[1];
+	char *image = argv[2];
+	char *dir = argv[3];
+
+	// dictionary load time: each engine on empty input
+	double load[NENGINES];
+	printf( "%-16s %-10s %10s %10s\n", "engine", "dict", "load ms", "rss KB" );
+	for( int e = 0; e < NENGINES; e++ )
+	{
+		char *dict = engines[e].wordlist ? wordlist : image;
+		result r = run( &engines[e], dict, "/dev/null", reps );
+		load[e] = r.secs;
+		printf( "%-16s %-10s %10.2f %10ld\n", engines[e].name,
+			engines[e].wordlist ? "wordlist" : "image",
+			r.secs*1e3, r.maxrss );
+	}
+	printf( "\n" );
+
+	// batch mode engines: sentences per second, on every corpus
+	printf( "%-16s %-18s %8s %9s %9s %12s %9s %10s %s\n",
+		"engine", "corpus", "lines", "chars", "secs",
+		"sentences/s", "ns/char", "rss KB", "status" );
+	for( int c = 0; c < NCORPORA; c++ )
+	{
+		for( int e = 0; e < NENGINES; e++ )
+		{
+			if( ! engines[e].stream ) report( &engines[e], &corpora[c],
+				wordlist, image, dir, load[e], reps );
+		}
+	}
+	printf( "\n" );
+
+	// stream mode engines: chars per second, on one text corpora
+	printf( "%-16s %-18s %8s %9s %9s %12s %9s %10s %s\n",
+		"engine", "corpus", "lines", "chars", "secs",
+		"chars/s", "ns/char", "rss KB", "status" );
+	for( int c = 0; c < NCORPORA; c++ )
+	{
+		for( int e = 0; e < NENGINES; e++ )
+		{
+			if( engines[e].stream && corpora[c].onetext ) report(
+				&engines[e], &corpora[c], wordlist, image, dir,
+				load[e], reps );
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,158 @@
+/*
+ *	segclient: send sentences, one per line, to the sentence splitting
+ *		   daemon (segd), optionally with some extra words for the
+ *		   dictionary, and print the daemon's result lines - the
+ *		   same as batch mode's (see batch.c) - in order.
+ *
+ *		   A sender thread sends every request as soon as it's
+ *		   read, without waiting for earlier responses (so only
+ *		   the socket buffers limit how many are in flight), while
+ *		   the main thread prints the responses as they arrive.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <assert.h>
+
+#include "proto.h"
+
+
+// what the sender thread needs
+typedef struct {
+	int		fd;			/* the connection */
+	FILE *		in;			/* read sentences from here */
+	char *		extra;			/* extra words, or "" */
+	long		nsent;			/* requests sent */
+} sendarg;
+
+
+/*
+ * The sender thread: send each line of input as a request, with the
+ * extra words in front.  When reading interactively, send each one at
+ * once; otherwise let them build up into large writes.  At the end,
+ * shut down our half of the connection, so that segd knows we're done.
+ */
+void *sender( void *arg )
+{
+	sendarg *a = (sendarg *) arg;
+	protoconn c = protoCreate( a->fd );
+	int interactive = isatty( fileno( a->in ) );
+	int extralen = strlen( a->extra );
+
+	char *line = NULL;
+	size_t linesize = 0;
+	char *req = NULL;
+	size_t reqsize = 0;
+	ssize_t n;
+	a->nsent = 0;
+	while( (n = getline( &line, &linesize, a->in )) != -1 )
+	{
+		// remove trailing '\n' or "\r\n"
+		if( n > 0 && line[n-1] == '\n' ) n--;
+		if( n > 0 && line[n-1] == '\r' ) n--;
+
+		// the request: extra words, newline, sentence
+		if( extralen+1+n > reqsize )
+		{
+			reqsize = extralen+1+n;
+			req = (char *) realloc( req, reqsize );
+			assert( req != NULL );
+		}
+		memcpy( req, a->extra, extralen );
+		req[extralen] = '\n';
+		memcpy( req+extralen+1, line, n );
+		protoSend( c, req, extralen+1+n );
+		a->nsent++;
+		if( interactive && ! protoFlush( c ) ) break;
+	}
+	(void) protoFlush( c );
+	shutdown( a->fd, SHUT_WR );
+
+	protoFree( c );
+	free( (void *) line );
+	free( (void *) req );
+	return NULL;
+}
+
+
+char *usage = "segclient [-w 'extra words'] socketpath [sentencefile|-]";
+
+int main( int argc, char **argv )
+{
+	char *extra = "";
+	int opt;
+	while( (opt = getopt( argc, argv, "+w:" )) != -1 )
+	{
+		if( opt == 'w' )
+		{
+			extra = optarg;
+		} else
+		{
+			fprintf( stderr, "%s\n", usage );
+			exit(1);
+		}
+	}
+	argc -= optind-1;
+	argv += optind-1;
+	if( argc != 2 && argc != 3 )
+	{
+		fprintf( stderr, "%s\n", usage );
+		exit(1);
+	}
+
+	// no newlines among the extra words: that would end them early
+	if( strchr( extra, '\n' ) != NULL )
+	{
+		fprintf( stderr, "segclient: extra words must be on one line\n" );
+		exit(1);
+	}
+
+	FILE *in = argc == 2 || strcmp( argv[2], "-" ) == 0 ? stdin : fopen( argv[2], "r" );
+	if( in == NULL )
+	{
+		fprintf( stderr, "segclient: can't open %s\n", argv[2] );
+		exit(1);
+	}
+	int fd = protoConnect( argv[1] );
+	if( fd == -1 )
+	{
+		fprintf( stderr, "segclient: can't connect to %s: %s\n",
+			argv[1], strerror( errno ) );
+		exit(1);
+	}
+
+	sendarg a = { fd, in, extra, 0 };
+	pthread_t t;
+	pthread_create( &t, NULL, &sender, &a );
+
+	// print each response as it arrives
+	protoconn c = protoCreate( fd );
+	int interactive = isatty( fileno( stdout ) );
+	long nreceived = 0;
+	char *msg;
+	int len;
+	while( (msg = protoRecv( c, &len )) != NULL )
+	{
+		fwrite( msg, sizeof(char), len, stdout );
+		if( interactive ) fflush( stdout );
+		nreceived++;
+	}
+	pthread_join( t, NULL );
+	fflush( stdout );
+
+	protoFree( c );
+	close( fd );
+	if( in != stdin ) fclose( in );
+	if( nreceived != a.nsent )
+	{
+		fprintf( stderr, "segclient: lost connection after %ld of %ld responses\n",
+			nreceived, a.nsent );
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,347 @@
+/*
+ *	segd: the sentence splitting daemon: read a dictionary once, then
+ *	      serve requests to break sentences WITH NO SPACES up into
+ *	      words, from any number of local clients at once, over a
+ *	      Unix domain socket - so the dictionary stays loaded, and
+ *	      its pages hot in the cache, between queries.  (See segclient
+ *	      and segload for clients.)
+ *
+ *	      Each message, either way, is a 4 byte length (in network
+ *	      byte order) followed by that many bytes (see proto.c).  A
+ *	      request is:
+ *
+ *		extra words, space separated<NEWLINE>sentence
+ *
+ *	      where the extra words (if any) are added to the dictionary
+ *	      for this request only; a request with no newline at all is
+ *	      just a sentence.  The response is the sentence's result line
+ *	      exactly as batch mode writes it (see batch.c), newline and
+ *	      all:
+ *
+ *		ok<TAB>s1,s2,...,sN<TAB>word1 word2 ... wordN<NEWLINE>
+ *	      or
+ *		fail<TAB><TAB>original sentence<NEWLINE>
+ *
+ *	      A client may send as many requests as it likes without
+ *	      waiting for the responses (pipelining): each connection's
+ *	      responses come back in the order of its requests.  Each
+ *	      connection gets its own thread, all sharing the one read-only
+ *	      dictionary; a request's extra words go into a dictionary
+ *	      overlay (see dictOverlay()), which costs time proportional
+ *	      to the number of extra words, not the size of the dictionary.
+ *
+ *	      Sending segd a SIGHUP makes it read its word list (or image)
+ *	      again, and swap the new dictionary in without a pause:
+ *	      requests already under way finish with the old one, which
+ *	      is freed once the last of them is done (see epoch.c), and
+ *	      later ones use the new one.  To replace an image, write the
+ *	      new one under another name and rename() it into place -
+ *	      overwriting the mapped file would pull it out from under
+ *	      the old dictionary.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <assert.h>
+
+#include "dict.h"
+#include "lower.h"
+#include "segment.h"
+#include "batch.h"
+#include "proto.h"
+#include "epoch.h"
+
+// no single word in the dictionary longer than..
+#define MAXWORDLEN 1024
+
+typedef char aword[MAXWORDLEN];
+
+
+// what every connection's thread shares: the current dictionary (only
+// to be used inside an epoch section, as it may be replaced at any time)
+_Atomic(dictionary) dict;
+seg_objective obj = SegLongestFirst;
+dict_backend backend = DictTrie;
+
+// where it came from, to read again on SIGHUP
+aword wordlistfile = "/usr/share/dict/words";
+
+// the socket's path, to remove when we're killed
+char *socketpath;
+
+
+/*
+ *  dictionary dict = readdict( wordlistfile, backend );
+ *	Read a word list <wordlistfile>, build and return a dictionary
+ *	(using the given <backend>) of all those LOWERCASED words.  If
+ *	<wordlistfile> is a precompiled dictionary image (see mkdictimage)
+ *	we simply map it in instead, ignoring <backend>.
+ */
+dictionary readdict( char *wordlistfile, dict_backend backend )
+{
+	dictionary dict = dictMapImage( wordlistfile );
+	if( dict == NULL )
+	{
+		dict = dictCreate( backend );
+
+		// read every line (word!) of wordlistfile
+		if( dictReadWords( dict, wordlistfile ) == -1 )
+		{
+			fprintf( stderr, "segd: can't open %s\n", wordlistfile );
+			exit(1);
+		}
+	}
+
+	// all words are in: build the automaton that segment() scans with,
+	// before any thread shares the dictionary
+	dictAutomaton( dict );
+	return dict;
+}
+
+
+// a connection's reusable buffers
+typedef struct {
+	segscratch	sc;			/* segmentSpans()' storage */
+	segspan *	spans;			/* the words.. */
+	int *		wordlen;		/* ..and their lengths */
+	int		maxlen;			/* room in spans, wordlen */
+	FILE *		res;			/* response, written here.. */
+	char *		resbuf;			/* ..which ends up here */
+	size_t		ressize;
+} connbufs;
+
+
+/*
+ * int len = handle( msg, len, b );
+ *	Handle request <msg> (of length <len>, '\0' terminated, and ours
+ *	to modify): segment its sentence, with its extra words, if any,
+ *	and write the response into b->resbuf, returning its length.
+ */
+int handle( char *msg, int len, connbufs *b )
+{
+	char *sentence = msg;
+
+	// hold on to the current dictionary until we're done with it
+	epochEnter();
+	dictionary base = atomic_load( &dict );
+	dictionary d = base;
+	char *nl = memchr( msg, '\n', len );
+	if( nl != NULL )
+	{
+		*nl = '\0';
+		sentence = nl+1;
+		char *save;
+		for( char *w = strtok_r( msg, " ", &save ); w != NULL;
+		     w = strtok_r( NULL, " ", &save ) )
+		{
+			if( d == base ) d = dictOverlay( base );
+			alllower( w );
+			dictInclude( d, w );
+		}
+		if( d != base ) dictAutomaton( d );
+	}
+	int n = len - (sentence - msg);
+
+	if( n+1 > b->maxlen )
+	{
+		b->maxlen = n+1;
+		b->spans = (segspan *) realloc( b->spans, b->maxlen*sizeof(segspan) );
+		b->wordlen = (int *) realloc( b->wordlen, b->maxlen*sizeof(int) );
+		assert( b->spans != NULL && b->wordlen != NULL );
+	}
+	int nwords = segmentSpans( d, sentence, n, obj, b->sc, b->spans );
+	for( int i = 0; i < nwords; i++ )
+	{
+		b->wordlen[i] = b->spans[i].len;
+	}
+	if( d != base ) dictFree( d );
+	epochExit();
+
+	rewind( b->res );
+	batchWrite( b->res, sentence, n, nwords, b->wordlen );
+	fflush( b->res );
+	return ftell( b->res );
+}
+
+
+/*
+ * A connection's thread: handle each request on connection <fd> in
+ * turn, until the client closes it (or goes away).
+ */
+void *serve( void *arg )
+{
+	int fd = (intptr_t) arg;
+	protoconn c = protoCreate( fd );
+	connbufs b = { segScratchCreate(), NULL, NULL, 0, NULL, NULL, 0 };
+	b.res = open_memstream( &b.resbuf, &b.ressize );
+	assert( b.res != NULL );
+
+	char *msg;
+	int len;
+	while( (msg = protoRecv( c, &len )) != NULL )
+	{
+		int reslen = handle( msg, len, &b );
+		protoSend( c, b.resbuf, reslen );
+	}
+	(void) protoFlush( c );
+
+	protoFree( c );
+	close( fd );
+	fclose( b.res );
+	free( (void *) b.resbuf );
+	segScratchFree( b.sc );
+	free( (void *) b.spans );
+	free( (void *) b.wordlen );
+	return NULL;
+}
+
+
+/*
+ * Free a retired dictionary, for epochRetire()
+ */
+void freedict( void *p )
+{
+	dictFree( (dictionary) p );
+}
+
+
+/*
+ * The reloader thread: each time we're sent a SIGHUP (which every
+ * other thread has blocked), read the dictionary again and swap it in,
+ * then wait until no request is still using the old one, and free it.
+ */
+void *reloader( void *arg )
+{
+	sigset_t hup;
+	sigemptyset( &hup );
+	sigaddset( &hup, SIGHUP );
+	for(;;)
+	{
+		int sig;
+		if( sigwait( &hup, &sig ) != 0 ) continue;
+
+		// readdict() dies if it can't read the file: keep serving
+		if( access( wordlistfile, R_OK ) != 0 )
+		{
+			fprintf( stderr, "segd: can't read %s, keeping the old dictionary\n",
+				wordlistfile );
+			continue;
+		}
+		dictionary new = readdict( wordlistfile, backend );
+		dictionary old = atomic_exchange( &dict, new );
+		epochRetire( (void *) old, &freedict );
+		epochSynchronize();
+		fprintf( stderr, "segd: reloaded %s\n", wordlistfile );
+	}
+	return NULL;
+}
+
+
+/*
+ * Signal handler: remove our socket, and go.
+ */
+void quit( int sig )
+{
+	unlink( socketpath );
+	_exit(0);
+}
+
+
+char *usage =
+	"segd [-H|-P] [-f|-p] (''|wordlistfile) socketpath\n"
+	"	-H: probe a hash set with each prefix, rather than walking a trie\n"
+	"	-P: likewise, but a static minimal perfect hash of the word list\n"
+	"	-f: find the breakdown with the fewest words, not longest first\n"
+	"	-p: find the most probable breakdown, given word frequencies\n"
+	"	    (an optional second column in wordlistfile; not with -H)";
+
+int main( int argc, char **argv )
+{
+	int opt;
+	while( (opt = getopt( argc, argv, "+HPfp" )) != -1 )
+	{
+		if( opt == 'H' )
+		{
+			backend = DictSet;
+		} else if( opt == 'P' )
+		{
+			backend = DictPerfect;
+		} else if( opt == 'f' )
+		{
+			obj = SegFewestWords;
+		} else if( opt == 'p' )
+		{
+			obj = SegMostProbable;
+		} else
+		{
+			fprintf( stderr, "%s\n", usage );
+			exit(1);
+		}
+	}
+	argc -= optind-1;
+	argv += optind-1;
+
+	// a hash set has nowhere to keep word frequencies
+	if( argc != 3 || (obj == SegMostProbable && backend == DictSet) )
+	{
+		fprintf( stderr, "%s\n", usage );
+		exit(1);
+	}
+
+	// if wordlistfile is an empty string, use above default
+	if( strlen(argv[1]) > 0 )
+	{
+		strcpy( wordlistfile, argv[1] );
+	}
+	socketpath = argv[2];
+
+	atomic_init( &dict, readdict( wordlistfile, backend ) );
+
+	int lfd = protoListen( socketpath );
+	if( lfd == -1 )
+	{
+		fprintf( stderr, "segd: can't listen on %s: %s\n",
+			socketpath, strerror( errno ) );
+		exit(1);
+	}
+	signal( SIGINT, &quit );
+	signal( SIGTERM, &quit );
+
+	// only the reloader thread takes SIGHUPs: block them here, before
+	// we start any threads, so they all inherit that
+	sigset_t hup;
+	sigemptyset( &hup );
+	sigaddset( &hup, SIGHUP );
+	pthread_sigmask( SIG_BLOCK, &hup, NULL );
+	pthread_t rt;
+	pthread_create( &rt, NULL, &reloader, NULL );
+	fprintf( stderr, "segd: listening on %s\n", socketpath );
+
+	pthread_attr_t attr;
+	pthread_attr_init( &attr );
+	pthread_attr_setdetachstate( &attr, PTHREAD_CREATE_DETACHED );
+	for(;;)
+	{
+		int fd = accept( lfd, NULL, NULL );
+		if( fd == -1 )
+		{
+			if( errno != EINTR ) perror( "segd: accept" );
+			continue;
+		}
+		pthread_t t;
+		if( pthread_create( &t, &attr, &serve, (void *) (intptr_t) fd ) != 0 )
+		{
+			fprintf( stderr, "segd: can't create a thread\n" );
+			close( fd );
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,326 @@
+/*
+ *	segload: load generator for the sentence splitting daemon (segd):
+ *		 open <conns> connections to it at once, and send <n>
+ *		 requests down each, sentences taken in turn from a file
+ *		 (each connection starting at a different place in it),
+ *		 keeping up to <depth> requests in flight per connection.
+ *		 Then report the throughput (requests and MB of sentences
+ *		 per second) and the latency of each request, from sending
+ *		 it to receiving its response (mean, median, 90th and 99th
+ *		 percentiles, and worst).
+ *
+ *		 Each connection has a sender thread and a receiver
+ *		 thread: the sender waits for a free slot in the window
+ *		 of <depth> requests (writing out what it's sent so far
+ *		 first), and the receiver frees one with each response.
+ *		 So depth 1 measures pure round trip latency, and larger
+ *		 depths measure pipelined throughput.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/socket.h>
+#include <assert.h>
+
+#include "proto.h"
+
+
+// how long we keep trying to connect, for a daemon that's starting up
+#define CONNECTTRIES	50
+#define CONNECTWAIT	100000			/* microseconds between tries */
+
+
+// the sentences we send
+char **sentence;
+int *sentlen;
+int nsentences;
+
+// the extra words in every request
+char *extra = "";
+
+// one connection, and its results
+typedef struct {
+	int		id;
+	int		fd;
+	long		n;			/* requests to send */
+	sem_t		window;			/* free slots in flight */
+	double *	sent;			/* when each request was sent */
+	double *	latency;		/* how long each one took */
+	long		nreceived;		/* responses received.. */
+	long		nok;			/* ..of which ok */
+	long		bytes;			/* sentence bytes sent */
+} conn;
+
+
+/*
+ * double t = now();
+ *	Return the current (monotonic) time in seconds.
+ */
+double now( void )
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+
+/*
+ * readsentences( filename );
+ *	Read all the lines of <filename> into sentence[0..nsentences-1],
+ *	without their line endings, or die.
+ */
+void readsentences( char *filename )
+{
+	FILE *in = fopen( filename, "r" );
+	if( in == NULL )
+	{
+		fprintf( stderr, "segload: can't open %s\n", filename );
+		exit(1);
+	}
+	int max = 1024;
+	sentence = (char **) malloc( max*sizeof(char *) );
+	sentlen = (int *) malloc( max*sizeof(int) );
+	assert( sentence != NULL && sentlen != NULL );
+	nsentences = 0;
+
+	char *line = NULL;
+	size_t linesize = 0;
+	ssize_t n;
+	while( (n = getline( &line, &linesize, in )) != -1 )
+	{
+		if( n > 0 && line[n-1] == '\n' ) n--;
+		if( n > 0 && line[n-1] == '\r' ) n--;
+		if( nsentences == max )
+		{
+			max *= 2;
+			sentence = (char **) realloc( sentence, max*sizeof(char *) );
+			sentlen = (int *) realloc( sentlen, max*sizeof(int) );
+			assert( sentence != NULL && sentlen != NULL );
+		}
+		sentence[nsentences] = strndup( line, n );
+		assert( sentence[nsentences] != NULL );
+		sentlen[nsentences++] = n;
+	}
+	free( (void *) line );
+	fclose( in );
+	if( nsentences == 0 )
+	{
+		fprintf( stderr, "segload: no sentences in %s\n", filename );
+		exit(1);
+	}
+}
+
+
+/*
+ * The sender thread: send connection c's requests, never more than
+ * depth (the window's initial size) of them unanswered.
+ */
+void *sender( void *arg )
+{
+	conn *c = (conn *) arg;
+	protoconn pc = protoCreate( c->fd );
+	int extralen = strlen( extra );
+	char *req = NULL;
+	int reqsize = 0;
+	c->bytes = 0;
+	for( long i = 0; i < c->n; i++ )
+	{
+		// wait for a free slot; if there isn't one now, the
+		// daemon must see what we've sent so far before there is
+		if( sem_trywait( &c->window ) == -1 )
+		{
+			if( ! protoFlush( pc ) ) break;
+			while( sem_wait( &c->window ) == -1 && errno == EINTR )
+			{
+			}
+		}
+
+		int s = (c->id * 7919 + i) % nsentences;
+		int len = extralen+1+sentlen[s];
+		if( len > reqsize )
+		{
+			reqsize = len;
+			req = (char *) realloc( req, reqsize );
+			assert( req != NULL );
+		}
+		memcpy( req, extra, extralen );
+		req[extralen] = '\n';
+		memcpy( req+extralen+1, sentence[s], sentlen[s] );
+		c->sent[i] = now();
+		protoSend( pc, req, len );
+		c->bytes += sentlen[s];
+	}
+	(void) protoFlush( pc );
+	shutdown( c->fd, SHUT_WR );
+	protoFree( pc );
+	free( (void *) req );
+	return NULL;
+}
+
+
+/*
+ * A connection's thread: start its sender, and receive the
+ * responses, timing each one.
+ */
+void *receiver( void *arg )
+{
+	conn *c = (conn *) arg;
+	pthread_t t;
+	pthread_create( &t, NULL, &sender, c );
+
+	protoconn pc = protoCreate( c->fd );
+	char *msg;
+	int len;
+	c->nreceived = c->nok = 0;
+	while( c->nreceived < c->n && (msg = protoRecv( pc, &len )) != NULL )
+	{
+		c->latency[c->nreceived] = now() - c->sent[c->nreceived];
+		if( strncmp( msg, "ok\t", 3 ) == 0 ) c->nok++;
+		c->nreceived++;
+		sem_post( &c->window );
+	}
+	pthread_join( t, NULL );
+	protoFree( pc );
+	close( c->fd );
+	return NULL;
+}
+
+
+/*
+ * Compare two doubles, for qsort()
+ */
+int cmpdouble( const void *a, const void *b )
+{
+	double x = *(double *)a;
+	double y = *(double *)b;
+	return x < y ? -1 : x > y;
+}
+
+
+char *usage =
+	"segload [-c conns] [-n requests] [-d depth] [-w 'extra words'] socketpath sentencefile\n"
+	"	-c: number of connections at once (default 4)\n"
+	"	-n: requests per connection (default 10000)\n"
+	"	-d: max requests in flight per connection (default 16)\n"
+	"	-w: extra words to send with every request";
+
+int main( int argc, char **argv )
+{
+	int nconns = 4;
+	long n = 10000;
+	int depth = 16;
+	int opt;
+	while( (opt = getopt( argc, argv, "+c:n:d:w:" )) != -1 )
+	{
+		if( opt == 'c' )
+		{
+			nconns = atoi( optarg );
+		} else if( opt == 'n' )
+		{
+			n = atol( optarg );
+		} else if( opt == 'd' )
+		{
+			depth = atoi( optarg );
+		} else if( opt == 'w' )
+		{
+			extra = optarg;
+		} else
+		{
+			fprintf( stderr, "%s\n", usage );
+			exit(1);
+		}
+	}
+	argc -= optind-1;
+	argv += optind-1;
+	if( argc != 3 || nconns < 1 || n < 1 || depth < 1 ||
+	    strchr( extra, '\n' ) != NULL )
+	{
+		fprintf( stderr, "%s\n", usage );
+		exit(1);
+	}
+	readsentences( argv[2] );
+
+	// connect them all first (waiting a while for segd to start)
+	conn *c = (conn *) calloc( nconns, sizeof(conn) );
+	assert( c != NULL );
+	for( int i = 0; i < nconns; i++ )
+	{
+		c[i].id = i;
+		c[i].n = n;
+		sem_init( &c[i].window, 0, depth );
+		c[i].sent = (double *) malloc( n*sizeof(double) );
+		c[i].latency = (double *) malloc( n*sizeof(double) );
+		assert( c[i].sent != NULL && c[i].latency != NULL );
+		c[i].fd = protoConnect( argv[1] );
+		for( int try = 1; c[i].fd == -1 && try < CONNECTTRIES; try++ )
+		{
+			usleep( CONNECTWAIT );
+			c[i].fd = protoConnect( argv[1] );
+		}
+		if( c[i].fd == -1 )
+		{
+			fprintf( stderr, "segload: can't connect to %s: %s\n",
+				argv[1], strerror( errno ) );
+			exit(1);
+		}
+	}
+
+	pthread_t t[nconns];
+	double start = now();
+	for( int i = 0; i < nconns; i++ )
+	{
+		pthread_create( &t[i], NULL, &receiver, &c[i] );
+	}
+	for( int i = 0; i < nconns; i++ )
+	{
+		pthread_join( t[i], NULL );
+	}
+	double secs = now() - start;
+
+	// gather all the latencies together
+	long total = 0, nok = 0, bytes = 0;
+	double *lat = (double *) malloc( nconns*n*sizeof(double) );
+	assert( lat != NULL );
+	for( int i = 0; i < nconns; i++ )
+	{
+		memcpy( lat+total, c[i].latency, c[i].nreceived*sizeof(double) );
+		total += c[i].nreceived;
+		nok += c[i].nok;
+		bytes += c[i].bytes;
+	}
+	qsort( lat, total, sizeof(double), &cmpdouble );
+	double sum = 0;
+	for( long i = 0; i < total; i++ )
+	{
+		sum += lat[i];
+	}
+
+	printf( "%d connections, depth %d: %ld requests (%ld ok, %ld failed)",
+		nconns, depth, total, nok, total-nok );
+	if( total < nconns*n ) printf( ", %ld lost", nconns*n - total );
+	printf( "\n" );
+	printf( "%.3f secs: %.0f requests/s, %.2f MB/s of sentences\n",
+		secs, total/secs, bytes/secs/1e6 );
+	if( total > 0 )
+	{
+		printf( "latency (us): mean %.1f, p50 %.1f, p90 %.1f, p99 %.1f, max %.1f\n",
+			sum/total*1e6, lat[total/2]*1e6, lat[total*9/10]*1e6,
+			lat[total*99/100]*1e6, lat[total-1]*1e6 );
+	}
+
+	for( int i = 0; i < nconns; i++ )
+	{
+		sem_destroy( &c[i].window );
+		free( (void *) c[i].sent );
+		free( (void *) c[i].latency );
+	}
+	free( (void *) c );
+	free( (void *) lat );
+	return total == nconns*n ? 0 : 1;
+}
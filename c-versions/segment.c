@@ -0,0 +1,256 @@
+/*
+ * segment.c: break a lower-cased sentence with no spaces into a
+ *	      sequence of dictionary words.
+ *
+ *	The obvious recursive search (try the longest prefix word,
+ *	recurse on the rest, backtrack on failure) re-explores the
+ *	same suffixes over and over again when there is no solution,
+ *	eg. "aaaaaaaaaaaaaaaaaaaaaaaaaaaaab" takes exponential time.
+ *	Instead, we run a bottom-up dynamic programme over positions,
+ *	from the end of the sentence backwards, recording for each
+ *	suffix whether it can be broken into words at all (and, if so,
+ *	which first word to pick).  The words starting at each position
+ *	come from the sentence's word lattice (see lattice.c), built in
+ *	one scan, so the worst case is O(n.L) for a sentence of length n
+ *	and a longest word of length L, with no recursion at all.
+ *
+ *	Picking, at each position, the longest prefix word whose suffix
+ *	can be broken up gives exactly the breakdown that the longest
+ *	first depth first search finds, because that search only ever
+ *	backtracks out of a word whose suffix can't be broken up.
+ *
+ *	The most probable breakdown (treating words as independent, so
+ *	the probability of a breakdown is the product of its words'
+ *	probabilities) falls out of the same programme, with words'
+ *	costs (-log probability) added up in place of word counts: it's
+ *	the Viterbi algorithm, on the word lattice.
+ *
+ *	segmentSpans() is the entry point for library use: it takes the
+ *	sentence as it is, in any case, and returns the words as (offset,
+ *	length) spans into it, doing all its work - lower casing, the
+ *	lattice and the programme - in a reusable segscratch, so once that
+ *	has grown to fit, segmenting a sentence allocates no memory at all.
+ *
+ * (C) Duncan C. White, 2017
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <math.h>
+#include <assert.h>
+
+#include "dict.h"
+#include "lattice.h"
+#include "segment.h"
+#include "lower.h"
+#include "stats.h"
+
+
+// a search's working storage, reused from one sentence to the next
+struct segscratch_s {
+	int		max;			/* room for sentences this long */
+	char *		lc_str;			/* lower-cased sentence */
+	int *		first;			/* see solve() */
+	int *		nwords;
+	double *	cost;
+	lattice		lat;
+};
+
+
+/* Private functions */
+
+static void reserve( segscratch, int, seg_objective );
+static int solve( dictionary, char *, int, seg_objective, segscratch );
+
+
+/*
+ * segscratch sc = segScratchCreate();
+ *	Create the (initially empty) working storage for segmentSpans():
+ *	it grows to fit the longest sentence it's used on, so that once
+ *	it has, segmenting allocates nothing.  One per thread.
+ */
+segscratch segScratchCreate( void )
+{
+	segscratch sc = (segscratch) malloc( sizeof(struct segscratch_s) );
+	assert( sc != NULL );
+	sc->max = -1;
+	sc->lc_str = NULL;
+	sc->first = NULL;
+	sc->nwords = NULL;
+	sc->cost = NULL;
+	sc->lat = latticeCreate();
+	return sc;
+}
+
+
+/*
+ * Free the given scratch space
+ */
+void segScratchFree( segscratch sc )
+{
+	free( (void *) sc->lc_str );
+	free( (void *) sc->first );
+	free( (void *) sc->nwords );
+	free( (void *) sc->cost );
+	latticeFree( sc->lat );
+	free( (void *) sc );
+}
+
+
+/*
+ * int nwords = segment( dict, lc_str, n, obj, wordlen[] );
+ *	Given a lower-case string <lc_str> of length <n>, and a dictionary
+ *	<dict>, try to break the string up into an array of word lengths,
+ *	choosing the breakdown according to objective <obj>.  The array of
+ *	word lengths is built up in wordlen[], which must have room for <n>
+ *	entries.  Return the number of words found - or -1 if no breakdown
+ *	is possible.
+ */
+int segment( dictionary dict, char *lc_str, int n, seg_objective obj, int *wordlen )
+{
+	segscratch sc = segScratchCreate();
+	int result = -1;
+	if( solve( dict, lc_str, n, obj, sc ) )
+	{
+		result = 0;
+		for( int i = 0; i < n; i += sc->first[i] )
+		{
+			wordlen[result++] = sc->first[i];
+		}
+	}
+	segScratchFree( sc );
+	return result;
+}
+
+
+/*
+ * int nwords = segmentSpans( dict, sentence, n, obj, sc, spans[] );
+ *	Given a <sentence> of length <n> in any case, and a dictionary
+ *	<dict>, try to break the sentence up into words, choosing the
+ *	breakdown according to objective <obj>, using scratch space <sc>
+ *	(see segScratchCreate()).  Each word is stored in spans[] as its
+ *	offset and length within sentence, which we don't modify or copy;
+ *	spans[] must have room for <n> entries.  Return the number of words
+ *	found - or -1 if no breakdown is possible.
+ *	Callers time the whole call as search (see stats.h), so if
+ *	statsTiming is set we move the time spent lower casing out of
+ *	search and into lower casing.
+ */
+int segmentSpans( dictionary dict, char *sentence, int n, seg_objective obj,
+		  segscratch sc, segspan *spans )
+{
+	reserve( sc, n, obj );
+	double t = statsTiming ? statsNow() : 0;
+	lowercopy( sc->lc_str, sentence, n );
+	sc->lc_str[n] = '\0';
+	if( statsTiming )
+	{
+		t = statsNow() - t;
+		threadstats.phase[PhaseLowercase] += t;
+		threadstats.phase[PhaseSearch] -= t;
+	}
+	if( ! solve( dict, sc->lc_str, n, obj, sc ) ) return -1;
+
+	int nwords = 0;
+	for( int i = 0; i < n; i += sc->first[i] )
+	{
+		spans[nwords].off = i;
+		spans[nwords].len = sc->first[i];
+		nwords++;
+	}
+	return nwords;
+}
+
+
+/*
+ * reserve( sc, n, obj );
+ *	Make sure that scratch space <sc> has room for a search of a
+ *	sentence of length <n> with objective <obj>.
+ */
+static void reserve( segscratch sc, int n, seg_objective obj )
+{
+	if( n > sc->max )
+	{
+		sc->max = n;
+		sc->lc_str = (char *) realloc( sc->lc_str, (n+1)*sizeof(char) );
+		sc->first  = (int *) realloc( sc->first, (n+1)*sizeof(int) );
+		sc->nwords = (int *) realloc( sc->nwords, (n+1)*sizeof(int) );
+		assert( sc->lc_str != NULL && sc->first != NULL && sc->nwords != NULL );
+		if( sc->cost != NULL )
+		{
+			free( (void *) sc->cost );
+			sc->cost = NULL;
+		}
+	}
+	if( obj == SegMostProbable && sc->cost == NULL )
+	{
+		sc->cost = (double *) malloc( (sc->max+1)*sizeof(double) );
+		assert( sc->cost != NULL );
+	}
+}
+
+
+/*
+ * int ok = solve( dict, lc_str, n, obj, sc );
+ *	Run the dynamic programme over lower-case string <lc_str> of length
+ *	<n>, in scratch space <sc>, leaving sc->first[i] the length of the
+ *	first word to pick when breaking up the suffix starting at i (or 0
+ *	if it can't be).  Return whether the whole string can be broken up.
+ */
+static int solve( dictionary dict, char *lc_str, int n, seg_objective obj, segscratch sc )
+{
+	reserve( sc, n, obj );
+
+	// first[i]: length of the first word to pick when breaking up the
+	//	     suffix starting at i, or 0 if that suffix can't be broken.
+	// nwords[i]: number of words in that suffix's breakdown.
+	// cost[i]:   SegMostProbable only: total cost of those words.
+	int *first  = sc->first;
+	int *nwords = sc->nwords;
+	double *cost = obj == SegMostProbable ? sc->cost : NULL;
+	if( cost != NULL ) cost[n] = 0;
+
+	lattice lat = sc->lat;
+	latticeFill( lat, dict, lc_str, n, obj == SegMostProbable );
+	int prefixlen[latticeLongest(lat)+1];
+
+	first[n]  = 0;
+	nwords[n] = 0;
+	for( int i = n-1; i >= 0; i-- )
+	{
+		first[i]  = 0;
+		nwords[i] = INT_MAX;
+		if( cost != NULL ) cost[i] = HUGE_VAL;
+
+		int nprefixes = latticeWords( lat, i, prefixlen );
+		STAT_INC( dppositions );
+
+		// consider prefix words longest first
+		for( int j = nprefixes-1; j >= 0; j-- )
+		{
+			int wlen = prefixlen[j];
+			int rest = i+wlen;
+			STAT_INC( dpwords );
+			if( rest < n && first[rest] == 0 ) continue;
+
+			// lc_str[i..i+wlen-1] is a word, and the rest can
+			// be broken up too..
+			if( obj == SegMostProbable )
+			{
+				double c = latticeCost( lat, i, wlen ) + cost[rest];
+				if( c < cost[i] )
+				{
+					first[i] = wlen;
+					cost[i]  = c;
+				}
+			} else if( nwords[rest]+1 < nwords[i] )
+			{
+				first[i]  = wlen;
+				nwords[i] = nwords[rest]+1;
+			}
+			if( obj == SegLongestFirst ) break;
+		}
+	}
+	return n > 0 && first[0] != 0;
+}
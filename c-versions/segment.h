@@ -0,0 +1,29 @@
+/*
+ * segment.h: break a lower-cased sentence with no spaces into a
+ *	      sequence of dictionary words, in O(n.L) time..
+ *
+ * (C) Duncan C. White, 2017
+ */
+
+// which of the (possibly many) breakdowns do we want?
+//  SegLongestFirst: the one that backtrack's longest-prefix-first
+//		     depth first search would find,
+//  SegFewestWords:  the one with the fewest words (ties broken by
+//		     preferring longer words earlier),
+//  SegMostProbable: the one whose words have the highest product of
+//		     probabilities, given the dictionary's word frequencies.
+typedef enum { SegLongestFirst, SegFewestWords, SegMostProbable } seg_objective;
+
+// a word within a sentence: where it starts, and how long it is
+typedef struct {
+	int		off;
+	int		len;
+} segspan;
+
+// a search's working storage, for segmentSpans() to reuse
+typedef struct segscratch_s *segscratch;
+
+extern int segment( dictionary dict, char *lc_str, int n, seg_objective obj, int *wordlen );
+extern segscratch segScratchCreate( void );
+extern void segScratchFree( segscratch sc );
+extern int segmentSpans( dictionary dict, char *sentence, int n, seg_objective obj, segscratch sc, segspan *spans );
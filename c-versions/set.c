@@ -1,10 +1,65 @@
 /*
  * set.c: "set of strings" storage for C..
- * 	we store a set as a reduced (no values) hash table,
- * 	hashing each set member (key) into a dynamic array of
- * 	binary search trees, and then search/include/exclude
- * 	the key in/from the corresponding search tree.  The
- * 	set also stores a key print function pointer so that
+ * 	we store a set as a reduced (no values) hash table, using
+ * 	open addressing: each set member (key) lives in a slot of a
+ * 	contiguous array, found by linear probing from the slot its
+ * 	hash selects.  Each slot stores the key's full hash (so that
+ * 	almost all non-matching slots are rejected without touching
+ * 	the key) and its length, and short keys - which is nearly all
+ * 	of them - are stored inline in the slot itself, so that a
+ * 	lookup usually costs a single cache miss.
+ *
+ * 	The table is split into NPART partitions, selected by the top
+ * 	bits of the hash, each of which grows (doubles) independently
+ * 	when it becomes too full; so a set of any size stays quick,
+ * 	and each grow step only rehashes a small part of the set.
+ *
+ * 	Longer keys are allocated from a per-set arena: a list of large
+ * 	chunks, carved up in order and never freed individually.  So
+ * 	emptying or freeing a set just releases the slot arrays and a
+ * 	few chunks, without visiting every member.  (The price is that
+ * 	the space for a long key that's excluded and later dropped by
+ * 	a rehash isn't reused until the set is emptied or freed.)
+ *
+ * 	Keys are hashed 8 chars at a time (never reading past a key's
+ * 	last char, which may be anywhere in the caller's buffer): with
+ * 	the SSE4.2 CRC32C instruction if the CPU has it (checked once,
+ * 	when the set is created), otherwise with a multiply and rotate
+ * 	per 8 chars.
+ * 	Hashes are never stored outside the process, so sets built on
+ * 	different machines needn't agree.
+ *
+ * 	Two sets (in one process) always hash a key the same way, so a
+ * 	key always lives in the same partition of either set: the bulk
+ * 	operations (setUnion() etc) therefore work partition by
+ * 	partition, in parallel on large sets, moving keys with their
+ * 	stored hashes - no rehashing and no per-key callbacks.  Each
+ * 	partition counts its members, and the set keeps the total, so
+ * 	setMembers() is O(1).
+ *
+ * 	A set can also be a "layer" over another set, its base (see
+ * 	setLayer()): it starts out with just the base's members, and
+ * 	its own slots record only its differences from the base - keys
+ * 	it includes, and keys of the base it hides.  A lookup checks
+ * 	the layer, then (if the layer says nothing about the key) the
+ * 	base, and so on down; creating, copying or freeing a layer
+ * 	costs time proportional to the layer, not the base.  The base
+ * 	must not change while it has layers, so many layers (eg. one
+ * 	per request, each with its own extra words) can share it.
+ *
+ * 	Finally, a set can be switched into concurrent mode (see
+ * 	setConcurrent()), in which lookups never block while other
+ * 	threads include and exclude keys.  Each partition is then
+ * 	published through an atomic pointer: a writer (one at a time,
+ * 	under the set's lock) copies the partition, changes the copy,
+ * 	and publishes it in place of the original, which it retires
+ * 	(see epoch.c) to be freed once no reader can still be using
+ * 	it.  A reader just loads the pointer - inside an epoch section
+ * 	- and probes as usual.  So an update costs a copy of one
+ * 	partition (1/NPART of the set): fine for adding a few words,
+ * 	while a bulk operation copies each partition just once.
+ *
+ * 	The set also stores a key print function pointer so that
  * 	the set members can be complex data structures printed
  * 	appropriately.  We handle exclusion of a member from
  * 	a set by marking the key as not "in" the set.
@@ -15,51 +70,164 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <assert.h>
 
-#include "set.h"
-
-
-#define	NHASH	32533
+#if defined(__GNUC__) && defined(__x86_64__)
+#define HAVE_X86 1
+#include <immintrin.h>
+#endif
 
+#include "set.h"
+#include "stats.h"
+#include "epoch.h"
+
+
+#define	NPART		256		/* number of partitions */
+#define	PARTBITS	8		/* log2(NPART) */
+#define	MINSLOTS	8		/* initial slots per partition */
+#define	INLINEKEY	24		/* keys shorter than this are inline */
+#define	CHUNKSIZE	65536		/* size of an arena chunk */
+#define	BULKMIN		65536		/* smaller bulk ops aren't threaded */
+
+
+typedef struct slot_s *slot;
+typedef struct part_s *part;
+typedef struct chunk_s *chunk;
+typedef uint64_t (*foldfunc)( uint64_t, uint64_t );
+
+
+struct slot_s {
+	uint32_t	hash;			/* full hash of key */
+	unsigned	len:29;			/* length of key */
+	unsigned	used:1;			/* is slot in use? */
+	unsigned	in:1;			/* is member included? */
+	unsigned	hide:1;			/* layer: excluded from base? */
+	union {
+		char	inl[INLINEKEY];		/* short key, inline */
+		char *	ptr;			/* longer key, in arena */
+	} k;
+};
 
-typedef struct tree_s *tree;
+struct part_s {
+	slot		slots;			/* dynamic array of slots */
+	uint32_t	nslots;			/* size, a power of 2 */
+	uint32_t	nused;			/* number of used slots */
+	uint32_t	nin;			/* how many of them are members */
+};
 
+struct chunk_s {
+	chunk		next;			/* next (older) chunk */
+	size_t		size;			/* bytes in data[] */
+	size_t		used;			/* bytes handed out */
+	char		data[];
+};
 
 struct set_s {
-	tree *		data;			/* dynamic array of trees */
+	struct part_s	part[NPART];		/* the partitions */
+	chunk		arena;			/* chunks for long keys */
+	atomic_long	nmembers;		/* total members, all partitions */
+	foldfunc	fold;			/* hash step, per 8 chars */
+	set		base;			/* layer: the set beneath, or NULL */
+	atomic_int	nlayers;		/* how many layers over this set */
+	_Atomic(part) *	live;			/* concurrent: published partitions */
+	pthread_mutex_t	lock;			/* concurrent: one writer at a time */
 	set_printfunc	p;
 };
 
-struct tree_s {
-	set_key		k;			/* Key, i.e. set member */
-	int		in;			/* is member included? */
-	tree		left;			/* Left... */
-	tree		right;			/* ... and Right trees */
-};
-
 
 /*
  * operation
  */
-typedef enum { Search, Define, Exclude } tree_operation;
+typedef enum { Find, Define, Exclude } slot_operation;
+
+/*
+ * bulk operation, and the work shared by the threads doing one
+ */
+typedef enum { BulkUnion, BulkSubtract, BulkIntersect, BulkDiff } bulk_operation;
+
+typedef struct {
+	set		a, b;			/* the two sets */
+	bulk_operation	op;
+	atomic_int	next;			/* next partition to do */
+} bulkjob;
+
+typedef struct {
+	bulkjob *	job;
+	chunk		arena;			/* this thread's long keys */
+	pthread_t	tid;
+} bulkworker;
+
+/*
+ * the work shared by the threads doing a setIncludeAll(), in phases:
+ * hash the keys and count them per partition, sort them into partition
+ * order, then size each partition and insert its keys
+ */
+typedef enum { IncHash, IncSort, IncInsert } include_phase;
+
+typedef struct {
+	set		s;
+	char **		keys;
+	int *		lens;
+	int		n;
+	uint32_t *	hash;			/* each key's hash */
+	int *		order;			/* keys, by partition */
+	int *		count;			/* [thread][partition] counts.. */
+	int		partstart[NPART+1];	/* ..partition starts in order */
+	include_phase	phase;
+	int		nthreads;
+	atomic_int	next;			/* next partition to insert */
+} includejob;
+
+typedef struct {
+	includejob *	job;
+	int		t;			/* which thread we are */
+	chunk		arena;			/* this thread's long keys */
+	pthread_t	tid;
+} includeworker;
 
 
 /* Private functions */
 
-static void foreach_tree( tree, set_foreachcbfunc, void * );
 static void dump_cb( set_key, void * );
-static void include_cb( set_key, void * );
-static void exclude_cb( set_key, void * );
-static void exclude_if_notin_cb( set_key, void *);
-static void diff_cb( set_key, void *);
-static void count_cb( set_key, void *);
-static tree copy_tree( tree );
-static void free_tree( tree );
-static int depth_tree( tree );
-static tree talloc( set_key );
-static tree tree_op( set, set_key, tree_operation );
-static int shash( char * );
+static void bulk_op( set, set, bulk_operation );
+static void *bulk_worker( void * );
+static void bulk_part( part, part, bulk_operation, chunk * );
+static void bulk_layered( set, set, bulk_operation );
+static void collect_cb( set_key, void * );
+static void include_run( includejob *, includeworker *, include_phase );
+static void *include_worker( void * );
+static int member( set, const char *, int, uint32_t );
+static void layer_op( set, const char *, int, uint32_t, int );
+static part livepart( set, int );
+static int live_member( set, const char *, int, uint32_t );
+static void live_op( set, const char *, int, uint32_t, slot_operation );
+static void live_bulk( set, set, bulk_operation );
+static void free_part( void * );
+static char *slotkey( slot );
+static char *arena_strdup( chunk *, const char *, int );
+static void free_arena( set );
+static void free_slots( part );
+static void copy_part( part, part, set );
+static void grow_part( part );
+static void reserve_part( part, uint32_t );
+static void rehash_part( part, uint32_t );
+static slot slot_op( set, const char *, int, uint32_t, slot_operation );
+static slot part_op( part, chunk *, const char *, int, uint32_t, slot_operation );
+static uint32_t fmix( uint64_t );
+static inline uint64_t loadword( const char *, int );
+static uint32_t shash( set, const char *, int * );
+static uint32_t shashn( set, const char *, int );
+static uint64_t fold_mul( uint64_t, uint64_t );
+#ifdef HAVE_X86
+static uint64_t fold_crc( uint64_t, uint64_t );
+#endif
+
+// the hash step new sets use: NULL means the best this CPU has
+static foldfunc hashfold = NULL;
 
 
 /*
@@ -67,104 +235,221 @@ static int shash( char * );
  */
 set setCreate( set_printfunc p )
 {
-	int   i;
-	set   s;
-
-	s = (set) malloc( sizeof(struct set_s) );
-	s->data = (tree *) malloc( NHASH*sizeof(tree) );
+	set s = (set) calloc( 1, sizeof(struct set_s) );
+	if( s == NULL )
+	{
+		fprintf( stderr, "setCreate: No space left\n" );
+		exit(1);
+	}
 	s->p = p;
-
-	for( i = 0; i < NHASH; i++ )
+	s->fold = hashfold != NULL ? hashfold : fold_mul;
+#ifdef HAVE_X86
+	if( hashfold == NULL && __builtin_cpu_supports( "sse4.2" ) )
 	{
-		s->data[i] = NULL;
+		s->fold = fold_crc;
 	}
+#endif
 	return s;
 }
 
 
+/*
+ * char *name = setHashImpl();
+ *	Return the name of the key hash function that new sets use:
+ *	"crc32c" or "multiply".
+ */
+char *setHashImpl( void )
+{
+#ifdef HAVE_X86
+	if( hashfold == fold_crc ) return "crc32c";
+	if( hashfold == NULL && __builtin_cpu_supports( "sse4.2" ) )
+	{
+		return "crc32c";
+	}
+#endif
+	return "multiply";
+}
+
+
+/*
+ * int ok = setChooseHash( name );
+ *	Make sets created from now on use the key hash function <name>
+ *	("crc32c" or "multiply"), rather than the best this CPU has, so
+ *	that the two can be compared (see setbench); NULL goes back to
+ *	the best this CPU has.  Return 0 if this CPU can't run <name>.  Sets made with different hash functions can't
+ *	be combined (layered, unioned etc), so only call this while there
+ *	are no sets.
+ */
+int setChooseHash( char *name )
+{
+	if( name == NULL )
+	{
+		hashfold = NULL;
+		return 1;
+	}
+	if( strcmp( name, "multiply" ) == 0 )
+	{
+		hashfold = fold_mul;
+		return 1;
+	}
+#ifdef HAVE_X86
+	if( strcmp( name, "crc32c" ) == 0 && __builtin_cpu_supports( "sse4.2" ) )
+	{
+		hashfold = fold_crc;
+		return 1;
+	}
+#endif
+	return 0;
+}
+
+
+/*
+ * set l = setLayer( base );
+ *	Create a new, empty layer over set base: l has all base's members,
+ *	but including or excluding keys in l only changes l.  This takes
+ *	constant time, however big base is.  base must not be changed or
+ *	freed while it has layers (but can have any number of them, made
+ *	and freed by any number of threads at once, and can itself be a
+ *	layer).
+ */
+set setLayer( set base )
+{
+	assert( base->live == NULL );
+	set l = setCreate( base->p );
+	assert( l->fold == base->fold );
+	l->base = base;
+	l->nmembers = base->nmembers;
+	base->nlayers++;
+	return l;
+}
+
+
 /*
  * Empty an existing set - ie. retain only the skeleton..
+ * (emptying a layer discards all its changes, leaving just the
+ * members of its base)
  */
 void setEmpty( set s )
 {
 	int   i;
 
-	for( i = 0; i < NHASH; i++ )
+	assert( s->nlayers == 0 && s->live == NULL );
+	for( i = 0; i < NPART; i++ )
 	{
-		if( s->data[i] != NULL )
-		{
-			free_tree( s->data[i] );
-			s->data[i] = NULL;
-		}
+		free_slots( &(s->part[i]) );
 	}
+	free_arena( s );
+	s->nmembers = s->base != NULL ? s->base->nmembers : 0;
 }
 
 
 /*
  * Copy an existing set.
+ * (a copy of a layer is another layer over the same base, so only
+ * the layer itself is copied; a copy of a concurrent set is an
+ * ordinary set, a snapshot of it between two updates)
  */
 set setCopy( set s )
 {
 	int   i;
-	set   result;
-
-	result = (set) malloc( sizeof(struct set_s) );
-	result->data = (tree *) malloc( NHASH*sizeof(tree) );
-	result->p = s->p;
+	set   result = s->base != NULL ? setLayer( s->base ) : setCreate( s->p );
 
-	for( i = 0; i < NHASH; i++ )
+	if( s->live != NULL ) pthread_mutex_lock( &s->lock );
+	for( i = 0; i < NPART; i++ )
 	{
-		result->data[i] = copy_tree( s->data[i] );
+		// only bother looking for long keys if s has any..
+		copy_part( livepart( s, i ), &(result->part[i]),
+			   s->arena != NULL ? result : NULL );
 	}
+	result->nmembers = s->nmembers;
+	if( s->live != NULL ) pthread_mutex_unlock( &s->lock );
 
 	return result;
 }
 
 
+/*
+ * setConcurrent( s );
+ *	Switch set s into concurrent mode, for good: from now on, any
+ *	number of threads may look keys up (setIn(), setInN(), setPrefix*,
+ *	setForeach()) without ever blocking, while others setInclude(),
+ *	setExclude() or setUnion() etc into it.  Each lookup sees each
+ *	partition either before or after any update.  Lookups enter an
+ *	epoch section (see epoch.h) themselves, but a caller doing many
+ *	can enter one around them all, to save time.  s can't be, or
+ *	have, a layer.  Old partitions are freed as readers move on, but
+ *	setFree( s ) must wait until no thread is using s at all.
+ */
+void setConcurrent( set s )
+{
+	assert( s->base == NULL && s->nlayers == 0 && s->live == NULL );
+	s->live = (_Atomic(part) *) malloc( NPART*sizeof(_Atomic(part)) );
+	assert( s->live != NULL );
+	for( int i = 0; i < NPART; i++ )
+	{
+		part pt = (part) malloc( sizeof(struct part_s) );
+		assert( pt != NULL );
+		*pt = s->part[i];
+		memset( &(s->part[i]), 0, sizeof(struct part_s) );
+		atomic_init( &(s->live[i]), pt );
+	}
+	pthread_mutex_init( &s->lock, NULL );
+}
+
+
 /*
  * Free the given set - clean it up and delete it's skeleton too..
  */
 void setFree( set s )
 {
-	int   i;
-
-	for( i = 0; i < NHASH; i++ )
+	if( s->live != NULL )
 	{
-		if( s->data[i] != NULL )
+		for( int i = 0; i < NPART; i++ )
 		{
-			free_tree( s->data[i] );
+			free_part( atomic_load( &(s->live[i]) ) );
 		}
+		free( (void *) s->live );
+		s->live = NULL;
+		pthread_mutex_destroy( &s->lock );
 	}
-	free( (void *) s->data );
+	setEmpty( s );
+	if( s->base != NULL ) s->base->nlayers--;
 	free( (void *) s );
 }
 
 
 /*
  * Set metrics:
- *  calculate the min, max and average depth of all non-empty trees
- *  sadly can't do this with a setForeach unless the depth is magically
- *  passed into the callback..
+ *  calculate the min, max and average probe length (the number of
+ *  slots examined to find a member, 1 meaning "found in it's home
+ *  slot") over all members of the set.
  */
 void setMetrics( set s, int *min, int *max, double *avg )
 {
 	int	i;
-	int	nonempty = 0;
-	int	total    = 0;
+	long	nmembers = 0;
+	long	total    = 0;
 
 	*min =  100000000;
 	*max = -100000000;
-	for( i = 0; i < NHASH; i++ ) {
-		if( s->data[i] != NULL )
+	if( s->live != NULL ) epochEnter();
+	for( i = 0; i < NPART; i++ )
+	{
+		part pt = livepart( s, i );
+		for( uint32_t j = 0; j < pt->nslots; j++ )
 		{
-			int d = depth_tree( s->data[i] );
+			slot sl = pt->slots + j;
+			if( ! sl->used || ! sl->in ) continue;
+			uint32_t home = sl->hash & (pt->nslots-1);
+			int d = 1 + ((j - home) & (pt->nslots-1));
 			if( d < *min ) *min = d;
 			if( d > *max ) *max = d;
 			total += d;
-			nonempty++;
+			nmembers++;
 		}
 	}
-	*avg = ((double)total)/(double)nonempty;
+	if( s->live != NULL ) epochExit();
+	*avg = ((double)total)/(double)nmembers;
 }
 
 
@@ -173,7 +458,115 @@ void setMetrics( set s, int *min, int *max, double *avg )
  */
 void setInclude( set s, set_key item )
 {
-	(void) tree_op( s, item, Define);
+	int len;
+	assert( s->nlayers == 0 );
+	uint32_t h = shash( s, item, &len );
+	if( s->live != NULL )
+	{
+		live_op( s, item, len, h, Define );
+	} else if( s->base != NULL )
+	{
+		layer_op( s, item, len, h, 1 );
+	} else
+	{
+		(void) slot_op( s, item, len, h, Define );
+	}
+}
+
+
+/*
+ * setIncludeAll( s, keys[], lens[], n );
+ *	Include the <n> keys keys[i], of lengths lens[i] (they needn't be
+ *	'\0' terminated), in set s: the same as including each in turn,
+ *	but much faster for many keys.  Threads hash the keys, and sort
+ *	them into partition order, in slices of keys[]; then each
+ *	partition is grown once, to the size it will need, and its keys
+ *	inserted, with the partitions shared out between the threads.
+ */
+void setIncludeAll( set s, char **keys, int *lens, int n )
+{
+	assert( s->nlayers == 0 );
+	if( n < BULKMIN || s->base != NULL || s->live != NULL )
+	{
+		for( int i = 0; i < n; i++ )
+		{
+			uint32_t h = shashn( s, keys[i], lens[i] );
+			if( s->live != NULL )
+			{
+				live_op( s, keys[i], lens[i], h, Define );
+			} else if( s->base != NULL )
+			{
+				layer_op( s, keys[i], lens[i], h, 1 );
+			} else
+			{
+				(void) slot_op( s, keys[i], lens[i], h, Define );
+			}
+		}
+		return;
+	}
+
+	int nthreads = sysconf( _SC_NPROCESSORS_ONLN );
+	if( nthreads > NPART ) nthreads = NPART;
+	if( nthreads < 1 ) nthreads = 1;
+
+	includejob job;
+	job.s = s;
+	job.keys = keys;
+	job.lens = lens;
+	job.n = n;
+	job.hash = (uint32_t *) malloc( n*sizeof(uint32_t) );
+	job.order = (int *) malloc( n*sizeof(int) );
+	job.count = (int *) calloc( nthreads*NPART, sizeof(int) );
+	assert( job.hash != NULL && job.order != NULL && job.count != NULL );
+	job.nthreads = nthreads;
+	atomic_init( &job.next, 0 );
+
+	includeworker w[nthreads];
+	for( int t = 0; t < nthreads; t++ )
+	{
+		w[t].job = &job;
+		w[t].t = t;
+		w[t].arena = NULL;
+	}
+
+	include_run( &job, w, IncHash );
+
+	// turn the counts into where each thread's keys of each
+	// partition go in order[], partition by partition
+	int at = 0;
+	for( int i = 0; i < NPART; i++ )
+	{
+		job.partstart[i] = at;
+		for( int t = 0; t < nthreads; t++ )
+		{
+			int c = job.count[t*NPART+i];
+			job.count[t*NPART+i] = at;
+			at += c;
+		}
+	}
+	job.partstart[NPART] = at;
+
+	include_run( &job, w, IncSort );
+	include_run( &job, w, IncInsert );
+
+	for( int t = 0; t < nthreads; t++ )
+	{
+		if( w[t].arena != NULL )
+		{
+			chunk c = w[t].arena;
+			while( c->next != NULL ) c = c->next;
+			c->next = s->arena;
+			s->arena = w[t].arena;
+		}
+	}
+	s->nmembers = 0;
+	for( int i = 0; i < NPART; i++ )
+	{
+		s->nmembers += s->part[i].nin;
+	}
+	free( (void *) job.hash );
+	free( (void *) job.order );
+	free( (void *) job.count );
 }
 
 
@@ -182,7 +575,19 @@ void setInclude( set s, set_key item )
  */
 void setExclude( set s, set_key item )
 {
-	(void) tree_op( s, item, Exclude);
+	int len;
+	assert( s->nlayers == 0 );
+	uint32_t h = shash( s, item, &len );
+	if( s->live != NULL )
+	{
+		live_op( s, item, len, h, Exclude );
+	} else if( s->base != NULL )
+	{
+		layer_op( s, item, len, h, 0 );
+	} else
+	{
+		(void) slot_op( s, item, len, h, Exclude );
+	}
 }
 
 
@@ -237,31 +642,122 @@ void setModify( set s, set_key changes )
  */
 int setIn( set s, set_key item )
 {
-	tree x = tree_op(s, item, Search);
+	int len;
+	uint32_t h = shash( s, item, &len );
+	return member( s, item, len, h );
+}
+
+
+/*
+ * int in = setInN( s, str, len );
+ *	Is the <len> char string at <str> (which needn't be '\0' terminated,
+ *	or writable) in set s?
+ */
+int setInN( set s, const char *str, int len )
+{
+	return member( s, str, len, shashn( s, str, len ) );
+}
+
+
+/*
+ * setPrefixStart( s, str, &pp );
+ *	Start probing set s with the prefixes of <str>, shortest first:
+ *	each setPrefixNext( &pp ) extends the prefix by one char, and says
+ *	whether that prefix is in s.  The prefix's hash is extended a char
+ *	at a time too, so probing all prefixes up to length L costs O(L)
+ *	hashing, not O(L^2).  str needn't be '\0' terminated or writable,
+ *	but it's up to the caller not to go past its end.
+ */
+void setPrefixStart( set s, const char *str, set_prefixprobe *pp )
+{
+	pp->s   = s;
+	pp->str = str;
+	pp->len = 0;
+	pp->hh  = 0;
+	pp->w   = 0;
+}
+
 
-	return x != NULL && x->in;
+/*
+ * setPrefixSkip( &pp );
+ *	Extend pp's prefix by one char, as setPrefixNext() does, but
+ *	without looking the new prefix up: for a caller who knows that
+ *	it can't be in the set.
+ */
+void setPrefixSkip( set_prefixprobe *pp )
+{
+	int len = pp->len++;
+	pp->w |= (uint64_t)(unsigned char)pp->str[len] << (8*(len & 7));
+	if( (len & 7) == 7 )
+	{
+		pp->hh = (*pp->s->fold)( pp->hh, pp->w );
+		pp->w = 0;
+	}
+}
+
+
+/*
+ * int in = setPrefixNext( &pp );
+ *	Extend pp's prefix by one char (so pp.len is now it's length),
+ *	and return whether it's in the set.  The hash is the same as
+ *	shashn()'s: whole 8 char words are folded into pp.hh, and the
+ *	partial word pp.w (if any) is folded into a copy.
+ */
+int setPrefixNext( set_prefixprobe *pp )
+{
+	set s = pp->s;
+	int len = pp->len++;
+	pp->w |= (uint64_t)(unsigned char)pp->str[len] << (8*(len & 7));
+	uint64_t hh;
+	if( (len & 7) == 7 )
+	{
+		hh = pp->hh = (*s->fold)( pp->hh, pp->w );
+		pp->w = 0;
+	} else
+	{
+		hh = (*s->fold)( pp->hh, pp->w );
+	}
+	uint32_t h = fmix( hh ^ (len+1) );
+	return member( s, pp->str, len+1, h );
 }
 
 
 /*
  * perform a foreach operation over a given set
  * call a given callback for each item pair.
+ * For a layer: first the layer's own members, then the members of
+ * each set beneath that no layer above it says anything about.
  */
 void setForeach( set s, set_foreachcbfunc cb, void * arg )
 {
 	int	i;
 
-	for( i = 0; i < NHASH; i++ ) {
-		if( s->data[i] != NULL )
+	assert( cb != NULL );
+	if( s->live != NULL ) epochEnter();
+	for( set l = s; l != NULL; l = l->base )
+	{
+		for( i = 0; i < NPART; i++ )
 		{
-			foreach_tree( s->data[i], cb, arg );
+			part pt = livepart( l, i );
+			for( uint32_t j = 0; j < pt->nslots; j++ )
+			{
+				slot sl = pt->slots + j;
+				if( ! sl->used || ! sl->in ) continue;
+				int shadowed = 0;
+				for( set u = s; u != l && ! shadowed; u = u->base )
+				{
+					shadowed = part_op( &(u->part[i]), NULL, slotkey(sl),
+						sl->len, sl->hash, Find ) != NULL;
+				}
+				if( ! shadowed ) (*cb)( slotkey(sl), arg );
+			}
 		}
 	}
+	if( s->live != NULL ) epochExit();
 }
 
 
-/* ----------- Higher level operations using setForeach -------------- */
-/* - each using it's own callback, sometimes with a custom structure - */
+/* ------------ setDump: a higher level operation using setForeach ------------ */
 
 
 /*
@@ -294,13 +790,9 @@ void setDump( FILE *out, set s )
  * setUnion: a += b
  *  include each item of b into a
  */
-static void include_cb( set_key k, void *s )
-{
-	setInclude( (set)s, k );
-}
 void setUnion( set a, set b )
 {
-	setForeach( b, &include_cb, (void *)a );
+	if( a != b ) bulk_op( a, b, BulkUnion );
 }
 
 
@@ -308,35 +800,19 @@ void setUnion( set a, set b )
  * Set subtraction, a -= b
  *  exclude each item of b from a
  */
-static void exclude_cb( set_key k, void *s )
-{
-	setExclude( (set)s, k );
-}
 void setSubtraction( set a, set b )
 {
-	setForeach( b, &exclude_cb, (void *)a );
+	bulk_op( a, b, BulkSubtract );
 }
 
 
 /*
  * Set intersection, a = a&b
  *   exclude each member of a FROM a UNLESS in b too
- *   here we need to pass both sets to the callback,
- *   via this "pair of sets" structure:
  */
-typedef struct { set a, b; } setpair;
-static void exclude_if_notin_cb( set_key k, void *arg )
-{
-	setpair *d = (setpair *)arg;
-	if( ! setIn(d->b, k) )
-	{
-		setExclude( d->a, k );
-	}
-}
 void setIntersection( set a, set b )
 {
-	setpair data; data.a = a; data.b = b;
-	setForeach( a, &exclude_if_notin_cb, (void *)&data );
+	bulk_op( a, b, BulkIntersect );
 }
 
 
@@ -346,35 +822,18 @@ void setIntersection( set a, set b )
  *  - a containing elements ONLY in a, and
  *  - b containing elements ONLY in b.
  */
-static void diff_cb( set_key k, void *arg )
-{
-	setpair *d = (setpair *)arg;
-	if( setIn(d->a, k) )
-	{
-		setExclude( d->a, k );
-		setExclude( d->b, k );
-	}
-}
 void setDiff( set a, set b )
 {
-	setpair data; data.a = a; data.b = b;
-	setForeach( b, &diff_cb, (void *)&data );
+	bulk_op( a, b, BulkDiff );
 }
 
 
 /*
  * Set members: how many members in the set?
  */
-static void count_cb( set_key k, void *arg )
-{
-	int *n = (int *)arg;
-	(*n)++;
-}
 int setMembers( set s )
 {
-	int n = 0;
-	setForeach( s, &count_cb, (void *)&n );
-	return n;
+	return s->nmembers;
 }
 
 
@@ -388,143 +847,766 @@ int setIsEmpty( set s )
 }
 
 
-/* -------------------- Binary search tree ops --------------------- */
+/* -------------------- Bulk set operations --------------------- */
 
 /*
- * Allocate a new node in the tree
+ * bulk_op( a, b, op );
+ *	Do bulk operation op on sets a and b, one partition at a time:
+ *	the partitions are independent, so on large sets we share them
+ *	out between one thread per CPU.  Each thread copies any new long
+ *	keys into it's own arena, which we add to a's afterwards.
  */
-static tree talloc( set_key k )
+static void bulk_op( set a, set b, bulk_operation op )
 {
-	tree   p = (tree) malloc(sizeof(struct tree_s));
+	assert( a->fold == b->fold );
+	assert( a->nlayers == 0 && (op != BulkDiff || b->nlayers == 0) );
+	if( a->live != NULL && b->live == NULL && b->base == NULL && op != BulkDiff )
+	{
+		live_bulk( a, b, op );
+		return;
+	}
+	if( a->base != NULL || b->base != NULL || a->live != NULL || b->live != NULL )
+	{
+		bulk_layered( a, b, op );
+		return;
+	}
 
-	if( p == NULL )
+	bulkjob job;
+	job.a = a;
+	job.b = b;
+	job.op = op;
+	atomic_init( &job.next, 0 );
+
+	int nthreads = 1;
+	if( a->nmembers + b->nmembers >= BULKMIN )
 	{
-		fprintf( stderr, "talloc: No space left\n" );
-		exit(1);
+		nthreads = sysconf( _SC_NPROCESSORS_ONLN );
+		if( nthreads > NPART ) nthreads = NPART;
+		if( nthreads < 1 ) nthreads = 1;
+	}
+	bulkworker w[nthreads];
+	for( int t = 0; t < nthreads; t++ )
+	{
+		w[t].job = &job;
+		w[t].arena = NULL;
+	}
+	for( int t = 1; t < nthreads; t++ )
+	{
+		if( pthread_create( &w[t].tid, NULL, &bulk_worker, &w[t] ) != 0 )
+		{
+			fprintf( stderr, "bulk_op: can't create thread\n" );
+			exit(1);
+		}
+	}
+	(void) bulk_worker( &w[0] );		/* we're a worker too */
+
+	for( int t = 0; t < nthreads; t++ )
+	{
+		if( t > 0 ) pthread_join( w[t].tid, NULL );
+		if( w[t].arena != NULL )
+		{
+			chunk c = w[t].arena;
+			while( c->next != NULL ) c = c->next;
+			c->next = a->arena;
+			a->arena = w[t].arena;
+		}
+	}
+
+	// recount the members
+	a->nmembers = b->nmembers = 0;
+	for( int i = 0; i < NPART; i++ )
+	{
+		a->nmembers += a->part[i].nin;
+		b->nmembers += b->part[i].nin;
 	}
-	p->left = p->right = NULL;
-	p->k    = strdup(k);		/* Save key */
-	p->in   = 1;			/* Include it */
-	return p;
 }
 
 
 /*
- * Operate on the Binary Search Tree
- * Search, Define, Exclude.
+ * bulk_worker( w );
+ *	Thread body for bulk_op(): do partitions of w's job until there
+ *	are none left.
  */
-static tree tree_op( set s, set_key k, tree_operation op )
+static void *bulk_worker( void *arg )
 {
-	tree	ptr;
-	tree *	aptr = s->data + shash(k);
+	bulkworker *w = (bulkworker *)arg;
+	bulkjob *job = w->job;
+	int i;
+	while( (i = atomic_fetch_add( &job->next, 1 )) < NPART )
+	{
+		bulk_part( &(job->a->part[i]), &(job->b->part[i]), job->op, &w->arena );
+	}
+	statsMerge();
+	return NULL;
+}
+
 
-	while( (ptr = *aptr) != NULL )
+/*
+ * bulk_part( pa, pb, op, arena );
+ *	Do bulk operation op on partitions pa and pb - partition i of sets
+ *	a and b, for some i - putting any new long keys in <arena>.  Every
+ *	key of b's partition i belongs in a's partition i too, with the
+ *	hash we stored, so we use that.
+ */
+static void bulk_part( part pa, part pb, bulk_operation op, chunk *arena )
+{
+	part walk = op == BulkIntersect ? pa : pb;
+	for( uint32_t j = 0; j < walk->nslots; j++ )
 	{
-		int rc = strcmp(ptr->k, k);
-		if( rc == 0 )
+		slot sl = walk->slots + j;
+		if( ! sl->used || ! sl->in ) continue;
+		slot x;
+		switch( op )
 		{
-			if( op == Define )
+		case BulkUnion:
+			(void) part_op( pa, arena, slotkey(sl), sl->len, sl->hash, Define );
+			break;
+		case BulkSubtract:
+			(void) part_op( pa, NULL, slotkey(sl), sl->len, sl->hash, Exclude );
+			break;
+		case BulkIntersect:
+			x = part_op( pb, NULL, slotkey(sl), sl->len, sl->hash, Find );
+			if( x == NULL || ! x->in )
 			{
-				ptr->in = 1;
-			} else if( op == Exclude )
+				sl->in = 0;
+				pa->nin--;
+			}
+			break;
+		case BulkDiff:
+			x = part_op( pa, NULL, slotkey(sl), sl->len, sl->hash, Find );
+			if( x != NULL && x->in )
 			{
-				ptr->in = 0;
-			} else if( ! ptr->in )
+				x->in = 0;
+				pa->nin--;
+				if( sl->in )		/* unless x is sl: a is b */
+				{
+					sl->in = 0;
+					pb->nin--;
+				}
+			}
+			break;
+		}
+	}
+}
+
+
+/*
+ * include_run( job, w, phase );
+ *	Do the given phase of setIncludeAll() <job>, with all its worker
+ *	threads <w> (of which we're the first).
+ */
+static void include_run( includejob *job, includeworker *w, include_phase phase )
+{
+	job->phase = phase;
+	for( int t = 1; t < job->nthreads; t++ )
+	{
+		if( pthread_create( &w[t].tid, NULL, &include_worker, &w[t] ) != 0 )
+		{
+			fprintf( stderr, "setIncludeAll: can't create thread\n" );
+			exit(1);
+		}
+	}
+	(void) include_worker( &w[0] );
+	for( int t = 1; t < job->nthreads; t++ )
+	{
+		pthread_join( w[t].tid, NULL );
+	}
+}
+
+
+/*
+ * include_worker( w );
+ *	Thread body for setIncludeAll(): do thread w's part of the job's
+ *	current phase.  Hashing and sorting work on the thread's own slice
+ *	of the keys; inserting takes whole partitions, until none are left.
+ */
+static void *include_worker( void *arg )
+{
+	includeworker *w = (includeworker *)arg;
+	includejob *job = w->job;
+	set s = job->s;
+	int from = (long)job->n * w->t / job->nthreads;
+	int to = (long)job->n * (w->t+1) / job->nthreads;
+	int *count = job->count + w->t*NPART;
+	int i;
+	switch( job->phase )
+	{
+	case IncHash:
+		for( i = from; i < to; i++ )
+		{
+			uint32_t h = shashn( s, job->keys[i], job->lens[i] );
+			job->hash[i] = h;
+			count[h >> (32-PARTBITS)]++;
+		}
+		break;
+	case IncSort:
+		for( i = from; i < to; i++ )
+		{
+			job->order[count[job->hash[i] >> (32-PARTBITS)]++] = i;
+		}
+		break;
+	case IncInsert:
+		while( (i = atomic_fetch_add( &job->next, 1 )) < NPART )
+		{
+			part pt = &(s->part[i]);
+			reserve_part( pt, pt->nused + job->partstart[i+1] - job->partstart[i] );
+			for( int j = job->partstart[i]; j < job->partstart[i+1]; j++ )
 			{
-				return NULL;
+				int k = job->order[j];
+				(void) part_op( pt, &w->arena, job->keys[k], job->lens[k],
+						job->hash[k], Define );
 			}
-			return ptr;
 		}
-		if (rc < 0)
+		statsMerge();
+		break;
+	}
+	return NULL;
+}
+
+
+/*
+ * bulk_layered( a, b, op );
+ *	bulk_op() when either set is a layer, whose partitions don't hold
+ *	all of it's members (or is concurrent, when live_bulk() can't
+ *	help): collect the keys to work on (a's for an
+ *	intersection, otherwise b's), then include, exclude and look them
+ *	up one at a time.
+ */
+typedef struct { char **key; int n, max; } keylist;
+static void collect_cb( set_key k, void *arg )
+{
+	keylist *kl = (keylist *)arg;
+	if( kl->n == kl->max )
+	{
+		kl->max = kl->max == 0 ? 64 : 2*kl->max;
+		kl->key = (char **) realloc( kl->key, kl->max*sizeof(char *) );
+		assert( kl->key != NULL );
+	}
+	kl->key[kl->n] = strdup( k );
+	assert( kl->key[kl->n] != NULL );
+	kl->n++;
+}
+static void bulk_layered( set a, set b, bulk_operation op )
+{
+	keylist kl = { NULL, 0, 0 };
+	setForeach( op == BulkIntersect ? a : b, &collect_cb, (void *)&kl );
+	for( int i = 0; i < kl.n; i++ )
+	{
+		char *k = kl.key[i];
+		switch( op )
 		{
-			/* less - left */
-			aptr = &(ptr->left);
-		} else
+		case BulkUnion:
+			setInclude( a, k );
+			break;
+		case BulkSubtract:
+			setExclude( a, k );
+			break;
+		case BulkIntersect:
+			if( ! setIn( b, k ) ) setExclude( a, k );
+			break;
+		case BulkDiff:
+			if( setIn( a, k ) )
+			{
+				setExclude( a, k );
+				setExclude( b, k );
+			}
+			break;
+		}
+		free( (void *) k );
+	}
+	free( (void *) kl.key );
+}
+
+
+/* -------------------- Layer ops --------------------- */
+
+/*
+ * int in = member( s, k, len, h );
+ *	Is the <len> char key k, whose hash is h, a member of set s?  The
+ *	first layer (starting with s itself) that has a slot for k knows:
+ *	the slot says whether k is in, or hidden.
+ */
+static int member( set s, const char *k, int len, uint32_t h )
+{
+	if( s->live != NULL ) return live_member( s, k, len, h );
+	STAT_INC( setlookups );
+	for( ; s != NULL; s = s->base )
+	{
+		slot sl = part_op( &(s->part[h >> (32-PARTBITS)]), NULL, k, len, h, Find );
+		if( sl != NULL )
 		{
-			/* more - right */
-			aptr = &(ptr->right);
+			if( sl->in ) STAT_INC( sethits ); else STAT_INC( setmisses );
+			return sl->in;
 		}
 	}
+	STAT_INC( setmisses );
+	return 0;
+}
 
-	if (op == Define )
+
+/*
+ * layer_op( l, k, len, h, in );
+ *	Include (if <in>) or exclude the <len> char key k, whose hash is
+ *	h, in layer l: l gets a slot for k either way, saying whether k is
+ *	in or hidden, so that the sets beneath are never consulted about
+ *	k again.
+ */
+static void layer_op( set l, const char *k, int len, uint32_t h, int in )
+{
+	int was = member( l, k, len, h );
+	part pt = &(l->part[h >> (32-PARTBITS)]);
+	slot sl = part_op( pt, &l->arena, k, len, h, Define );
+	if( ! in )
 	{
-		return *aptr = talloc(k);	/* Alloc new node */
+		sl->in = 0;
+		pt->nin--;
 	}
+	sl->hide = ! in;
+	l->nmembers += in - was;
+}
 
-	return NULL;				/* not found */
+
+/* -------------------- Concurrent ops --------------------- */
+
+/*
+ * part pt = livepart( s, i );
+ *	Set s's partition i: in concurrent mode, the currently published
+ *	one (which the caller must be in an epoch section to use, or
+ *	hold s's lock).
+ */
+static part livepart( set s, int i )
+{
+	if( s->live == NULL ) return &(s->part[i]);
+	return atomic_load_explicit( &(s->live[i]), memory_order_acquire );
 }
 
 
 /*
- * Copy one tree
+ * int in = live_member( s, k, len, h );
+ *	member() for a concurrent set s: probe the published partition,
+ *	which can't be freed under us while we're in an epoch section.
  */
-static tree copy_tree( tree t )
+static int live_member( set s, const char *k, int len, uint32_t h )
 {
-	tree result = NULL;
-	if( t )
+	STAT_INC( setlookups );
+	epochEnter();
+	part pt = atomic_load_explicit( &(s->live[h >> (32-PARTBITS)]), memory_order_acquire );
+	slot sl = part_op( pt, NULL, k, len, h, Find );
+	int in = sl != NULL && sl->in;
+	epochExit();
+	if( in ) STAT_INC( sethits ); else STAT_INC( setmisses );
+	return in;
+}
+
+
+/*
+ * live_op( s, k, len, h, op );
+ *	Define or Exclude the <len> char key k, whose hash is h, in the
+ *	concurrent set s: copy it's partition, change the copy, publish
+ *	that, and retire the original.  (If k is already in, or out, as
+ *	required, there's nothing to do.)  New long keys go into s's arena
+ *	as usual - readers never look at the arena's chunk list, only at
+ *	keys that published slots point to, and nothing in the arena is
+ *	freed before s is.
+ */
+static void live_op( set s, const char *k, int len, uint32_t h, slot_operation op )
+{
+	int i = h >> (32-PARTBITS);
+	pthread_mutex_lock( &s->lock );
+	part old = atomic_load_explicit( &(s->live[i]), memory_order_relaxed );
+	slot sl = part_op( old, NULL, k, len, h, Find );
+	if( (sl != NULL && sl->in) == (op == Define) )
 	{
-		result = talloc( t->k );
-		result->in    = t->in;
-		result->left  = copy_tree( t->left );
-		result->right = copy_tree( t->right );
+		pthread_mutex_unlock( &s->lock );
+		return;
 	}
+
+	part new = (part) malloc( sizeof(struct part_s) );
+	assert( new != NULL );
+	copy_part( old, new, NULL );
+	(void) part_op( new, &s->arena, k, len, h, op );
+	s->nmembers += (long)new->nin - old->nin;
+	atomic_store_explicit( &(s->live[i]), new, memory_order_release );
+	pthread_mutex_unlock( &s->lock );
+	epochRetire( old, &free_part );
+}
+
+
+/*
+ * live_bulk( a, b, op );
+ *	bulk_op() (not BulkDiff) into the concurrent set a, from the
+ *	ordinary set b: copy each of a's partitions just once, do the
+ *	whole partition's worth of work on the copy, and publish it.
+ *	Readers see each partition change all at once, but may see some
+ *	partitions changed before others are.
+ */
+static void live_bulk( set a, set b, bulk_operation op )
+{
+	pthread_mutex_lock( &a->lock );
+	for( int i = 0; i < NPART; i++ )
+	{
+		part pb = &(b->part[i]);
+		part old = atomic_load_explicit( &(a->live[i]), memory_order_relaxed );
+		if( op == BulkIntersect ? old->nin == 0 : pb->nin == 0 ) continue;
+
+		part new = (part) malloc( sizeof(struct part_s) );
+		assert( new != NULL );
+		copy_part( old, new, NULL );
+		bulk_part( new, pb, op, &a->arena );
+		a->nmembers += (long)new->nin - old->nin;
+		atomic_store_explicit( &(a->live[i]), new, memory_order_release );
+		epochRetire( old, &free_part );
+	}
+	pthread_mutex_unlock( &a->lock );
+}
+
+
+/*
+ * free_part( pt );
+ *	Free a (retired, or no longer shared) partition of a concurrent
+ *	set, and its slots.  Its long keys belong to the set's arena.
+ */
+static void free_part( void *arg )
+{
+	part pt = (part) arg;
+	free( (void *) pt->slots );
+	free( (void *) pt );
+}
+
+
+/* -------------------- Hash table ops --------------------- */
+
+/*
+ * Where is the key stored in this (used) slot?
+ */
+static char *slotkey( slot sl )
+{
+	return sl->len < INLINEKEY ? sl->k.inl : sl->k.ptr;
+}
+
+
+/*
+ * Copy the len char key k (plus a '\0') into the arena whose newest
+ * chunk is *arena, adding a new chunk if that one is full.
+ */
+static char *arena_strdup( chunk *arena, const char *k, int len )
+{
+	chunk c = *arena;
+	if( c == NULL || c->used + len+1 > c->size )
+	{
+		size_t size = len+1 > CHUNKSIZE ? len+1 : CHUNKSIZE;
+		c = (chunk) malloc( sizeof(struct chunk_s) + size );
+		if( c == NULL )
+		{
+			fprintf( stderr, "arena_strdup: No space left\n" );
+			exit(1);
+		}
+		c->next = *arena;
+		c->size = size;
+		c->used = 0;
+		*arena = c;
+	}
+	char *result = c->data + c->used;
+	memcpy( result, k, len );
+	result[len] = '\0';
+	c->used += len+1;
 	return result;
 }
 
 
 /*
- * foreach one tree
+ * Free all chunks of set s's arena
+ */
+static void free_arena( set s )
+{
+	chunk next;
+	for( chunk c = s->arena; c != NULL; c = next )
+	{
+		next = c->next;
+		free( (void *) c );
+	}
+	s->arena = NULL;
+}
+
+
+/*
+ * Free all slots in the partition (the keys live in the arena)
  */
-static void foreach_tree( tree t, set_foreachcbfunc f, void * arg )
+static void free_slots( part pt )
 {
-	assert( f != NULL );
-	if( t )
+	free( (void *) pt->slots );
+	pt->slots  = NULL;
+	pt->nslots = 0;
+	pt->nused  = 0;
+	pt->nin    = 0;
+}
+
+
+/*
+ * Copy partition from into (empty) partition to; if s is not NULL,
+ * copy any long keys into the arena of set s (to's set).
+ */
+static void copy_part( part from, part to, set s )
+{
+	*to = *from;
+	if( from->nslots == 0 ) return;
+
+	to->slots = (slot) malloc( from->nslots*sizeof(struct slot_s) );
+	if( to->slots == NULL )
 	{
-		if( t->left ) foreach_tree( t->left, f, arg );
-		if( t->in ) (*f)( t->k, arg );
-		if( t->right ) foreach_tree( t->right, f, arg );
+		fprintf( stderr, "copy_part: No space left\n" );
+		exit(1);
+	}
+	memcpy( to->slots, from->slots, from->nslots*sizeof(struct slot_s) );
+	if( s == NULL ) return;
+	for( uint32_t j = 0; j < to->nslots; j++ )
+	{
+		slot sl = to->slots + j;
+		if( sl->used && sl->len >= INLINEKEY )
+		{
+			sl->k.ptr = arena_strdup( &s->arena, sl->k.ptr, sl->len );
+		}
 	}
 }
 
 
 /*
- * Free one tree
+ * Grow partition pt (or create it, if it has no slots yet), and
+ * rehash it's members into the new slots - dropping any excluded
+ * keys on the way (except a layer's hidden ones, which it must keep).
+ * We only double the size if the partition is genuinely filling up,
+ * not just full of excluded keys.
  */
-static void free_tree( tree t )
+static void grow_part( part pt )
 {
-	if( t )
+	uint32_t nkeep = 0;
+	for( uint32_t j = 0; j < pt->nslots; j++ )
 	{
-		if( t->left ) free_tree( t->left );
-		if( t->right ) free_tree( t->right );
-		free( (void *) t->k );
-		free( (void *) t );
+		slot sl = pt->slots + j;
+		if( sl->used && (sl->in || sl->hide) ) nkeep++;
 	}
+
+	uint32_t nslots = pt->nslots == 0 ? MINSLOTS : pt->nslots;
+	if( nkeep*2 >= nslots ) nslots *= 2;
+	rehash_part( pt, nslots );
+}
+
+
+/*
+ * reserve_part( pt, n );
+ *	Make partition pt big enough to hold <n> used slots without
+ *	growing: ie. grow it, just once, straight to the size that
+ *	adding keys one at a time would eventually have grown it to.
+ */
+static void reserve_part( part pt, uint32_t n )
+{
+	uint32_t nslots = pt->nslots == 0 ? MINSLOTS : pt->nslots;
+	while( (uint64_t)n*4 > (uint64_t)nslots*3 ) nslots *= 2;
+	if( nslots > pt->nslots ) rehash_part( pt, nslots );
 }
 
 
 /*
- * Compute the depth of a given tree
+ * rehash_part( pt, nslots );
+ *	Rehash partition pt's members (and a layer's hidden keys) into
+ *	<nslots> new slots, dropping any excluded keys.
  */
-#define max(a,b)  ((a)>(b)?(a):(b))
-static int depth_tree( tree t )
+static void rehash_part( part pt, uint32_t nslots )
 {
-	if( t )
+	slot new = (slot) calloc( nslots, sizeof(struct slot_s) );
+	if( new == NULL )
 	{
-		int d2 = depth_tree( t->left );
-		int d3 = depth_tree( t->right );
-		return 1 + max(d2,d3);
+		fprintf( stderr, "rehash_part: No space left\n" );
+		exit(1);
 	}
-	return 0;
+
+	uint32_t nkeep = 0;
+	for( uint32_t j = 0; j < pt->nslots; j++ )
+	{
+		slot sl = pt->slots + j;
+		if( ! sl->used ) continue;
+		if( ! sl->in && ! sl->hide ) continue;
+		uint32_t i = sl->hash & (nslots-1);
+		while( new[i].used ) i = (i+1) & (nslots-1);
+		new[i] = *sl;
+		nkeep++;
+	}
+	free( (void *) pt->slots );
+	pt->slots  = new;
+	pt->nslots = nslots;
+	pt->nused  = nkeep;
 }
 
 
 /*
- * Calculate hash on a string
+ * Operate on the hash table
+ * Find, Define, Exclude, given the key (its first <len> chars), its
+ * length and its hash.  Find returns the key's slot if it has one,
+ * whether or not the key is in.
  */
-static int shash( char *str )
+static slot slot_op( set s, const char *k, int len, uint32_t h, slot_operation op )
 {
-	unsigned char	ch;
-	unsigned int	hh;
-	for (hh = 0; (ch = *str++) != '\0'; hh = hh * 65599 + ch );
-	return hh % NHASH;
+	part		pt  = &(s->part[h >> (32-PARTBITS)]);
+	uint32_t	nin = pt->nin;
+	slot		sl  = part_op( pt, &s->arena, k, len, h, op );
+	s->nmembers += (long)pt->nin - nin;
+	return sl;
 }
+
+
+/*
+ * slot_op() within partition pt, the key's partition, copying a new
+ * long key into the arena whose newest chunk is *arena.
+ */
+static slot part_op( part pt, chunk *arena, const char *k, int len, uint32_t h, slot_operation op )
+{
+	// make sure there's room for a new key, before we probe..
+	if( op == Define && (pt->nused+1)*4 > pt->nslots*3 )
+	{
+		grow_part( pt );
+	}
+	if( pt->nslots == 0 )
+	{
+		return NULL;				/* not found */
+	}
+
+	uint32_t	mask = pt->nslots-1;
+	uint32_t	i;
+	slot		sl;
+	for( i = h & mask; (sl = pt->slots+i)->used; i = (i+1) & mask )
+	{
+		STAT_INC( setprobes );
+		if( sl->hash == h && sl->len == len &&
+		    memcmp( slotkey(sl), k, len ) == 0 )
+		{
+			if( op == Define )
+			{
+				pt->nin += ! sl->in;
+				sl->in = 1;
+			} else if( op == Exclude )
+			{
+				pt->nin -= sl->in;
+				sl->in = 0;
+			}
+			return sl;
+		}
+	}
+
+	if( op == Define )
+	{
+		// sl is the first empty slot: store the key there
+		sl->hash = h;
+		sl->len  = len;
+		sl->used = 1;
+		sl->in   = 1;
+		if( len < INLINEKEY )
+		{
+			memcpy( sl->k.inl, k, len );
+			sl->k.inl[len] = '\0';
+		} else
+		{
+			sl->k.ptr = arena_strdup( arena, k, len );
+		}
+		pt->nused++;
+		pt->nin++;
+		return sl;
+	}
+
+	return NULL;				/* not found */
+}
+
+
+/*
+ * uint32_t h = fmix( hh );
+ *	Mix all 64 bits of <hh> into a 32 bit hash, so that every bit of
+ *	the result (in particular the top bits, which pick the partition)
+ *	depends on every char of the key.
+ */
+static uint32_t fmix( uint64_t hh )
+{
+	hh ^= hh >> 33;
+	hh *= 0xff51afd7ed558ccdULL;
+	hh ^= hh >> 33;
+	hh *= 0xc4ceb9fe1a85ec53ULL;
+	hh ^= hh >> 33;
+	return (uint32_t) hh;
+}
+
+
+/*
+ * uint64_t w = loadword( p, n );
+ *	Load the <n> (1..8) chars at p into w, first char in the lowest
+ *	byte, zero padded.  We read only those n chars, never past the
+ *	end of the key (which may be anywhere in the caller's buffer).
+ */
+static inline uint64_t loadword( const char *p, int n )
+{
+	uint64_t	v = 0;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	memcpy( &v, p, n );
+#else
+	for( int i = 0; i < n; i++ )
+	{
+		v |= (uint64_t)(unsigned char)p[i] << (8*i);
+	}
+#endif
+	return v;
+}
+
+
+/*
+ * Calculate hash on a string, also setting *len to it's length: find
+ * its length first, then hash it as shashn() does.
+ */
+static uint32_t shash( set s, const char *str, int *len )
+{
+	*len = strlen( str );
+	return shashn( s, str, *len );
+}
+
+
+/*
+ * Calculate the same hash as shash() on the <len> char string at str:
+ * we take the key 8 chars at a time (see loadword()), and fold each
+ * word into the hash with the set's fold function.
+ */
+static uint32_t shashn( set s, const char *str, int len )
+{
+	uint64_t	hh = 0;
+	int		i;
+	for( i = 0; i+8 <= len; i += 8 )
+	{
+		hh = (*s->fold)( hh, loadword( str+i, 8 ) );
+	}
+	if( i < len )
+	{
+		hh = (*s->fold)( hh, loadword( str+i, len-i ) );
+	}
+	return fmix( hh ^ len );
+}
+
+
+/*
+ * hh = fold_mul( hh, w );
+ *	Fold the next 8 chars w of a key into hash hh: rotate, xor and
+ *	multiply by a large odd constant.
+ */
+static uint64_t fold_mul( uint64_t hh, uint64_t w )
+{
+	return ((hh << 5 | hh >> 59) ^ w) * 0x9e3779b97f4a7c15ULL;
+}
+
+
+#ifdef HAVE_X86
+
+/*
+ * fold_mul() using the SSE4.2 CRC32C instruction, which folds in all 8
+ * chars at once.
+ */
+__attribute__((target("sse4.2")))
+static uint64_t fold_crc( uint64_t hh, uint64_t w )
+{
+	return _mm_crc32_u64( hh, w );
+}
+
+#endif
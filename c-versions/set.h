@@ -4,21 +4,41 @@
  * (C) Duncan C. White, 1996-2017 although it seems longer:-)
  */
 
+#include <stdio.h>
+#include <stdint.h>
+
 typedef struct set_s *set;
 typedef char *set_key;
 
 typedef void (*set_printfunc)( FILE *, set_key );
 typedef void (*set_foreachcbfunc)( set_key, void * );
 
+// the state of a setPrefixStart()/setPrefixNext() walk: public only so
+// that callers can keep it on the stack
+typedef struct {
+	set		s;			/* the set we're probing */
+	const char *	str;			/* the string whose prefixes.. */
+	int		len;			/* length of current prefix */
+	uint64_t	hh;			/* hash of its whole words */
+	uint64_t	w;			/* its last partial word */
+} set_prefixprobe;
+
 extern set setCreate( set_printfunc p );
 extern void setEmpty( set s );
 extern set setCopy( set s );
+extern set setLayer( set base );
+extern void setConcurrent( set s );
 extern void setFree( set s );
 extern void setMetrics( set s, int * min, int * max, double * avg );
 extern void setInclude( set s, set_key item );
+extern void setIncludeAll( set s, char **keys, int *lens, int n );
 extern void setExclude( set s, set_key item );
 extern void setModify( set s, set_key changes );
 extern int setIn( set s, set_key item );
+extern int setInN( set s, const char *str, int len );
+extern void setPrefixStart( set s, const char *str, set_prefixprobe *pp );
+extern int setPrefixNext( set_prefixprobe *pp );
+extern void setPrefixSkip( set_prefixprobe *pp );
 extern void setForeach( set s, set_foreachcbfunc cb, void * arg );
 extern void setDump( FILE * out, set s );
 extern void setUnion( set a, set b );
@@ -27,3 +47,5 @@ extern void setIntersection( set a, set b );
 extern void setDiff( set a, set b );
 extern int setMembers( set s );
 extern int setIsEmpty( set s );
+extern char *setHashImpl( void );
+extern int setChooseHash( char *name );
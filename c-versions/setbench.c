@@ -0,0 +1,307 @@
+/*
+ *	setbench: measure the two inner loops that every segmenter runs
+ *		  over and over - lower casing text, and looking strings
+ *		  up in a hash set - in isolation, on the real dictionary
+ *		  and a corpus file (see mkcorpus):
+ *
+ *		  case folding: MB/s lower casing the corpus, one char at
+ *				a time and with the vector version this
+ *				CPU uses (see lower.c)
+ *		  set load:	words/s adding every dictionary word to
+ *				an empty set, with each key hash function
+ *				this CPU can run (see set.c)
+ *		  lookups:	lookups/s probing the set with every
+ *				prefix (up to the longest word) of every
+ *				position of the corpus, as the -H
+ *				segmenters do (with setPrefixNext()),
+ *				again with each hash function
+ *		  bulk ops:	keys/s merging (setUnion) and subtracting
+ *				(setSubtraction) sets of half the words
+ *		  mph build:	words/s compiling every dictionary word
+ *				into a static minimal perfect hash (see
+ *				mph.c), and the bits per key it takes
+ *		  mph lookups:	lookups/s making the same probes as
+ *				"lookups", in the perfect hash (with
+ *				mphPrefixNext()), as the -P segmenters do
+ *
+ *		  Each measurement is repeated <reps> times, and the
+ *		  fastest taken.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <assert.h>
+
+#include "set.h"
+#include "mph.h"
+#include "lower.h"
+
+
+/*
+ * double t = now();
+ *	Return the current (monotonic) time in seconds.
+ */
+double now( void )
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+
+/*
+ * char *text = slurp( filename, &size );
+ *	Read all of <filename> into a malloc()d, NUL terminated buffer,
+ *	setting size to its length, or die.
+ */
+char *slurp( char *filename, long *size )
+{
+	FILE *f = fopen( filename, "r" );
+	if( f == NULL )
+	{
+		fprintf( stderr, "setbench: can't open %s\n", filename );
+		exit(1);
+	}
+	fseek( f, 0, SEEK_END );
+	*size = ftell( f );
+	rewind( f );
+	char *text = (char *) malloc( *size+1 );
+	assert( text != NULL );
+	if( fread( text, 1, *size, f ) != *size )
+	{
+		fprintf( stderr, "setbench: can't read %s\n", filename );
+		exit(1);
+	}
+	text[*size] = '\0';
+	fclose( f );
+	return text;
+}
+
+
+/*
+ * int nwords = splitwords( text, words[] );
+ *	Split <text> (a word list) in place into lines, storing the first
+ *	field of each line (the word, not its frequency) in words[], and
+ *	return how many there were.
+ */
+int splitwords( char *text, char **words )
+{
+	int nwords = 0;
+	for( char *p = strtok( text, "\n" ); p != NULL; p = strtok( NULL, "\n" ) )
+	{
+		p[strcspn( p, " \t\r" )] = '\0';
+		if( *p != '\0' ) words[nwords++] = p;
+	}
+	return nwords;
+}
+
+
+/*
+ * long nhits = lookups( s, text, size, longest, &nlookups );
+ *	Probe set <s> with every prefix, of at most <longest> chars and
+ *	not crossing a line break, of every position of <text> (<size>
+ *	chars); set nlookups to the number of probes, and return how many
+ *	of them were members.
+ */
+long lookups( set s, char *text, long size, int longest, long *nlookups )
+{
+	long nhits = 0;
+	*nlookups = 0;
+	for( long pos = 0; pos < size; pos++ )
+	{
+		set_prefixprobe pp;
+		setPrefixStart( s, text+pos, &pp );
+		for( int len = 1; len <= longest && pos+len <= size; len++ )
+		{
+			if( text[pos+len-1] == '\n' ) break;
+			(*nlookups)++;
+			if( setPrefixNext( &pp ) ) nhits++;
+		}
+	}
+	return nhits;
+}
+
+
+/*
+ * long nhits = perfectlookups( m, text, size, longest, &nlookups );
+ *	lookups(), probing the minimal perfect hash <m> instead.
+ */
+long perfectlookups( mph m, char *text, long size, int longest, long *nlookups )
+{
+	long nhits = 0;
+	*nlookups = 0;
+	for( long pos = 0; pos < size; pos++ )
+	{
+		mph_prefixprobe pp;
+		mphPrefixStart( m, text+pos, &pp );
+		for( int len = 1; len <= longest && pos+len <= size; len++ )
+		{
+			if( text[pos+len-1] == '\n' ) break;
+			(*nlookups)++;
+			if( mphPrefixNext( &pp ) != -1 ) nhits++;
+		}
+	}
+	return nhits;
+}
+
+
+char *usage = "setbench [-r reps] wordlistfile corpusfile";
+
+int main( int argc, char **argv )
+{
+	int reps = 3;
+	int opt;
+	while( (opt = getopt( argc, argv, "+r:" )) != -1 )
+	{
+		if( opt == 'r' )
+		{
+			reps = atoi( optarg );
+			if( reps < 1 ) reps = 1;
+		} else
+		{
+			fprintf( stderr, "%s\n", usage );
+			exit(1);
+		}
+	}
+	argc -= optind-1;
+	argv += optind-1;
+	if( argc != 3 )
+	{
+		fprintf( stderr, "%s\n", usage );
+		exit(1);
+	}
+
+	long dictsize, size;
+	char *dicttext = slurp( argv[1], &dictsize );
+	char *text = slurp( argv[2], &size );
+	char *lc = (char *) malloc( size+1 );
+	char **words = (char **) malloc( (dictsize/2+1)*sizeof(char *) );
+	assert( lc != NULL && words != NULL );
+	int nwords = splitwords( dicttext, words );
+	int *lens = (int *) malloc( (nwords+1)*sizeof(int) );
+	assert( lens != NULL );
+	int longest = 0;
+	for( int i = 0; i < nwords; i++ )
+	{
+		alllower( words[i] );
+		lens[i] = strlen( words[i] );
+		if( lens[i] > longest ) longest = lens[i];
+	}
+
+	// case folding, both ways
+	double scalar = 1e9, vector = 1e9;
+	for( int r = 0; r < reps; r++ )
+	{
+		double t = now();
+		lowercopyScalar( lc, text, size );
+		t = now() - t;
+		if( t < scalar ) scalar = t;
+		t = now();
+		lowercopy( lc, text, size );
+		t = now() - t;
+		if( t < vector ) vector = t;
+	}
+	lc[size] = '\0';
+	printf( "%-14s %10.1f MB/s scalar, %10.1f MB/s %s\n", "case folding",
+		size/scalar/1e6, size/vector/1e6, lowerImpl() );
+
+	// load, then lookups, with each hash function this CPU can run
+	char *hashes[] = { "crc32c", "multiply" };
+	double load, look;
+	long nlookups = 0, nhits = 0;
+	for( int h = 0; h < sizeof(hashes)/sizeof(hashes[0]); h++ )
+	{
+		if( ! setChooseHash( hashes[h] ) ) continue;
+		load = look = 1e9;
+		for( int r = 0; r < reps; r++ )
+		{
+			double t = now();
+			set s = setCreate( NULL );
+			for( int i = 0; i < nwords; i++ )
+			{
+				setInclude( s, words[i] );
+			}
+			t = now() - t;
+			if( t < load ) load = t;
+
+			t = now();
+			nhits = lookups( s, lc, size, longest, &nlookups );
+			t = now() - t;
+			if( t < look ) look = t;
+			setFree( s );
+		}
+		printf( "%-14s %10.0f words/s (%d words, %s hash)\n", "set load",
+			nwords/load, nwords, hashes[h] );
+		printf( "%-14s %10.0f lookups/s (%ld lookups, %ld hits, %s hash)\n",
+			"lookups", nlookups/look, nlookups, nhits, hashes[h] );
+	}
+	setChooseHash( NULL );
+
+	// bulk ops: a (the even words) += b (every third word), then
+	// a -= b, each on a fresh copy of a
+	set a = setCreate( NULL );
+	set b = setCreate( NULL );
+	for( int i = 0; i < nwords; i++ )
+	{
+		if( i % 2 == 0 ) setInclude( a, words[i] );
+		if( i % 3 == 0 ) setInclude( b, words[i] );
+	}
+	double uni = 1e9, sub = 1e9;
+	for( int r = 0; r < reps; r++ )
+	{
+		set c = setCopy( a );
+		double t = now();
+		setUnion( c, b );
+		t = now() - t;
+		if( t < uni ) uni = t;
+		setFree( c );
+
+		c = setCopy( a );
+		t = now();
+		setSubtraction( c, b );
+		t = now() - t;
+		if( t < sub ) sub = t;
+		setFree( c );
+	}
+	printf( "%-14s %10.0f keys/s union, %10.0f keys/s subtraction\n",
+		"bulk ops", setMembers( b )/uni, setMembers( b )/sub );
+	setFree( a );
+	setFree( b );
+
+	// the same lookups again, in a minimal perfect hash
+	int *slot = (int *) malloc( (nwords+1)*sizeof(int) );
+	assert( slot != NULL );
+	double build = 1e9;
+	look = 1e9;
+	double bits = 0;
+	for( int r = 0; r < reps; r++ )
+	{
+		double t = now();
+		mph m = mphBuild( words, lens, nwords, slot );
+		t = now() - t;
+		if( t < build ) build = t;
+		bits = mphBitsPerKey( m );
+
+		t = now();
+		nhits = perfectlookups( m, lc, size, longest, &nlookups );
+		t = now() - t;
+		if( t < look ) look = t;
+		mphFree( m );
+	}
+	printf( "%-14s %10.0f words/s (%.1f bits/key)\n", "mph build",
+		nwords/build, bits );
+	printf( "%-14s %10.0f lookups/s (%ld lookups, %ld hits)\n", "mph lookups",
+		nlookups/look, nlookups, nhits );
+
+	free( (void *) slot );
+	free( (void *) lens );
+	free( (void *) words );
+	free( (void *) dicttext );
+	free( (void *) text );
+	free( (void *) lc );
+	return 0;
+}
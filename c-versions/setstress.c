@@ -0,0 +1,353 @@
+/*
+ *	setstress: stress test a concurrent set (see setConcurrent()), and
+ *		   measure what concurrency costs its readers.  The words
+ *		   of a word list are split in two: "base" words, which
+ *		   are always in the set, and "churn" words, which writer
+ *		   threads keep including and excluding.  Reader threads
+ *		   look up random words meanwhile, checking that every
+ *		   base word is always found, and that keys that are never
+ *		   added (base words with a '#' on the end) never are.
+ *		   Each writer owns every nwriters'th churn word, so it
+ *		   knows what it should find after each of its updates,
+ *		   and checks that too.  We report lookups/s for:
+ *
+ *		   plain:	 the set before it's made concurrent
+ *		   idle:	 the concurrent set, with no writers
+ *		   busy:	 the concurrent set, with the writers going
+ *
+ *		   and the writers' updates/s.  Finally we check the set's
+ *		   contents against what the writers did, and exercise
+ *		   bulk operations and snapshots on it.  Any wrong answer
+ *		   is reported, and makes us exit 1.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <assert.h>
+
+#include "set.h"
+#include "epoch.h"
+
+
+// readers enter an epoch section once per this many lookups
+#define BATCH	256
+
+
+char **word;			// all the words: even ones are base words,
+int nwords;			// odd ones churn words
+char **absent;			// absent[i]: base word i, plus '#'
+char *isin;			// isin[i]: is churn word i in? (its writer's)
+
+set s;
+int concurrent;			// has s been made concurrent yet?
+int nwriters;
+
+atomic_int stop;		// time's up
+atomic_long nerrors;		// wrong answers
+
+// what each thread is given, and counts
+typedef struct {
+	int		id;
+	long		nops;			/* lookups or updates done */
+	pthread_t	tid;
+} worker;
+
+
+/*
+ * double t = now();
+ *	Return the current (monotonic) time in seconds.
+ */
+double now( void )
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+
+/*
+ * readwords( filename );
+ *	Read the words (first fields) of word list <filename> into
+ *	word[0..nwords-1], and make the absent[] keys, or die.
+ */
+void readwords( char *filename )
+{
+	FILE *f = fopen( filename, "r" );
+	if( f == NULL )
+	{
+		fprintf( stderr, "setstress: can't open %s\n", filename );
+		exit(1);
+	}
+	int max = 1024;
+	word = (char **) malloc( max*sizeof(char *) );
+	assert( word != NULL );
+	nwords = 0;
+	char *line = NULL;
+	size_t linesize = 0;
+	while( getline( &line, &linesize, f ) != -1 )
+	{
+		line[strcspn( line, " \t\r\n" )] = '\0';
+		if( *line == '\0' ) continue;
+		if( nwords == max )
+		{
+			max *= 2;
+			word = (char **) realloc( word, max*sizeof(char *) );
+			assert( word != NULL );
+		}
+		word[nwords] = strdup( line );
+		assert( word[nwords] != NULL );
+		nwords++;
+	}
+	free( (void *) line );
+	fclose( f );
+	if( nwords < 2 )
+	{
+		fprintf( stderr, "setstress: too few words in %s\n", filename );
+		exit(1);
+	}
+
+	absent = (char **) calloc( nwords, sizeof(char *) );
+	isin = (char *) calloc( nwords, sizeof(char) );
+	assert( absent != NULL && isin != NULL );
+	for( int i = 0; i < nwords; i += 2 )
+	{
+		absent[i] = (char *) malloc( strlen( word[i] )+2 );
+		assert( absent[i] != NULL );
+		sprintf( absent[i], "%s#", word[i] );
+	}
+}
+
+
+/*
+ * error( what, key );
+ *	Report a wrong answer.
+ */
+void error( char *what, char *key )
+{
+	if( atomic_fetch_add( &nerrors, 1 ) < 10 )
+	{
+		fprintf( stderr, "setstress: %s: %s\n", what, key );
+	}
+}
+
+
+/*
+ * A reader thread: look up random words, BATCH at a time (inside one
+ * epoch section, once s is concurrent), until told to stop.
+ */
+void *reader( void *arg )
+{
+	worker *w = (worker *) arg;
+	uint64_t r = 88172645463325252ULL + w->id;
+	w->nops = 0;
+	while( ! atomic_load_explicit( &stop, memory_order_relaxed ) )
+	{
+		if( concurrent ) epochEnter();
+		for( int j = 0; j < BATCH; j++ )
+		{
+			r ^= r >> 12;
+			r ^= r << 25;
+			r ^= r >> 27;
+			int i = (r * 2685821657736338717ULL >> 33) % nwords;
+			if( i % 2 == 1 )
+			{
+				(void) setIn( s, word[i] );	/* could be either */
+			} else if( j % 2 == 0 )
+			{
+				if( ! setIn( s, word[i] ) ) error( "base word missing", word[i] );
+			} else
+			{
+				if( setIn( s, absent[i] ) ) error( "absent word found", absent[i] );
+			}
+		}
+		if( concurrent ) epochExit();
+		w->nops += BATCH;
+	}
+	return NULL;
+}
+
+
+/*
+ * A writer thread: flip each of our churn words in and out in turn,
+ * checking that we see each change ourselves at once.
+ */
+void *writer( void *arg )
+{
+	worker *w = (worker *) arg;
+	w->nops = 0;
+	int i = 1 + 2*w->id;
+	while( ! atomic_load_explicit( &stop, memory_order_relaxed ) )
+	{
+		if( isin[i] )
+		{
+			setExclude( s, word[i] );
+			if( setIn( s, word[i] ) ) error( "excluded word found", word[i] );
+		} else
+		{
+			setInclude( s, word[i] );
+			if( ! setIn( s, word[i] ) ) error( "included word missing", word[i] );
+		}
+		isin[i] = ! isin[i];
+		w->nops++;
+		i += 2*nwriters;
+		if( i >= nwords ) i = 1 + 2*w->id;
+	}
+	return NULL;
+}
+
+
+/*
+ * double rate = run( nreaders, nw, secs, &wrate );
+ *	Run <nreaders> readers and <nw> writers for <secs> seconds, and
+ *	return the readers' total lookups/s (and the writers' total
+ *	updates/s in wrate).
+ */
+double run( int nreaders, int nw, double secs, double *wrate )
+{
+	worker r[nreaders];
+	worker w[nw > 0 ? nw : 1];
+	atomic_store( &stop, 0 );
+	double start = now();
+	for( int i = 0; i < nreaders; i++ )
+	{
+		r[i].id = i;
+		pthread_create( &r[i].tid, NULL, &reader, &r[i] );
+	}
+	for( int i = 0; i < nw; i++ )
+	{
+		w[i].id = i;
+		pthread_create( &w[i].tid, NULL, &writer, &w[i] );
+	}
+	usleep( (useconds_t) (secs*1e6) );
+	atomic_store( &stop, 1 );
+
+	long nlookups = 0, nupdates = 0;
+	for( int i = 0; i < nreaders; i++ )
+	{
+		pthread_join( r[i].tid, NULL );
+		nlookups += r[i].nops;
+	}
+	for( int i = 0; i < nw; i++ )
+	{
+		pthread_join( w[i].tid, NULL );
+		nupdates += w[i].nops;
+	}
+	double elapsed = now() - start;
+	if( wrate != NULL ) *wrate = nupdates / elapsed;
+	return nlookups / elapsed;
+}
+
+
+/*
+ * check();
+ *	With no other threads running: check that s holds exactly the
+ *	base words and the churn words that the writers left in, then
+ *	that bulk operations and snapshots work on it.
+ */
+void check( void )
+{
+	int nexpected = 0;
+	for( int i = 0; i < nwords; i++ )
+	{
+		int want = i % 2 == 0 || isin[i];
+		nexpected += want;
+		if( setIn( s, word[i] ) != want )
+		{
+			error( want ? "word missing at end" : "word found at end", word[i] );
+		}
+	}
+	if( setMembers( s ) != nexpected ) error( "wrong member count", "at end" );
+
+	set snap = setCopy( s );
+	if( setMembers( snap ) != nexpected ) error( "wrong member count", "in snapshot" );
+
+	set churn = setCreate( NULL );
+	for( int i = 1; i < nwords; i += 2 )
+	{
+		setInclude( churn, word[i] );
+	}
+	setUnion( s, churn );
+	if( setMembers( s ) != nwords ) error( "wrong member count", "after union" );
+	setSubtraction( s, churn );
+	if( setMembers( s ) != (nwords+1)/2 ) error( "wrong member count", "after subtraction" );
+	for( int i = 0; i < nwords; i++ )
+	{
+		if( setIn( s, word[i] ) != (i % 2 == 0) ) error( "wrong after bulk ops", word[i] );
+		if( setIn( snap, word[i] ) != (i % 2 == 0 || isin[i]) ) error( "snapshot changed", word[i] );
+	}
+	setFree( churn );
+	setFree( snap );
+}
+
+
+char *usage = "setstress [-r readers] [-w writers] [-s secs] wordlistfile";
+
+int main( int argc, char **argv )
+{
+	int nreaders = 2;
+	double secs = 2;
+	nwriters = 1;
+	int opt;
+	while( (opt = getopt( argc, argv, "+r:w:s:" )) != -1 )
+	{
+		if( opt == 'r' )
+		{
+			nreaders = atoi( optarg );
+		} else if( opt == 'w' )
+		{
+			nwriters = atoi( optarg );
+		} else if( opt == 's' )
+		{
+			secs = atof( optarg );
+		} else
+		{
+			fprintf( stderr, "%s\n", usage );
+			exit(1);
+		}
+	}
+	argc -= optind-1;
+	argv += optind-1;
+	if( argc != 2 || nreaders < 1 || nwriters < 1 || secs <= 0 )
+	{
+		fprintf( stderr, "%s\n", usage );
+		exit(1);
+	}
+	readwords( argv[1] );
+	if( nwriters > nwords/2 ) nwriters = nwords/2;
+
+	s = setCreate( NULL );
+	for( int i = 0; i < nwords; i += 2 )
+	{
+		setInclude( s, word[i] );
+	}
+	printf( "%d words (%d base, %d churn), %d readers, %d writers, %g secs each\n",
+		nwords, (nwords+1)/2, nwords/2, nreaders, nwriters, secs );
+
+	double plain = run( nreaders, 0, secs, NULL );
+	printf( "plain set:      %8.2fM lookups/s\n", plain/1e6 );
+
+	setConcurrent( s );
+	concurrent = 1;
+	double idle = run( nreaders, 0, secs, NULL );
+	printf( "concurrent:     %8.2fM lookups/s (%.1f%% of plain)\n",
+		idle/1e6, 100*idle/plain );
+
+	double wrate;
+	double busy = run( nreaders, nwriters, secs, &wrate );
+	printf( "with writers:   %8.2fM lookups/s (%.1f%% of idle), %.0f updates/s\n",
+		busy/1e6, 100*busy/idle, wrate );
+
+	check();
+	setFree( s );
+	epochSynchronize();
+
+	long n = atomic_load( &nerrors );
+	printf( "%ld errors\n", n );
+	return n == 0 ? 0 : 1;
+}
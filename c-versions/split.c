@@ -0,0 +1,194 @@
+/*
+ * split.c: cut a long sentence into pieces that can be segmented
+ *	    independently, and segment them in parallel.
+ *
+ *	Every char of the sentence must be in some word, so one scan
+ *	with the dictionary's table of the chars its words use (see
+ *	dictUsesChar()) rejects, in O(n), a sentence that has a char
+ *	that no word does (a digit, say, or punctuation).  The same
+ *	scan finds the forced boundaries: if no dictionary word has
+ *	chars c1,c2 next to each other (see dictAdjacent()), then no
+ *	word in any breakdown can span a c1 followed by c2 in the
+ *	sentence, so every breakdown has a word boundary between them.
+ *
+ *	So the pieces between forced boundaries can be broken up on
+ *	their own, and their breakdowns joined together give the
+ *	breakdown of the whole - exactly the one segment() would find,
+ *	for each objective, as the longest-first choice, the word counts
+ *	and the costs at each position only ever depend on what lies
+ *	between it and the next forced boundary.  We group the pieces
+ *	into chunks of at least a target size, and let a few threads
+ *	take chunks in turn, each segmenting them (see segmentSpans())
+ *	straight into the caller's spans[], at the chunk's own offset;
+ *	then stitch the results together in a single pass.
+ *
+ * (C) Duncan C. White, 2017
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <assert.h>
+
+#include "dict.h"
+#include "segment.h"
+#include "split.h"
+#include "stats.h"
+
+
+// no chunk shorter than this is worth a thread's while..
+#define MINCHUNK	4096
+
+// ..and we aim for this many chunks per thread, to even out the load
+#define CHUNKSPERTHREAD	4
+
+// ASCII case folding, as lower.c does
+#define FOLD(c)		((c) >= 'A' && (c) <= 'Z' ? (c)-'A'+'a' : (c))
+
+
+// what the threads segmenting one sentence share
+typedef struct {
+	dictionary	dict;
+	char *		sentence;
+	seg_objective	obj;
+	int *		ends;			/* where each chunk ends */
+	int		nchunks;
+	int *		nwords;			/* each chunk's word count */
+	segspan *	spans;
+	atomic_int	next;			/* the next chunk to do */
+	atomic_int	failed;			/* has some chunk failed? */
+} splitjob;
+
+
+/* Private functions */
+
+static void *worker( void * );
+
+
+/*
+ * int nchunks = splitChunks( dict, sentence, n, target, ends[] );
+ *	Scan the <n> char <sentence> (in any case) once, and cut it into
+ *	chunks at forced word boundaries, each chunk ending at the first
+ *	forced boundary at least <target> chars from its start (or at the
+ *	end of the sentence).  Store the chunk ends in ends[], which must
+ *	have room for n/target+1 entries, and return the number of chunks
+ *	- or -1 if the sentence has a char used by no dictionary word, in
+ *	which case it can't be broken up at all.
+ */
+int splitChunks( dictionary dict, char *sentence, int n, int target, int *ends )
+{
+	unsigned char *s = (unsigned char *) sentence;
+	int nchunks = 0;
+	int start = 0;
+	for( int i = 0; i < n; i++ )
+	{
+		int c = FOLD(s[i]);
+		if( ! dictUsesChar( dict, c ) ) return -1;
+		if( i - start >= target && ! dictAdjacent( dict, FOLD(s[i-1]), c ) )
+		{
+			ends[nchunks++] = i;
+			start = i;
+		}
+	}
+	if( n > 0 ) ends[nchunks++] = n;
+	return nchunks;
+}
+
+
+/*
+ * int nwords = splitSegment( dict, sentence, n, obj, nthreads, spans[] );
+ *	Break the <n> char <sentence> (in any case) up into words, just as
+ *	segmentSpans() would, storing them in spans[] (which must have room
+ *	for <n> entries), but cut into chunks at forced word boundaries,
+ *	segmented by up to <nthreads> threads at once.  Return the number
+ *	of words found - or -1 if no breakdown is possible.
+ */
+int splitSegment( dictionary dict, char *sentence, int n, seg_objective obj,
+		  int nthreads, segspan *spans )
+{
+	if( nthreads < 1 ) nthreads = 1;
+	int target = n / (nthreads*CHUNKSPERTHREAD);
+	if( target < MINCHUNK ) target = MINCHUNK;
+	int *ends = (int *) malloc( (n/target+1)*sizeof(int) );
+	assert( ends != NULL );
+	int nchunks = splitChunks( dict, sentence, n, target, ends );
+	if( nchunks <= 0 )
+	{
+		free( (void *) ends );
+		return -1;
+	}
+
+	splitjob j;
+	j.dict = dict;
+	j.sentence = sentence;
+	j.obj = obj;
+	j.ends = ends;
+	j.nchunks = nchunks;
+	j.nwords = (int *) malloc( nchunks*sizeof(int) );
+	assert( j.nwords != NULL );
+	j.spans = spans;
+	atomic_init( &j.next, 0 );
+	atomic_init( &j.failed, 0 );
+
+	// we're one of the threads ourselves
+	if( nthreads > nchunks ) nthreads = nchunks;
+	pthread_t t[nthreads];
+	for( int i = 1; i < nthreads; i++ )
+	{
+		pthread_create( &t[i], NULL, &worker, &j );
+	}
+	(void) worker( &j );
+	for( int i = 1; i < nthreads; i++ )
+	{
+		pthread_join( t[i], NULL );
+	}
+
+	// stitch: move each chunk's words down to follow the previous
+	// chunk's, making their offsets relative to the whole sentence
+	int nwords = -1;
+	if( ! atomic_load( &j.failed ) )
+	{
+		nwords = 0;
+		for( int k = 0; k < nchunks; k++ )
+		{
+			int start = k == 0 ? 0 : ends[k-1];
+			for( int i = 0; i < j.nwords[k]; i++ )
+			{
+				spans[nwords].off = start + spans[start+i].off;
+				spans[nwords].len = spans[start+i].len;
+				nwords++;
+			}
+		}
+	}
+	free( (void *) j.nwords );
+	free( (void *) ends );
+	return nwords;
+}
+
+
+/*
+ * A segmenting thread: segment chunks, taking the next one each time,
+ * until there are none left (or one fails, dooming the whole sentence).
+ * A chunk of m chars has at most m words, so its words fit in spans[]
+ * from the chunk's start onwards, without touching any other chunk's.
+ * Like every thread, we merge our stats before we go.
+ */
+static void *worker( void *arg )
+{
+	splitjob *j = (splitjob *) arg;
+	segscratch sc = segScratchCreate();
+	int k;
+	while( ! atomic_load_explicit( &j->failed, memory_order_relaxed ) &&
+	       (k = atomic_fetch_add( &j->next, 1 )) < j->nchunks )
+	{
+		int start = k == 0 ? 0 : j->ends[k-1];
+		int nw = segmentSpans( j->dict, j->sentence+start, j->ends[k]-start,
+				       j->obj, sc, j->spans+start );
+		j->nwords[k] = nw;
+		if( nw == -1 ) atomic_store( &j->failed, 1 );
+	}
+	segScratchFree( sc );
+	statsMerge();
+	return NULL;
+}
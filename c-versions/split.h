@@ -0,0 +1,9 @@
+/*
+ * split.h: cut a long sentence at the places where any breakdown must
+ *	    have a word boundary, and segment the pieces in parallel..
+ *
+ * (C) Duncan C. White, 2017
+ */
+
+extern int splitChunks( dictionary dict, char *sentence, int n, int target, int *ends );
+extern int splitSegment( dictionary dict, char *sentence, int n, seg_objective obj, int nthreads, segspan *spans );
@@ -0,0 +1,113 @@
+/*
+ * stats.c: search statistics for the sentence splitters (see stats.h).
+ *	statsPrint() writes the totals as a machine-readable block, one
+ *	"name value" pair per line between "stats begin" and "stats end".
+ *
+ * (C) Duncan C. White, 2017
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "stats.h"
+
+
+_Thread_local stats_t threadstats;		/* this thread's figures */
+int statsTiming = 0;				/* measure phase times? */
+
+static stats_t total;				/* merged figures */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static char *phasename[NPHASES] = {
+	"load_secs", "lowercase_secs", "search_secs", "output_secs"
+};
+
+
+/*
+ * double t = statsNow();
+ *	Return the current (monotonic) time in seconds.
+ */
+double statsNow( void )
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+
+/*
+ * statsPhase( p, since );
+ *	Add the time from <since> (a statsNow() time) until now to this
+ *	thread's time in phase p.
+ */
+void statsPhase( stat_phase p, double since )
+{
+	threadstats.phase[p] += statsNow() - since;
+}
+
+
+/*
+ * statsMerge();
+ *	Fold this thread's figures into the totals, and reset them: each
+ *	thread must do this before it exits.
+ */
+void statsMerge( void )
+{
+	pthread_mutex_lock( &lock );
+	total.setlookups  += threadstats.setlookups;
+	total.sethits     += threadstats.sethits;
+	total.setmisses   += threadstats.setmisses;
+	total.setprobes   += threadstats.setprobes;
+	total.trienodes   += threadstats.trienodes;
+	total.acfails     += threadstats.acfails;
+	total.matches     += threadstats.matches;
+	total.dppositions += threadstats.dppositions;
+	total.dpwords     += threadstats.dpwords;
+	total.loadbytes   += threadstats.loadbytes;
+	for( int p = 0; p < NPHASES; p++ )
+	{
+		total.phase[p] += threadstats.phase[p];
+	}
+	pthread_mutex_unlock( &lock );
+	memset( &threadstats, 0, sizeof(threadstats) );
+}
+
+
+/*
+ * statsPrint( out );
+ *	Merge the calling thread's figures, then print the totals to out.
+ *	Phase times from several threads are added up, so may exceed the
+ *	elapsed time.  Without -DSTATS, there are no counters to print.
+ */
+void statsPrint( FILE *out )
+{
+	statsMerge();
+	fprintf( out, "stats begin\n" );
+	for( int p = 0; p < NPHASES; p++ )
+	{
+		fprintf( out, "%s %.6f\n", phasename[p], total.phase[p] );
+	}
+	if( total.loadbytes > 0 && total.phase[PhaseLoad] > 0 )
+	{
+		fprintf( out, "load_bytes %ld\n", total.loadbytes );
+		fprintf( out, "load_mb_per_sec %.1f\n",
+			total.loadbytes / total.phase[PhaseLoad] / 1e6 );
+	}
+#ifdef STATS
+	fprintf( out, "counters 1\n" );
+	fprintf( out, "set_lookups %ld\n",  total.setlookups );
+	fprintf( out, "set_hits %ld\n",     total.sethits );
+	fprintf( out, "set_misses %ld\n",   total.setmisses );
+	fprintf( out, "set_probes %ld\n",   total.setprobes );
+	fprintf( out, "trie_nodes %ld\n",   total.trienodes );
+	fprintf( out, "ac_fails %ld\n",     total.acfails );
+	fprintf( out, "matches %ld\n",      total.matches );
+	fprintf( out, "dp_positions %ld\n", total.dppositions );
+	fprintf( out, "dp_words %ld\n",     total.dpwords );
+#else
+	fprintf( out, "counters 0\n" );
+#endif
+	fprintf( out, "stats end\n" );
+}
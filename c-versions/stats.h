@@ -0,0 +1,44 @@
+/*
+ * stats.h: search statistics for the sentence splitters..
+ *	Counters bumped inside the hot loops (set probes, trie nodes
+ *	visited etc) only exist when compiled with -DSTATS (make STATS=1):
+ *	otherwise STAT_INC() and STAT_ADD() compile to nothing.  Per-phase
+ *	wall times are always available, but are only measured if
+ *	statsTiming is set (eg. by --stats).  Each thread accumulates
+ *	its own figures, and folds them into the totals with statsMerge().
+ *
+ * (C) Duncan C. White, 2017
+ */
+
+typedef enum {
+	PhaseLoad, PhaseLowercase, PhaseSearch, PhaseOutput, NPHASES
+} stat_phase;
+
+typedef struct {
+	long		setlookups;		/* setIn() calls.. */
+	long		sethits;		/* ..that found the key */
+	long		setmisses;		/* ..that didn't */
+	long		setprobes;		/* slots examined */
+	long		trienodes;		/* trie nodes examined */
+	long		acfails;		/* Aho-Corasick fail links taken */
+	long		matches;		/* word occurrences found */
+	long		dppositions;		/* positions solved by segment() */
+	long		dpwords;		/* words considered there */
+	long		loadbytes;		/* word list bytes read */
+	double		phase[NPHASES];		/* seconds spent in each phase */
+} stats_t;
+
+extern _Thread_local stats_t threadstats;
+extern int statsTiming;
+
+#ifdef STATS
+#define STAT_ADD(field,n)	(threadstats.field += (n))
+#else
+#define STAT_ADD(field,n)	((void)0)
+#endif
+#define STAT_INC(field)		STAT_ADD(field,1)
+
+extern double statsNow( void );
+extern void statsPhase( stat_phase p, double since );
+extern void statsMerge( void );
+extern void statsPrint( FILE *out );
@@ -0,0 +1,339 @@
+/*
+ * stream.c: segment an unbounded stream of text with no spaces (eg.
+ *	     a multi-megabyte OCR dump) into dictionary words, reading
+ *	     it incrementally and emitting words as soon as they are
+ *	     certain, without ever holding the whole text in memory.
+ *
+ *	We run a forward dynamic programme: for each position in the
+ *	text, the fewest words that the text up to that position can
+ *	be broken into, and the position at which the last of those
+ *	words starts (a back pointer).  Once we have read L chars past
+ *	a position (L being the length of the longest word), we know
+ *	every word starting there, and "process" it, extending the
+ *	breakdowns ending there by each of those words.
+ *
+ *	Having processed position p, every breakdown of the whole text
+ *	must pass through one of the reachable positions in (p,p+L]:
+ *	the "live" positions.  Following back pointers from all live
+ *	positions, they meet at a common ancestor; the words up to
+ *	that ancestor are the same whatever text follows, so we emit
+ *	them and discard everything before the ancestor.  So we only
+ *	ever keep a window of the text: L chars of lookahead plus any
+ *	genuinely pending ambiguity (eg. "aaaa..." with words "a" and
+ *	"aa", where only the end of the text can decide).
+ *
+ *	Note that we pick the breakdown with the fewest words (ties
+ *	going to the one whose last word is longest), as that can be
+ *	decided online, unlike backtrack's "longest word first" rule,
+ *	which needs to see the end of the text before committing to
+ *	anything; so the two may differ where the text is ambiguous.
+ *	Everything is iterative - no recursion however long the text.
+ *
+ * (C) Duncan C. White, 2017
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <assert.h>
+
+#include "dict.h"
+#include "stream.h"
+#include "lower.h"
+
+
+#define	UNREACHABLE	INT_MAX
+
+
+struct stream_s {
+	dictionary	dict;
+	int		longest;		/* length of longest word */
+	stream_emitfunc	emit;
+	void *		arg;
+	long		base;			/* text offset of window[0] */
+	int		nbuf;			/* chars in the window */
+	int		maxbuf;			/* room in the window */
+	char *		text;			/* window: original text.. */
+	char *		lc;			/* ..lower-cased */
+	int *		nwords;			/* nwords[i]: fewest words to
+						   reach window posn i.. */
+	int *		back;			/* ..the last of which starts
+						   at back[i] */
+	int		next;			/* next posn to process */
+	int		nextcommit;		/* try to commit at this posn */
+	int		dead;			/* no breakdown possible? */
+};
+
+
+/* Private functions */
+
+static void process( streamseg, int );
+static int islive( streamseg, int );
+static void commit( streamseg, int );
+static void emitpath( streamseg, int );
+
+
+/*
+ * streamseg s = streamCreate( dict, emit, arg );
+ *	Create a stream segmenter using dictionary <dict>, which will
+ *	call (*emit)( word, len, arg ) with each word as it's committed.
+ */
+streamseg streamCreate( dictionary dict, stream_emitfunc emit, void *arg )
+{
+	streamseg s = (streamseg) malloc( sizeof(struct stream_s) );
+	assert( s != NULL );
+	s->dict = dict;
+	s->longest = dictLongest( dict );
+	s->emit = emit;
+	s->arg = arg;
+	s->base = 0;
+	s->nbuf = 0;
+	s->maxbuf = 4096 + s->longest;
+	s->text = (char *) malloc( s->maxbuf*sizeof(char) );
+	s->lc = (char *) malloc( s->maxbuf*sizeof(char) );
+	s->nwords = (int *) malloc( (s->maxbuf+1)*sizeof(int) );
+	s->back = (int *) malloc( (s->maxbuf+1)*sizeof(int) );
+	assert( s->text != NULL && s->lc != NULL );
+	assert( s->nwords != NULL && s->back != NULL );
+	s->nwords[0] = 0;			/* the start is reachable */
+	s->back[0] = -1;
+	s->next = 0;
+	s->nextcommit = s->longest;
+	s->dead = 0;
+	return s;
+}
+
+
+/*
+ * int ok = streamPut( s, text, n );
+ *	Feed the next <n> chars of <text> into stream segmenter <s>,
+ *	processing (and committing) whatever we now can.  Return 0 if
+ *	it's already certain that no breakdown is possible, else 1.
+ */
+int streamPut( streamseg s, char *text, int n )
+{
+	if( s->dead ) return 0;
+
+	for( int done = 0; done < n; )
+	{
+		// make room, growing the window if it's full of pending
+		// ambiguity
+		if( s->nbuf == s->maxbuf )
+		{
+			s->maxbuf *= 2;
+			s->text = (char *) realloc( s->text, s->maxbuf*sizeof(char) );
+			s->lc = (char *) realloc( s->lc, s->maxbuf*sizeof(char) );
+			s->nwords = (int *) realloc( s->nwords, (s->maxbuf+1)*sizeof(int) );
+			s->back = (int *) realloc( s->back, (s->maxbuf+1)*sizeof(int) );
+			assert( s->text != NULL && s->lc != NULL );
+			assert( s->nwords != NULL && s->back != NULL );
+		}
+		int chunk = s->maxbuf - s->nbuf;
+		if( chunk > n-done ) chunk = n-done;
+		memcpy( s->text+s->nbuf, text+done, chunk );
+		lowercopy( s->lc+s->nbuf, text+done, chunk );
+		for( int i = 0; i < chunk; i++ )
+		{
+			s->nwords[s->nbuf+i+1] = UNREACHABLE;
+		}
+		s->nbuf += chunk;
+		done += chunk;
+
+		// process every position that has L chars of lookahead
+		while( ! s->dead && s->next + s->longest <= s->nbuf )
+		{
+			process( s, s->next++ );
+		}
+		if( s->dead ) return 0;
+	}
+	return 1;
+}
+
+
+/*
+ * int ok = streamEnd( s );
+ *	Tell stream segmenter <s> that the text has ended: process the
+ *	remaining positions, and emit the rest of the words.  Return 1
+ *	if the whole text was broken up into words, or 0 if that's
+ *	impossible.
+ */
+int streamEnd( streamseg s )
+{
+	while( ! s->dead && s->next < s->nbuf )
+	{
+		process( s, s->next++ );
+	}
+	if( s->dead || s->nwords[s->nbuf] == UNREACHABLE || s->base+s->nbuf == 0 )
+	{
+		return 0;
+	}
+	emitpath( s, s->nbuf );
+	return 1;
+}
+
+
+/*
+ * long offset = streamOffset( s );
+ *	Return the text offset up to which the words have been emitted
+ *	(for reporting where a doomed text went wrong).
+ */
+long streamOffset( streamseg s )
+{
+	return s->base;
+}
+
+
+/*
+ * Free the stream segmenter s
+ */
+void streamFree( streamseg s )
+{
+	free( (void *) s->text );
+	free( (void *) s->lc );
+	free( (void *) s->nwords );
+	free( (void *) s->back );
+	free( (void *) s );
+}
+
+
+/*
+ * process( s, i );
+ *	Process window position i: extend the best breakdown reaching i
+ *	(if any) by each word starting at i.  Then check that some
+ *	breakdown can still continue, and maybe commit some words.
+ */
+static void process( streamseg s, int i )
+{
+	if( s->nwords[i] != UNREACHABLE )
+	{
+		int prefixlen[s->longest+1];
+		int nprefixes = dictPrefixes( s->dict, s->lc+i, s->nbuf-i, prefixlen );
+		for( int j = 0; j < nprefixes; j++ )
+		{
+			int t = i + prefixlen[j];
+			if( s->nwords[i]+1 < s->nwords[t] )
+			{
+				s->nwords[t] = s->nwords[i]+1;
+				s->back[t] = i;
+			}
+		}
+	}
+
+	if( ! islive( s, i ) )
+	{
+		s->dead = 1;
+	} else if( i >= s->nextcommit )
+	{
+		commit( s, i );
+	}
+}
+
+
+/*
+ * int live = islive( s, i );
+ *	Having processed window position i, is any position after it
+ *	(or i itself, if it's the end of the window) reachable?
+ */
+static int islive( streamseg s, int i )
+{
+	if( i == s->nbuf ) return s->nwords[i] != UNREACHABLE;
+	int last = i + s->longest;
+	if( last > s->nbuf ) last = s->nbuf;
+	for( int t = i+1; t <= last; t++ )
+	{
+		if( s->nwords[t] != UNREACHABLE ) return 1;
+	}
+	return 0;
+}
+
+
+/*
+ * commit( s, i );
+ *	Having processed window position i, find the common ancestor of
+ *	all live positions, and if it's past the start of the window,
+ *	emit the words up to it and slide the window along to start
+ *	there.  If not, don't try again until the pending ambiguity has
+ *	doubled, so that a long ambiguous stretch costs linear time.
+ */
+static void commit( streamseg s, int i )
+{
+	// the live positions..
+	int live[s->longest];
+	int nlive = 0;
+	int last = i + s->longest;
+	if( last > s->nbuf ) last = s->nbuf;
+	for( int t = i+1; t <= last; t++ )
+	{
+		if( s->nwords[t] != UNREACHABLE ) live[nlive++] = t;
+	}
+
+	// ..walk them back (furthest first) until they all meet
+	for(;;)
+	{
+		int max = live[0], min = live[0];
+		for( int k = 1; k < nlive; k++ )
+		{
+			if( live[k] > max ) max = live[k];
+			if( live[k] < min ) min = live[k];
+		}
+		if( max == min ) break;
+		for( int k = 0; k < nlive; k++ )
+		{
+			if( live[k] == max ) live[k] = s->back[max];
+		}
+	}
+	int anc = live[0];
+
+	if( anc == 0 )
+	{
+		s->nextcommit = i + (i > s->longest ? i : s->longest);
+		return;
+	}
+
+	// emit the words up to anc, then slide the window along to anc
+	emitpath( s, anc );
+
+	int keep = s->nbuf - anc;
+	memmove( s->text, s->text+anc, keep*sizeof(char) );
+	memmove( s->lc, s->lc+anc, keep*sizeof(char) );
+	int offset = s->nwords[anc];
+	for( int t = anc; t <= s->nbuf; t++ )
+	{
+		int nw = s->nwords[t];
+		s->nwords[t-anc] = nw == UNREACHABLE ? nw : nw-offset;
+		s->back[t-anc] = s->back[t] - anc;	/* -ve: dead end */
+	}
+	s->base += anc;
+	s->nbuf -= anc;
+	// anc may lie beyond i+1, but the positions in between can't be
+	// reached (or anc wouldn't be the common ancestor): skip them
+	s->next = s->next > anc ? s->next - anc : 0;
+	s->nextcommit = i - anc + s->longest;
+}
+
+
+/*
+ * emitpath( s, end );
+ *	Emit the words of the best breakdown from the start of the
+ *	window up to window position end.
+ */
+static void emitpath( streamseg s, int end )
+{
+	// follow the back pointers to find where each word starts..
+	int nw = s->nwords[end];
+	int *start = (int *) malloc( (nw+1)*sizeof(int) );
+	assert( start != NULL );
+	start[nw] = end;
+	for( int k = nw-1; k >= 0; k-- )
+	{
+		start[k] = s->back[start[k+1]];
+	}
+
+	// ..and emit the words in order
+	for( int k = 0; k < nw; k++ )
+	{
+		(*s->emit)( s->text + start[k], start[k+1] - start[k], s->arg );
+	}
+	free( (void *) start );
+}
@@ -0,0 +1,20 @@
+/*
+ * stream.h: segment an unbounded stream of text with no spaces into
+ *	     dictionary words, in bounded memory, emitting each word
+ *	     as soon as it's certain..
+ *
+ * (C) Duncan C. White, 2017
+ */
+
+typedef struct stream_s *streamseg;
+
+// called with each committed word <word> (of length <len>, in it's
+// original case, NOT '\0' terminated) in order.  <arg> is passed
+// through unchanged.
+typedef void (*stream_emitfunc)( char *word, int len, void *arg );
+
+extern streamseg streamCreate( dictionary dict, stream_emitfunc emit, void *arg );
+extern int streamPut( streamseg s, char *text, int n );
+extern int streamEnd( streamseg s );
+extern long streamOffset( streamseg s );
+extern void streamFree( streamseg s );
@@ -0,0 +1,493 @@
+/*
+ * trie.c: prefix tree (trie) storage for C..
+ * 	we store a trie as a dynamic array of nodes, node 0 being
+ * 	the root.  Each node records the character on the edge into
+ * 	it, whether the path from the root to it spells a complete
+ * 	word, the index of its first child and the index of its next
+ * 	sibling (0 meaning "none" in both cases, as the root can
+ * 	never be anyone's child or sibling).  Siblings are kept in
+ * 	ascending character order, so a search can give up early.
+ * 	Each word also carries a small integer weight, whose meaning
+ * 	is up to the caller (dict.c uses it for word frequencies).
+ *
+ * 	The point of a trie (rather than a set) is triePrefixes():
+ * 	a single forward walk from the start of a string finds the
+ * 	lengths of ALL words that are prefixes of that string, and
+ * 	stops as soon as no word can possibly continue.
+ *
+ * 	As nodes refer to each other by index, not by pointer, the
+ * 	node array is relocatable: trieSave() writes it out as is,
+ * 	and trieMap() builds a read-only trie straight on top of a
+ * 	saved copy (eg. one that has been mmap()ed in) - no parsing
+ * 	and no per-word allocation.  The format is native endian.
+ *
+ * 	trieACBuild() adds Aho-Corasick links to a (finished) trie:
+ * 	for each node, the node spelling its longest proper suffix
+ * 	(its "fail" link), and the node spelling its longest proper
+ * 	suffix that is a word.  trieACScan() then finds every word
+ * 	occurrence in a whole string in one linear pass, rather than
+ * 	one triePrefixes() walk per starting position.  The links live
+ * 	outside the node array, and can be saved (trieACSave) and
+ * 	mapped back in (trieACMap) alongside a saved trie.
+ *
+ * (C) Duncan C. White, 2017
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "trie.h"
+#include "stats.h"
+
+
+typedef struct trienode_s *trienode;
+
+struct trienode_s {
+	int32_t		child;			/* first child, or 0 */
+	int32_t		sibling;		/* next sibling, or 0 */
+	unsigned char	ch;			/* char on edge into node */
+	char		isword;			/* does a word end here? */
+	uint16_t	weight;			/* the word's weight */
+};
+
+struct trie_s {
+	trienode	node;			/* dynamic array of nodes */
+	int		nnodes;			/* number of nodes in use */
+	int		maxnodes;		/* number allocated, 0 if mapped */
+	int		longest;		/* length of longest word */
+};
+
+struct trieac_s {
+	trie		t;			/* the trie we're built over */
+	int32_t *	fail;			/* longest proper suffix node */
+	int32_t *	out;			/* longest proper suffix word */
+	int32_t *	depth;			/* length of string at node */
+	int32_t		root[256];		/* root's children, by char */
+	int		mapped;			/* links in someone's memory? */
+};
+
+// the header of a saved trie, followed by header.nnodes nodes
+typedef struct {
+	int32_t		nnodes;
+	int32_t		longest;
+} trieheader;
+
+
+/* Private functions */
+
+static int nalloc( trie, unsigned char );
+static int findchild( trie, int, unsigned char );
+
+
+/*
+ * Create an empty trie, containing just the root
+ */
+trie trieCreate( void )
+{
+	trie t = (trie) malloc( sizeof(struct trie_s) );
+	assert( t != NULL );
+	t->maxnodes = 1024;
+	t->node = (trienode) malloc( t->maxnodes*sizeof(struct trienode_s) );
+	assert( t->node != NULL );
+	t->nnodes = 0;
+	t->longest = 0;
+	(void) nalloc( t, '\0' );		/* the root */
+	return t;
+}
+
+
+/*
+ * Free the given trie (but not the memory under a mapped trie)
+ */
+void trieFree( trie t )
+{
+	if( t->maxnodes > 0 )
+	{
+		free( (void *) t->node );
+	}
+	free( (void *) t );
+}
+
+
+/*
+ * size_t size = trieSave( t, out );
+ *	Write trie t to out, in the form that trieMap() expects;
+ *	return the number of bytes written, or 0 on failure.
+ */
+size_t trieSave( trie t, FILE *out )
+{
+	trieheader h;
+	h.nnodes  = t->nnodes;
+	h.longest = t->longest;
+	if( fwrite( &h, sizeof(h), 1, out ) != 1 ) return 0;
+	if( fwrite( t->node, sizeof(struct trienode_s), t->nnodes, out )
+	    != t->nnodes ) return 0;
+	return trieSize( t );
+}
+
+
+/*
+ * size_t size = trieSize( t );
+ *	Return the number of bytes that trieSave( t ) writes.
+ */
+size_t trieSize( trie t )
+{
+	return sizeof(trieheader) + t->nnodes*sizeof(struct trienode_s);
+}
+
+
+/*
+ * trie t = trieMap( mem, size );
+ *	Build a read-only trie on top of <size> bytes at <mem>, previously
+ *	written by trieSave() - and suitably aligned.  The memory must
+ *	outlive the trie.  Return NULL if it's not a plausible trie.
+ */
+trie trieMap( const void *mem, size_t size )
+{
+	const trieheader *h = (const trieheader *)mem;
+	if( size < sizeof(*h) || h->nnodes < 1 ||
+	    size < sizeof(*h) + h->nnodes*sizeof(struct trienode_s) )
+	{
+		return NULL;
+	}
+	trie t = (trie) malloc( sizeof(struct trie_s) );
+	assert( t != NULL );
+	t->node = (trienode) (h+1);
+	t->nnodes = h->nnodes;
+	t->maxnodes = 0;
+	t->longest = h->longest;
+	return t;
+}
+
+
+/*
+ * Include word in trie t, with the given weight (0..TRIEMAXWEIGHT),
+ * replacing its old weight if it was already present
+ */
+void trieInclude( trie t, char *word, int weight )
+{
+	assert( weight >= 0 && weight <= TRIEMAXWEIGHT );
+	assert( t->maxnodes > 0 );		/* not a mapped trie! */
+	int n = 0;
+	int len = 0;
+	for( unsigned char *p = (unsigned char *)word; *p; p++, len++ )
+	{
+		// find the child of n for *p, inserting it into the
+		// (sorted) sibling list if not already present
+		int prev = 0;
+		int c = t->node[n].child;
+		while( c != 0 && t->node[c].ch < *p )
+		{
+			prev = c;
+			c = t->node[c].sibling;
+		}
+		if( c == 0 || t->node[c].ch != *p )
+		{
+			int new = nalloc( t, *p );	/* NB: may move t->node */
+			t->node[new].sibling = c;
+			if( prev == 0 )
+			{
+				t->node[n].child = new;
+			} else
+			{
+				t->node[prev].sibling = new;
+			}
+			c = new;
+		}
+		n = c;
+	}
+	t->node[n].isword = 1;
+	t->node[n].weight = weight;
+	if( len > t->longest ) t->longest = len;
+}
+
+
+/*
+ * Look for a word in the trie t
+ */
+int trieIn( trie t, char *word )
+{
+	int n = 0;
+	for( unsigned char *p = (unsigned char *)word; *p; p++ )
+	{
+		n = findchild( t, n, *p );
+		if( n == 0 ) return 0;
+	}
+	return t->node[n].isword;
+}
+
+
+/*
+ * int weight = trieWeight( t, word );
+ *	Return the weight of word in the trie t, or -1 if it's not there.
+ */
+int trieWeight( trie t, char *word )
+{
+	int n = 0;
+	for( unsigned char *p = (unsigned char *)word; *p; p++ )
+	{
+		n = findchild( t, n, *p );
+		if( n == 0 ) return -1;
+	}
+	return t->node[n].isword ? t->node[n].weight : -1;
+}
+
+
+/*
+ * int nlens = triePrefixes( t, str, n, lens[], weights[] );
+ *	Walk forward through (at most n chars of) <str>, storing the
+ *	lengths of all words in t that are prefixes of <str> in lens[],
+ *	in ascending order, and return how many there were.  lens[]
+ *	must have room for trieLongest(t) entries.  If <weights> is not
+ *	NULL, store the weight of each word in weights[] too.
+ */
+int triePrefixes( trie t, const char *str, int n, int *lens, int *weights )
+{
+	int nlens = 0;
+	int node = 0;
+	for( int i = 0; i < n && str[i] != '\0'; i++ )
+	{
+		node = findchild( t, node, (unsigned char)str[i] );
+		if( node == 0 ) break;
+		if( t->node[node].isword )
+		{
+			if( weights != NULL ) weights[nlens] = t->node[node].weight;
+			lens[nlens++] = i+1;
+		}
+	}
+	return nlens;
+}
+
+
+/*
+ * How long is the longest word in the trie?
+ */
+int trieLongest( trie t )
+{
+	return t->longest;
+}
+
+
+/*
+ * trieAdjacent( t, adjacent, used );
+ *	Record every pair of chars c1,c2 that are adjacent (c1 then c2)
+ *	in some word of trie t, by setting bit c1<<8|c2 of the bitset
+ *	adjacent[] (65536 bits), and every char used in some word, by
+ *	setting used[c].  As every node is on some word's path, that's
+ *	just each node's char, and each edge's pair of chars.
+ */
+void trieAdjacent( trie t, uint64_t *adjacent, char *used )
+{
+	for( int n = 1; n < t->nnodes; n++ )
+	{
+		unsigned char c1 = t->node[n].ch;
+		used[c1] = 1;
+		for( int c = t->node[n].child; c != 0; c = t->node[c].sibling )
+		{
+			int pair = c1<<8 | t->node[c].ch;
+			adjacent[pair/64] |= (uint64_t)1 << (pair%64);
+		}
+	}
+}
+
+
+/*
+ * trieac ac = trieACBuild( t );
+ *	Build the Aho-Corasick links for trie t, which must not change
+ *	while ac exists.  We visit the nodes breadth first, so that a
+ *	node's fail link (which is always shallower) is known before
+ *	any of its children need it.
+ */
+trieac trieACBuild( trie t )
+{
+	trieac ac = (trieac) malloc( sizeof(struct trieac_s) );
+	assert( ac != NULL );
+	ac->t = t;
+	ac->mapped = 0;
+	ac->fail  = (int32_t *) malloc( t->nnodes*sizeof(int32_t) );
+	ac->out   = (int32_t *) malloc( t->nnodes*sizeof(int32_t) );
+	ac->depth = (int32_t *) malloc( t->nnodes*sizeof(int32_t) );
+	int32_t *queue = (int32_t *) malloc( t->nnodes*sizeof(int32_t) );
+	assert( ac->fail != NULL && ac->out != NULL && ac->depth != NULL );
+	assert( queue != NULL );
+
+	for( int ch = 0; ch < 256; ch++ )
+	{
+		ac->root[ch] = 0;
+	}
+	ac->fail[0] = ac->out[0] = ac->depth[0] = 0;
+
+	int head = 0, tail = 0;
+	queue[tail++] = 0;
+	while( head < tail )
+	{
+		int n = queue[head++];
+		for( int c = t->node[n].child; c != 0; c = t->node[c].sibling )
+		{
+			unsigned char ch = t->node[c].ch;
+			int f = 0;
+			if( n == 0 )
+			{
+				ac->root[ch] = c;
+			} else
+			{
+				// longest proper suffix of n that can
+				// be extended by ch
+				int s = ac->fail[n];
+				while( s != 0 && findchild( t, s, ch ) == 0 )
+				{
+					s = ac->fail[s];
+				}
+				f = s == 0 ? ac->root[ch] : findchild( t, s, ch );
+			}
+			ac->fail[c]  = f;
+			ac->out[c]   = t->node[f].isword ? f : ac->out[f];
+			ac->depth[c] = ac->depth[n]+1;
+			queue[tail++] = c;
+		}
+	}
+	free( (void *) queue );
+	return ac;
+}
+
+
+/*
+ * Free the given Aho-Corasick links (but not the trie, nor the memory
+ * under mapped links)
+ */
+void trieACFree( trieac ac )
+{
+	if( ! ac->mapped )
+	{
+		free( (void *) ac->fail );
+		free( (void *) ac->out );
+		free( (void *) ac->depth );
+	}
+	free( (void *) ac );
+}
+
+
+/*
+ * size_t size = trieACSave( ac, out );
+ *	Write Aho-Corasick links ac to out, in the form that trieACMap()
+ *	expects: the root's child table, followed by the fail, out and
+ *	depth arrays.  Return the number of bytes written, or 0 on failure.
+ */
+size_t trieACSave( trieac ac, FILE *out )
+{
+	int nnodes = ac->t->nnodes;
+	if( fwrite( ac->root, sizeof(ac->root), 1, out ) != 1 ||
+	    fwrite( ac->fail, sizeof(int32_t), nnodes, out ) != nnodes ||
+	    fwrite( ac->out, sizeof(int32_t), nnodes, out ) != nnodes ||
+	    fwrite( ac->depth, sizeof(int32_t), nnodes, out ) != nnodes )
+	{
+		return 0;
+	}
+	return sizeof(ac->root) + 3*nnodes*sizeof(int32_t);
+}
+
+
+/*
+ * trieac ac = trieACMap( t, mem, size );
+ *	Build read-only Aho-Corasick links for trie t on top of <size>
+ *	bytes at <mem>, previously written by trieACSave() for the same
+ *	trie.  The memory must outlive ac.  Return NULL if it's too short.
+ */
+trieac trieACMap( trie t, const void *mem, size_t size )
+{
+	int nnodes = t->nnodes;
+	if( size < 256*sizeof(int32_t) + 3*nnodes*sizeof(int32_t) )
+	{
+		return NULL;
+	}
+	trieac ac = (trieac) malloc( sizeof(struct trieac_s) );
+	assert( ac != NULL );
+	ac->t = t;
+	ac->mapped = 1;
+	memcpy( ac->root, mem, sizeof(ac->root) );
+	ac->fail  = (int32_t *) mem + 256;
+	ac->out   = ac->fail + nnodes;
+	ac->depth = ac->out + nnodes;
+	return ac;
+}
+
+
+/*
+ * trieACScan( ac, str, n, cb, arg );
+ *	Scan (at most n chars of) <str> once, calling cb( end, len, weight,
+ *	arg ) for every occurrence of a word in ac's trie: str[end-len..end-1]
+ *	is that word, and has that weight.  Occurrences are reported in ascending order of
+ *	end, and then descending order of len.  Amortized, each char
+ *	costs O(1) fail link steps, plus O(1) per occurrence reported.
+ */
+void trieACScan( trieac ac, char *str, int n, trie_matchfunc cb, void *arg )
+{
+	trie t = ac->t;
+	int node = 0;
+	for( int i = 0; i < n && str[i] != '\0'; i++ )
+	{
+		unsigned char ch = (unsigned char)str[i];
+		// follow fail links until some suffix can be extended
+		int next;
+		for( ;; )
+		{
+			next = node == 0 ? ac->root[ch] : findchild( t, node, ch );
+			if( next != 0 || node == 0 ) break;
+			node = ac->fail[node];
+			STAT_INC( acfails );
+		}
+		node = next;
+
+		for( int w = t->node[node].isword ? node : ac->out[node];
+		     w != 0; w = ac->out[w] )
+		{
+			(*cb)( i+1, ac->depth[w], t->node[w].weight, arg );
+		}
+	}
+}
+
+
+/* -------------------- Node ops --------------------- */
+
+/*
+ * Allocate a new node labelled ch in the trie, growing the node
+ * array if necessary; return it's index.
+ */
+static int nalloc( trie t, unsigned char ch )
+{
+	if( t->nnodes == t->maxnodes )
+	{
+		t->maxnodes *= 2;
+		t->node = (trienode) realloc( t->node,
+				t->maxnodes*sizeof(struct trienode_s) );
+		if( t->node == NULL )
+		{
+			fprintf( stderr, "nalloc: No space left\n" );
+			exit(1);
+		}
+	}
+	trienode p = t->node + t->nnodes;
+	p->child = p->sibling = 0;
+	p->ch = ch;
+	p->isword = 0;
+	p->weight = 0;
+	return t->nnodes++;
+}
+
+
+/*
+ * Find the child of node n labelled ch, or 0 if there isn't one
+ */
+static int findchild( trie t, int n, unsigned char ch )
+{
+	int c;
+	for( c = t->node[n].child; c != 0 && t->node[c].ch < ch;
+	     c = t->node[c].sibling )
+	{
+		STAT_INC( trienodes );
+	}
+	return c != 0 && t->node[c].ch == ch ? c : 0;
+}
@@ -0,0 +1,31 @@
+/*
+ * trie.h: prefix tree (trie) of strings for C..
+ *
+ * (C) Duncan C. White, 2017
+ */
+
+typedef struct trie_s *trie;
+typedef struct trieac_s *trieac;		/* Aho-Corasick links */
+
+// called by trieACScan() for each word occurrence str[end-len..end-1]
+typedef void (*trie_matchfunc)( int end, int len, int weight, void *arg );
+
+// each word carries a weight, 0..TRIEMAXWEIGHT
+#define TRIEMAXWEIGHT	65535
+
+extern trie trieCreate( void );
+extern void trieFree( trie t );
+extern size_t trieSave( trie t, FILE *out );
+extern trie trieMap( const void *mem, size_t size );
+extern size_t trieSize( trie t );
+extern void trieInclude( trie t, char *word, int weight );
+extern int trieIn( trie t, char *word );
+extern int trieWeight( trie t, char *word );
+extern int triePrefixes( trie t, const char *str, int n, int *lens, int *weights );
+extern int trieLongest( trie t );
+extern void trieAdjacent( trie t, uint64_t *adjacent, char *used );
+extern trieac trieACBuild( trie t );
+extern void trieACFree( trieac ac );
+extern size_t trieACSave( trieac ac, FILE *out );
+extern trieac trieACMap( trie t, const void *mem, size_t size );
+extern void trieACScan( trieac ac, char *str, int n, trie_matchfunc cb, void *arg );
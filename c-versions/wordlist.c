@@ -0,0 +1,354 @@
+/*
+ * wordlist.c: read a word list - one word per line, optionally
+ *	followed by a space or tab and its frequency - as fast as we can,
+ *	for building dictionaries of many millions of words.
+ *
+ *	Rather than reading a line at a time into a fixed size buffer,
+ *	we mmap() the whole file in, privately (so that we can change
+ *	our copy of it), and split it into slices at line boundaries,
+ *	one per CPU.  A thread per slice then finds each line - with
+ *	memchr(), which libc vectorizes, 16 or 32 chars at a time, however
+ *	we're compiled - and its word, up to the first CR, space or tab;
+ *	lower cases the word in place, '\0' terminates it in place (over
+ *	the char that ended it), and records where it is, how long it is
+ *	and its frequency.  So no word is copied, and
+ *	no line is too long.  CRLF line endings and blank lines are fine,
+ *	as is a missing newline at the end of the file; duplicate words
+ *	are left for the dictionary to merge (adding up frequencies).
+ *
+ *	The words stay in the mapped file, so they're only valid until
+ *	wordlistFree().
+ *
+ * (C) Duncan C. White, 2017
+ */
+
+#define _GNU_SOURCE				/* for memrchr() */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <assert.h>
+
+#include "lower.h"
+#include "wordlist.h"
+
+// files smaller than this are read by a single thread
+#define MINSLICE	(1<<20)
+
+
+struct wordlist_s {
+	char *		map;			/* the file, mapped privately */
+	size_t		size;			/* its size */
+	char *		last;			/* its unterminated last line */
+	char **		word;			/* each word.. */
+	int *		len;			/* ..its length.. */
+	double *	freq;			/* ..and frequency (or NULL) */
+	int		n;			/* how many words */
+};
+
+// one thread's slice of the file, and the words it finds there
+typedef struct {
+	char *		from;			/* first char of the slice */
+	char *		to;			/* just after its last char */
+	char **		word;
+	int *		len;
+	double *	freq;			/* NULL until we see one */
+	int		n;
+	int		max;			/* room in word, len, freq */
+	pthread_t	tid;
+} slice;
+
+
+/* Private functions */
+
+static void *parse( void * );
+static double parsefreq( char *, char * );
+static void addword( slice *, char *, int, double );
+static void joinslices( wordlist, slice *, int );
+
+// does c end a line's word?
+#define ENDSWORD(c)	((c) == '\r' || (c) == ' ' || (c) == '\t')
+
+
+/*
+ * wordlist wl = wordlistRead( filename );
+ *	Read word list <filename>: map it in, and find, lower case and
+ *	'\0' terminate all its words, in parallel.  Return NULL if we
+ *	can't open or map the file.
+ */
+wordlist wordlistRead( char *filename )
+{
+	int fd = open( filename, O_RDONLY );
+	if( fd == -1 ) return NULL;
+	struct stat st;
+	if( fstat( fd, &st ) == -1 )
+	{
+		close( fd );
+		return NULL;
+	}
+
+	wordlist wl = (wordlist) calloc( 1, sizeof(struct wordlist_s) );
+	assert( wl != NULL );
+	wl->size = st.st_size;
+	if( wl->size > 0 )
+	{
+		wl->map = mmap( NULL, wl->size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0 );
+		if( wl->map == MAP_FAILED )
+		{
+			close( fd );
+			free( (void *) wl );
+			return NULL;
+		}
+		madvise( wl->map, wl->size, MADV_SEQUENTIAL );
+	}
+	close( fd );
+
+	// a last line with no newline can't be terminated in place (it
+	// may end right at the end of the mapping): parse a copy instead
+	size_t end = wl->size;
+	if( end > 0 && wl->map[end-1] != '\n' )
+	{
+		char *nl = memrchr( wl->map, '\n', end );
+		end = nl == NULL ? 0 : nl+1 - wl->map;
+		wl->last = strndup( wl->map+end, wl->size-end );
+		assert( wl->last != NULL );
+	}
+
+	// cut the file into slices, each starting at the start of a line
+	int nslices = end / MINSLICE;
+	int ncpus = sysconf( _SC_NPROCESSORS_ONLN );
+	if( nslices > ncpus ) nslices = ncpus;
+	if( nslices < 1 ) nslices = 1;
+	slice sl[nslices+1];
+	memset( sl, 0, sizeof(sl) );
+	char *at = wl->map;
+	for( int i = 0; i < nslices; i++ )
+	{
+		sl[i].from = at;
+		at = wl->map + end*(i+1)/nslices;
+		if( i < nslices-1 && at > sl[i].from )
+		{
+			char *nl = memchr( at-1, '\n', wl->map+end - (at-1) );
+			at = nl == NULL ? wl->map+end : nl+1;
+		}
+		if( at < sl[i].from ) at = sl[i].from;
+		sl[i].to = at;
+	}
+	for( int i = 1; i < nslices; i++ )
+	{
+		pthread_create( &sl[i].tid, NULL, &parse, &sl[i] );
+	}
+	(void) parse( &sl[0] );
+	for( int i = 1; i < nslices; i++ )
+	{
+		pthread_join( sl[i].tid, NULL );
+	}
+	if( wl->last != NULL )
+	{
+		sl[nslices].from = wl->last;
+		sl[nslices].to = wl->last + strlen( wl->last );
+		(void) parse( &sl[nslices] );
+		nslices++;
+	}
+
+	joinslices( wl, sl, nslices );
+	return wl;
+}
+
+
+/*
+ * Free the given word list (and so all its words)
+ */
+void wordlistFree( wordlist wl )
+{
+	if( wl->map != NULL ) munmap( wl->map, wl->size );
+	free( (void *) wl->last );
+	free( (void *) wl->word );
+	free( (void *) wl->len );
+	free( (void *) wl->freq );
+	free( (void *) wl );
+}
+
+
+/*
+ * How many words (non-blank lines) does wl have?
+ */
+int wordlistCount( wordlist wl )
+{
+	return wl->n;
+}
+
+
+/*
+ * The words of wl, in file order, lower cased and '\0' terminated
+ */
+char **wordlistWords( wordlist wl )
+{
+	return wl->word;
+}
+
+
+/*
+ * The lengths of the words of wl
+ */
+int *wordlistLens( wordlist wl )
+{
+	return wl->len;
+}
+
+
+/*
+ * The frequencies of the words of wl (1 for those with none), or NULL
+ * if none of them has one
+ */
+double *wordlistFreqs( wordlist wl )
+{
+	return wl->freq;
+}
+
+
+/*
+ * How many bytes long was wl's file?
+ */
+size_t wordlistBytes( wordlist wl )
+{
+	return wl->size;
+}
+
+
+/*
+ * The body of a slice's thread: find, lower case and terminate each
+ * word in the slice.  Each line's word ends at the first newline, CR,
+ * space or tab; if that's a space or tab, a frequency may follow it.
+ * Lines with no word (blank, or starting with a space) are skipped.
+ */
+static void *parse( void *arg )
+{
+	slice *sl = (slice *) arg;
+	char *p = sl->from;
+	while( p < sl->to )
+	{
+		char *nl = memchr( p, '\n', sl->to - p );
+		if( nl == NULL ) nl = sl->to;
+		char *q = p;
+		while( q < nl && ! ENDSWORD( *q ) ) q++;
+		double freq = 1.0;
+		if( q < nl && (*q == ' ' || *q == '\t') )
+		{
+			freq = parsefreq( q+1, nl );
+		}
+		if( q > p )
+		{
+			lowercopy( p, p, q-p );
+			*q = '\0';
+			addword( sl, p, q-p, freq );
+		}
+		p = nl+1;
+	}
+	return NULL;
+}
+
+
+/*
+ * double freq = parsefreq( p, nl );
+ *	Parse the frequency starting at <p>, in the line ending at <nl>:
+ *	it must start right there (not at more white space, which strtod()
+ *	would skip, newlines and all, on into the next line) and take up
+ *	the rest of the line, bar a CR, and be a positive number (log()
+ *	of anything else is NaN or -inf).  If it isn't, the word gets the
+ *	default frequency, 1.
+ */
+static double parsefreq( char *p, char *nl )
+{
+	if( p >= nl || isspace( (unsigned char) *p ) ) return 1.0;
+	char *end;
+	double freq = strtod( p, &end );
+	if( end == p || (end != nl && *end != '\r') ) return 1.0;
+	if( ! (freq > 0 && freq < HUGE_VAL) ) return 1.0;	/* NaN too */
+	return freq;
+}
+
+
+/*
+ * addword( sl, word, len, freq );
+ *	Add <word> (of length <len>, with frequency <freq>) to slice sl's
+ *	words.  We only keep frequencies once there's one that isn't 1.
+ */
+static void addword( slice *sl, char *word, int len, double freq )
+{
+	if( sl->n == sl->max )
+	{
+		sl->max = sl->max == 0 ? 1024 : 2*sl->max;
+		sl->word = (char **) realloc( sl->word, sl->max*sizeof(char *) );
+		sl->len = (int *) realloc( sl->len, sl->max*sizeof(int) );
+		assert( sl->word != NULL && sl->len != NULL );
+		if( sl->freq != NULL )
+		{
+			sl->freq = (double *) realloc( sl->freq, sl->max*sizeof(double) );
+			assert( sl->freq != NULL );
+		}
+	}
+	if( freq != 1.0 && sl->freq == NULL )
+	{
+		sl->freq = (double *) malloc( sl->max*sizeof(double) );
+		assert( sl->freq != NULL );
+		for( int i = 0; i < sl->n; i++ )
+		{
+			sl->freq[i] = 1.0;
+		}
+	}
+	sl->word[sl->n] = word;
+	sl->len[sl->n] = len;
+	if( sl->freq != NULL ) sl->freq[sl->n] = freq;
+	sl->n++;
+}
+
+
+/*
+ * joinslices( wl, sl, nslices );
+ *	Gather the words of all <nslices> slices sl[], in order, into wl,
+ *	freeing the slices' own arrays.
+ */
+static void joinslices( wordlist wl, slice *sl, int nslices )
+{
+	int n = 0;
+	int anyfreq = 0;
+	for( int i = 0; i < nslices; i++ )
+	{
+		n += sl[i].n;
+		if( sl[i].freq != NULL ) anyfreq = 1;
+	}
+	wl->n = n;
+	wl->word = (char **) malloc( (n+1)*sizeof(char *) );
+	wl->len = (int *) malloc( (n+1)*sizeof(int) );
+	assert( wl->word != NULL && wl->len != NULL );
+	if( anyfreq )
+	{
+		wl->freq = (double *) malloc( (n+1)*sizeof(double) );
+		assert( wl->freq != NULL );
+	}
+
+	int at = 0;
+	for( int i = 0; i < nslices; i++ )
+	{
+		if( sl[i].n > 0 )	/* else its arrays are NULL */
+		{
+			memcpy( wl->word+at, sl[i].word, sl[i].n*sizeof(char *) );
+			memcpy( wl->len+at, sl[i].len, sl[i].n*sizeof(int) );
+		}
+		for( int j = 0; anyfreq && j < sl[i].n; j++ )
+		{
+			wl->freq[at+j] = sl[i].freq != NULL ? sl[i].freq[j] : 1.0;
+		}
+		at += sl[i].n;
+		free( (void *) sl[i].word );
+		free( (void *) sl[i].len );
+		free( (void *) sl[i].freq );
+	}
+}
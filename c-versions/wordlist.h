@@ -0,0 +1,16 @@
+/*
+ * wordlist.h: read a whole word list file at once, fast: mapped in,
+ *	       split into lines and lower cased by several threads..
+ *
+ * (C) Duncan C. White, 2017
+ */
+
+typedef struct wordlist_s *wordlist;
+
+extern wordlist wordlistRead( char *filename );
+extern void wordlistFree( wordlist wl );
+extern int wordlistCount( wordlist wl );
+extern char **wordlistWords( wordlist wl );
+extern int *wordlistLens( wordlist wl );
+extern double *wordlistFreqs( wordlist wl );
+extern size_t wordlistBytes( wordlist wl );